@@ -3,6 +3,10 @@
 #include "util/Util.h"
 #include "util/Logger.h"
 #include "util/FileHandler.h"
+#include "util/Trace.h"
+#include "util/Metrics.h"
+#include "util/InputRecording.h"
+#include "util/FrameScheduler.h"
 #include "window/WindowHandler.h"
 #include "render/RenderHandler.h"
 #include "pdf/PDFHandler.h"
\ No newline at end of file
@@ -1,24 +1,31 @@
 #include "PDFHandler.h"
 
-PDFHandler::AnnotationHandler::InkStroke::InkStroke(std::vector<Point2D<float>>* p) {
-	m_points = p;
+// name of the custom annotation entry that holds the pressure of every point
+constexpr const char* PRESSURE_ANNOT_KEY = "StylusPressure";
+
+PDFHandler::AnnotationHandler::InkStroke::InkStroke(QuantizedStroke&& p, std::vector<byte>* pressure) {
+	m_points = std::move(p);
+	m_pressure = pressure;
 }
 
 PDFHandler::AnnotationHandler::InkStroke::~InkStroke() {
-	delete m_points;
-	//SafeRelease(&m_bezierCurveGeometry);
-	if (m_bezierCurveGeometry != nullptr)
-		Logger::add(m_bezierCurveGeometry->Release());
+	delete m_pressure;
+	SafeRelease(&m_outlineGeometry);
 	SafeRelease(&m_strokeBrush);
 	SafeRelease(&m_strokeStyle);
 }
 
 PDFHandler::AnnotationHandler::InkStroke& PDFHandler::AnnotationHandler::InkStroke::operator=(InkStroke&& s) {
-	this->m_points = s.m_points;
-	s.m_points = nullptr;
+	this->m_points = std::move(s.m_points);
+
+	this->m_pressure = s.m_pressure;
+	s.m_pressure = nullptr;
+
+	this->m_outlineGeometry = s.m_outlineGeometry;
+	s.m_outlineGeometry = nullptr;
 
-	this->m_bezierCurveGeometry = s.m_bezierCurveGeometry;
-	s.m_bezierCurveGeometry = nullptr;
+	this->m_outlineSize = s.m_outlineSize;
+	s.m_outlineSize = 0;
 
 	this->m_strokeBrush = s.m_strokeBrush;
 	s.m_strokeBrush = nullptr;
@@ -36,11 +43,16 @@ PDFHandler::AnnotationHandler::InkStroke& PDFHandler::AnnotationHandler::InkStro
 }
 
 PDFHandler::AnnotationHandler::InkStroke::InkStroke(InkStroke&& s) { 
-	this->m_points = s.m_points;
-	s.m_points = nullptr;
+	this->m_points = std::move(s.m_points);
 
-	this->m_bezierCurveGeometry = s.m_bezierCurveGeometry;
-	s.m_bezierCurveGeometry = nullptr;
+	this->m_pressure = s.m_pressure;
+	s.m_pressure = nullptr;
+
+	this->m_outlineGeometry = s.m_outlineGeometry;
+	s.m_outlineGeometry = nullptr;
+
+	this->m_outlineSize = s.m_outlineSize;
+	s.m_outlineSize = 0;
 
 	this->m_strokeBrush = s.m_strokeBrush;
 	s.m_strokeBrush = nullptr;
@@ -55,13 +67,12 @@ PDFHandler::AnnotationHandler::InkStroke::InkStroke(InkStroke&& s) {
 	s.m_boundingBox = { {0, 0}, 0, 0 };
 }
 
-PDFHandler::AnnotationHandler::PdfStroke::PdfStroke(fz_context* ctx, pdf_annot* annot, Point2D<float> offset) {
+PDFHandler::AnnotationHandler::PdfStroke::PdfStroke(fz_context* ctx, pdf_annot* annot) {
 	this->ctx = ctx;
 	pdf_keep_annot(ctx, annot);
 	m_annot = annot;
 
 	m_boundingBox = Rect2D<float>(pdf_bound_annot(ctx, m_annot));
-	m_boundingBox.upperleft += offset;
 
 	auto amountOfStrokes = pdf_annot_ink_list_count(ctx, annot);
 	if (amountOfStrokes > 1) {
@@ -69,17 +80,28 @@ PDFHandler::AnnotationHandler::PdfStroke::PdfStroke(fz_context* ctx, pdf_annot*
 	}
 
 	auto strokeCount = pdf_annot_ink_list_stroke_count(ctx, annot, 0);
-	m_points = new std::vector<Point2D<float>>();
+	std::vector<Point2D<float>> points;
+	points.reserve(strokeCount);
 	for (size_t k = 0; k < strokeCount; k++) {
-		m_points->push_back(Point2D<float>(pdf_annot_ink_list_stroke_vertex(ctx, annot, 0, k)) + offset);
+		points.push_back(Point2D<float>(pdf_annot_ink_list_stroke_vertex(ctx, annot, 0, k)));
 	}
+	m_points = QuantizedStroke(points);
 
 	m_strokeWidth = pdf_annot_border_width(ctx, annot);
+
+	// the pressure is saved in a custom entry of the annotation
+	auto pressure = pdf_dict_gets(ctx, pdf_annot_obj(ctx, annot), PRESSURE_ANNOT_KEY);
+	if (pdf_is_string(ctx, pressure)) {
+		size_t len = 0;
+		auto data = (const byte*)pdf_to_string(ctx, pressure, &len);
+		if (len == m_points.size())
+			m_pressure = new std::vector<byte>(data, data + len);
+	}
 }
 
 PDFHandler::AnnotationHandler::PdfStroke::~PdfStroke() {
 	pdf_drop_annot(ctx, m_annot);
-	delete m_points;
+	delete m_pressure;
 }
 
 PDFHandler::AnnotationHandler::PdfStroke& PDFHandler::AnnotationHandler::PdfStroke::operator=(PdfStroke&& s) {
@@ -89,8 +111,13 @@ PDFHandler::AnnotationHandler::PdfStroke& PDFHandler::AnnotationHandler::PdfStro
 	this->m_annot = s.m_annot;
 	s.m_annot = nullptr;
 
-	this->m_points = s.m_points;
-	s.m_points = nullptr;
+	this->m_points = std::move(s.m_points);
+
+	this->m_pressure = s.m_pressure;
+	s.m_pressure = nullptr;
+
+	this->m_pressureView = s.m_pressureView;
+	s.m_pressureView = nullptr;
 
 	this->m_strokeWidth = s.m_strokeWidth;
 	s.m_strokeWidth = 0;
@@ -108,8 +135,13 @@ PDFHandler::AnnotationHandler::PdfStroke::PdfStroke(PdfStroke&& s) {
 	this->m_annot = s.m_annot;
 	s.m_annot = nullptr;
 
-	this->m_points = s.m_points;
-	s.m_points = nullptr;
+	this->m_points = std::move(s.m_points);
+
+	this->m_pressure = s.m_pressure;
+	s.m_pressure = nullptr;
+
+	this->m_pressureView = s.m_pressureView;
+	s.m_pressureView = nullptr;
 
 	this->m_strokeWidth = s.m_strokeWidth;
 	s.m_strokeWidth = 0;
@@ -131,12 +163,19 @@ void PDFHandler::AnnotationHandler::InkStroke::setStrokeStyle(ID2D1StrokeStyle*
 	m_strokeStyle = style;
 }
 
-PDFHandler::AnnotationHandler::AnnotationHandler(PDFHandler::PDF* pdf, RenderHandler::PDFBuilder* context) {
+PDFHandler::AnnotationHandler::AnnotationHandler(PDFHandler::PDF* pdf, RenderHandler::PDFBuilder* context, const std::wstring& sidecar) {
 	m_pdf = pdf;
 	m_pdfbuilder = context;
+	m_memory = MemoryBudget::add("ink.strokes", 1);
 	m_inkstrokes = std::vector<std::list<InkStroke>*>(m_pdf->getNumberOfPages(), nullptr); 
 	m_strokeBuilder = new RenderHandler::StrokeBuilder();
+	initCapture();
 
+	auto time = TimeSince1970();
+	if (!sidecar.empty())
+		loadSidecar(sidecar);
+	size_t sidecarStrokes = 0;
+	size_t importedStrokes = 0;
 
 	auto ctx = pdf->m_pdfcontext->getctx();
 	for (size_t i = 0; i < m_pdf->getNumberOfPages(); i++) {
@@ -151,18 +190,28 @@ PDFHandler::AnnotationHandler::AnnotationHandler(PDFHandler::PDF* pdf, RenderHan
 			m_pdfinkannotations.push_back(nullptr);
 		else*/
 		m_pdfinkannotations.push_back(new std::vector<PdfStroke>());
-		
-		auto offset = context->getSizeAndPositionOfPage(i).upperleft;
 
+		size_t inkindex = 0;
 		while (annot) {
 			// TODO support for other types of annotattions?
 			// for now just support ink annotations
 			if (pdf_annot_type(ctx, annot) == PDF_ANNOT_INK) {
-				m_pdfinkannotations[i]->push_back(std::move(PdfStroke(ctx, annot, offset)));  
+				// only take the stroke from the sidecar if it still matches the annotation
+				auto entry = getSidecarStroke(i, inkindex++);
+				if (entry != nullptr && (int)entry->m_points.m_size == pdf_annot_ink_list_stroke_count(ctx, annot, 0)) {
+					m_pdfinkannotations[i]->push_back(std::move(PdfStroke(ctx, annot, *entry, m_sidecar.data)));
+					sidecarStrokes++;
+				}
+				else {
+					m_pdfinkannotations[i]->push_back(std::move(PdfStroke(ctx, annot)));
+					importedStrokes++;
+				}
+				trackStroke(true, m_pdfinkannotations[i]->back().m_points, m_pdfinkannotations[i]->back().m_pressure);
 			}
 			annot = pdf_next_annot(ctx, annot);
 		}
 	}
+	LOG_INFO(L"Loaded {} strokes from the sidecar and imported {} ink annotations in {}ms", sidecarStrokes, importedStrokes, TimeSince1970() - time);
 
 	// create the resources for the ink strokes
 	if (context->m_rendercontext->getRenderTarget()->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::Blue), &(m_currentInkBrush)) != S_OK) {
@@ -221,8 +270,13 @@ PDFHandler::AnnotationHandler::AnnotationHandler(AnnotationHandler&& a) {
 	m_pdfbuilder = a.m_pdfbuilder;
 	m_pdfinkannotations = std::move(a.m_pdfinkannotations);
 	m_inkstrokes = std::move(a.m_inkstrokes);
+	m_sidecar = std::move(a.m_sidecar);
+	m_memory = a.m_memory;
+	m_capture = std::move(a.m_capture);
+	initCapture();
 
 	a.m_pdf = nullptr;
+	a.m_memory = nullptr;
 }
 
 PDFHandler::AnnotationHandler& PDFHandler::AnnotationHandler::operator=(AnnotationHandler&& a) {
@@ -230,8 +284,13 @@ PDFHandler::AnnotationHandler& PDFHandler::AnnotationHandler::operator=(Annotati
 	m_pdfbuilder = a.m_pdfbuilder;
 	m_pdfinkannotations = std::move(a.m_pdfinkannotations);
 	m_inkstrokes = std::move(a.m_inkstrokes);
+	m_sidecar = std::move(a.m_sidecar);
+	m_memory = a.m_memory;
+	m_capture = std::move(a.m_capture);
+	initCapture();
 
 	a.m_pdf = nullptr;
+	a.m_memory = nullptr;
 
 	return *this;
 }
@@ -240,86 +299,30 @@ PDFHandler::AnnotationHandler::~AnnotationHandler() {
 	// dont delete the pdf or the builder because we are borrowing them
 	for (size_t i = 0; i < m_pdfinkannotations.size(); i++) {
 		if (m_pdfinkannotations[i] != nullptr) {
+			for (auto& stroke : *m_pdfinkannotations[i]) {
+				trackStroke(false, stroke.m_points, stroke.m_pressure);
+			}
 			delete m_pdfinkannotations[i];
 		}
 	}
 
 	for (size_t i = 0; i < m_inkstrokes.size(); i++) {
+		if (m_inkstrokes[i] == nullptr)
+			continue;
+		for (auto& stroke : *m_inkstrokes[i]) {
+			trackStroke(false, stroke.m_points, stroke.m_pressure, stroke.m_outlineSize);
+		}
 		delete m_inkstrokes[i];
 	}
+	// the sidecar is unmapped after the strokes that point into it are gone
+	m_sidecar.close();
+	MemoryBudget::remove(m_memory);
 
 	SafeRelease(&m_currentInkBrush);
 	SafeRelease(&m_currentLineStyle);
 }
 
-void calcBoundingBox(Rect2D<float>& a, Point2D<float> p) {
-	if (a.upperleft.x > p.x) {
-		a.width += std::abs(p.x - a.upperleft.x);
-		a.upperleft.x = p.x;
-	}
-	if (a.upperleft.y > p.y) {
-		a.height += std::abs(p.y - a.upperleft.y);
-		a.upperleft.y = p.y;
-	}
-	a.width = max(a.width, std::abs(p.x - a.upperleft.x));
-	a.height = max(a.height, std::abs(p.y - a.upperleft.y));
-}
-
-Rect2D<float> getBoundingBox(std::vector<Point2D<float>>* points) {
-	Rect2D<float> r(points->at(0), 0, 0);
-	for (size_t i = 0; i < points->size(); i++) {
-		calcBoundingBox(r, points->at(i));
-	}
-	return r;
-}
-
-// https://www.quantstart.com/articles/Tridiagonal-Matrix-Algorithm-Thomas-Algorithm-in-C/
-void solveTridiagonal(std::vector<float>& a,
-					  std::vector<float>& b,
-					  std::vector<float>& c,
-					  std::vector<Point2D<float>>& d,
-					  std::vector<Point2D<float>>& x) {
-	for (size_t i = 1; i < d.size(); i++) {
-		auto w = a[i - 1] / b[i - 1];
-		b[i] = b[i] - w * c[i - 1];
-		d[i] = d[i] - w * d[i - 1];
-	}
-
-	x[d.size() - 1] = d[d.size() - 1] / b[d.size() - 1];
-	for (int i = d.size() - 2; i >= 0; i--) {
-		x[i] = (d[i] - c[i] * x[i + 1]) / b[i];
-	}
-}
-
-//https://towardsdatascience.com/b%C3%A9zier-interpolation-8033e9a262c2
-void calcBezierPoints(const std::vector<Point2D<float>>* points, std::vector<Point2D<float>>& a, std::vector<Point2D<float>>& b) {
-	//create the vectos
-	auto n = points->size() - 1;
-	std::vector<Point2D<float>> p(n);
-
-	p[0] = points->at(0) + 2 * points->at(1);
-	for (size_t i = 1; i < n - 1; i++) {
-		p[i] = 2 * (2 * points->at(i) + points->at(i + 1));
-	}
-	p[n - 1] = 8 * points->at(n - 1) + points->at(n); 
-
-	// matrix
-	std::vector<float> m_a(n - 1, 1);
-	std::vector<float> m_b(n, 4);
-	std::vector<float> m_c(n - 1, 1);
-	m_a[n - 2] = 2;
-	m_b[0] = 2;
-	m_b[n - 1] = 7;
-
-	solveTridiagonal(m_a, m_b, m_c, p, a);
-
-	b[n - 1] = (a[n - 1] + points->at(n)) / 2.0;
-	for (size_t i = 0; i < n - 1; i++) {
-		b[i] = 2 * points->at(i + 1) - a[i + 1];
-	}
-}
-
-ID2D1PathGeometry* createBezierPathGeometry(ID2D1Factory* factory, const std::vector<Point2D<float>>* points, const std::vector<Point2D<float>>& a, const std::vector<Point2D<float>>& b) {
+ID2D1PathGeometry* createOutlinePathGeometry(ID2D1Factory* factory, const std::vector<Point2D<float>>& outline) {
 	ID2D1PathGeometry* geo = NULL;
 	ID2D1GeometrySink* pSink = NULL;
 	if (factory->CreatePathGeometry(&geo) != S_OK) {
@@ -327,15 +330,13 @@ ID2D1PathGeometry* createBezierPathGeometry(ID2D1Factory* factory, const std::ve
 		return nullptr;
 	}
 	geo->Open(&pSink);
-	pSink->BeginFigure({ (float)points->at(0).x,(float)points->at(0).y }, D2D1_FIGURE_BEGIN_FILLED);
-	D2D1_BEZIER_SEGMENT seg;
-	for (size_t i = 0; i < a.size() - 1; i++) {
-		seg.point1 = { (float)a[i].x, (float)a[i].y };
-		seg.point2 = { (float)b[i].x, (float)b[i].y };
-		seg.point3 = { (float)points->at(i + 1).x,(float)points->at(i + 1).y };
-		pSink->AddBezier(seg);
+	// the outline can overlap itself
+	pSink->SetFillMode(D2D1_FILL_MODE_WINDING);
+	pSink->BeginFigure(outline[0], D2D1_FIGURE_BEGIN_FILLED);
+	for (size_t i = 1; i < outline.size(); i++) {
+		pSink->AddLine(outline[i]);
 	}
-	pSink->EndFigure(D2D1_FIGURE_END_OPEN);
+	pSink->EndFigure(D2D1_FIGURE_END_CLOSED);
 	pSink->Close();
 
 	SafeRelease(&pSink);
@@ -343,172 +344,143 @@ ID2D1PathGeometry* createBezierPathGeometry(ID2D1Factory* factory, const std::ve
 	return geo;
 }
 
+// replaces the appearance of the annotation with the filled outline so other pdf viewers show the same stroke
+void setFilledAppearance(fz_context* ctx, pdf_annot* annot, const std::vector<Point2D<float>>& outline, float color[3]) {
+	fz_path* path = fz_new_path(ctx);
+	fz_moveto(ctx, path, outline[0].x, outline[0].y);
+	for (size_t i = 1; i < outline.size(); i++) {
+		fz_lineto(ctx, path, outline[i].x, outline[i].y);
+	}
+	fz_closepath(ctx, path);
 
-void PDFHandler::AnnotationHandler::strokeEnd(std::vector<Point2D<float>>* points, long page) {
-	InkStroke newStroke(points);
-	newStroke.m_boundingBox = getBoundingBox(points);
+	auto list = fz_new_display_list(ctx, fz_bound_path(ctx, path, nullptr, fz_identity));
+	auto dev = fz_new_list_device(ctx, list);
+	fz_fill_path(ctx, dev, path, 0, fz_identity, fz_device_rgb(ctx), color, 1.0f, fz_default_color_params);
+	fz_close_device(ctx, dev);
+	fz_drop_device(ctx, dev);
 
-	newStroke.setStrokeBrush(m_currentInkBrush);
-	newStroke.setStrokeStyle(m_currentLineStyle);
-	newStroke.m_strokeWidth = m_currentStrokeWidht;
+	pdf_set_annot_appearance_from_display_list(ctx, annot, "N", nullptr, fz_identity, list);
+	// writing the appearance marks the annotation as edited and an edited annotation gets a new generated appearance
+	// on the next pdf_update_annot or pdf_update_page. Mark it as clean so mupdf keeps the outline as a user supplied appearance
+	pdf_clean_obj(ctx, pdf_annot_obj(ctx, annot));
 
-	// create bezier stuff
-	std::vector<Point2D<float>> ai(points->size() - 1);
-	std::vector<Point2D<float>> bi(points->size() - 1);
-	calcBezierPoints(points, ai, bi);
-	newStroke.m_bezierCurveGeometry = createBezierPathGeometry(m_pdfbuilder->m_rendercontext->getFactory(), points, ai, bi);
+	fz_drop_display_list(ctx, list);
+	fz_drop_path(ctx, path);
+}
 
-	// put the new stroke into the m_inkstroke vector
-	m_inkstrokes[page]->push_back(std::move(newStroke));
+
+void PDFHandler::AnnotationHandler::initCapture() {
+	m_capture.setPages(m_pdf->getNumberOfPages(), [this](size_t page) { return m_pdfbuilder->getSizeAndPositionOfPage(page); });
+	m_capture.setCallbacks(
+		[this](UINT32 id, Point2D<float> from, Point2D<float> to, byte pressure, UINT64 timestamp, bool merged) { strokeLine(id, from, to, pressure, timestamp, merged); },
+		[this](UINT32 id, StrokeCapture::Stroke&& stroke) { strokeEnd(std::move(stroke)); });
 }
 
-void PDFHandler::AnnotationHandler::startStroke(Point2D<float> p, UINT32 id) {
-	m_dynamicStroke[id] = std::make_tuple(new std::vector<Point2D<float>>(), -1);
-	for (size_t i = 0; i < m_pdf->getNumberOfPages(); i++) {
-		if (m_pdfbuilder->getSizeAndPositionOfPage(i).intersects(p)) {
-			std::get<0>(m_dynamicStroke[id])->push_back(p);
-			std::get<1>(m_dynamicStroke[id]) = i;
-			break;
-		}
-	}
+void PDFHandler::AnnotationHandler::strokeLine(UINT32 id, Point2D<float> from, Point2D<float> to, byte pressure, UINT64 timestamp, bool merged) {
+	auto it = m_strokeLatency.find(id);
+	auto latency = it != m_strokeLatency.end() ? it->second : nullptr;
+	if (merged)
+		m_strokeBuilder->extendDynamicLine(from, to, pressureToWidth(m_currentStrokeWidht, pressure), timestamp, latency);
+	else
+		m_strokeBuilder->addDynamicLine(from, to, pressureToWidth(m_currentStrokeWidht, pressure), timestamp, latency);
 }
 
-void PDFHandler::AnnotationHandler::addStroke(Point2D<float> p, UINT32 id) {
-	if (m_dynamicStroke.find(id) == m_dynamicStroke.end())
-		return;
+void PDFHandler::AnnotationHandler::strokeEnd(StrokeCapture::Stroke&& stroke) {
+	TRACE_SCOPE("strokeEnd", "ink");
+	static auto& strokeendtime = Metrics::histogram("ink.stroke_end_us");
+	static auto& finishedstrokes = Metrics::counter("ink.strokes_finished");
+	auto start = Trace::now();
+	LOG_INFO(L"Stroke filter dropped {} of {} samples", stroke.m_droppedSamples, stroke.m_totalSamples);
 
-	auto& ref = m_dynamicStroke[id];
-	// check if the list is empty
-	if (std::get<0>(ref)->size() == 0) {
-		// iterate through all pages
-		for (size_t i = 0; i < m_pdf->getNumberOfPages(); i++) { 
-			// if the points is on a pdf page add the point to the list
-			if (m_pdfbuilder->getSizeAndPositionOfPage(i).intersects(p)) { 
-				std::get<0>(m_dynamicStroke[id])->push_back(p);
-				std::get<1>(m_dynamicStroke[id]) = i;
-				break;
-			}
-		}
-		return;
-	}
+	auto pressure = new std::vector<byte>(std::move(stroke.m_pressure));
+	InkStroke newStroke(QuantizedStroke(stroke.m_points), pressure);
+	newStroke.m_boundingBox = newStroke.m_points.getBoundingBox();
 
-	// everything is good
-	if (m_pdfbuilder->getSizeAndPositionOfPage(std::get<1>(ref)).intersects(p)) {
-		m_strokeBuilder->addDynamicLine(std::get<0>(ref)->back(), p);
-		std::get<0>(ref)->push_back(p); 
-		return;
-	}
+	newStroke.setStrokeBrush(m_currentInkBrush);
+	newStroke.setStrokeStyle(m_currentLineStyle);
+	newStroke.m_strokeWidth = m_currentStrokeWidht;
 
-	// point is not a pdf anymore 
-	// we dont need to delete the old vector because it will be deleted by the InkStroke object that 
-	// is created in the strokeEnd function
-	strokeEnd(std::get<0>(ref), std::get<1>(ref));
-	m_dynamicStroke[id] = std::make_tuple<std::vector<Point2D<float>>*, long>(new std::vector<Point2D<float>>(), -1);
-} 
+	// tessellate the stroke once so it doesnt have to be stroked every frame. The full precision points are only
+	// needed for the outline
+	auto outline = tessellateStroke(&stroke.m_points, pressure, m_currentStrokeWidht);
+	newStroke.m_outlineGeometry = createOutlinePathGeometry(m_pdfbuilder->m_rendercontext->getFactory(), outline);
+	newStroke.m_outlineSize = outline.size() * sizeof(D2D1_POINT_2F);
 
-void PDFHandler::AnnotationHandler::endStroke(Point2D<float> p, UINT32 id) {
-	if (m_dynamicStroke.find(id) == m_dynamicStroke.end())
-		return;
+	trackStroke(true, newStroke.m_points, newStroke.m_pressure, newStroke.m_outlineSize);
+	finishedstrokes.add();
 
-	auto& ref = m_dynamicStroke[id];
+	// put the new stroke into the m_inkstroke vector
+	auto page = stroke.m_page;
+	m_inkstrokes[page]->push_back(std::move(newStroke));
+	// a stroke with a single point has no dynamic line that shows it yet
+	m_pdfbuilder->m_rendercontext->invalidate(getStrokeArea(page, m_inkstrokes[page]->back()));
 
-	// check if the list is empty
-	if (std::get<0>(ref)->size() <= 2) {
-		delete std::get<0>(ref);
-		m_dynamicStroke.erase(id);
-		return;
-	}
+	strokeendtime.record((Trace::now() - start) / 1000);
+}
 
-	// check if the last point should be thrown away or not
-	if (m_pdfbuilder->getSizeAndPositionOfPage(std::get<1>(ref)).intersects(p)) {
-		// add point to list
-		m_strokeBuilder->addDynamicLine(std::get<0>(ref)->back(), p);
-		std::get<0>(ref)->push_back(p);
-	}
+void PDFHandler::AnnotationHandler::startStroke(Point2D<float> p, UINT32 id, UINT32 pressure, UINT64 timestamp, Metrics::Histogram* latency) {
+	if (timestamp == 0)
+		timestamp = Trace::now();
+	m_strokeLatency[id] = latency;
+	// the thresholds of the filter are in screen pixels so they have to be converted into document space
+	m_capture.setFilterScale(1.0f / (getContext()->getMatrixScaleOffset() * getContext()->DptoPx(1)));
+	m_capture.startStroke(p, id, pressure, timestamp);
+}
+
+void PDFHandler::AnnotationHandler::addStroke(Point2D<float> p, UINT32 id, UINT32 pressure, UINT64 timestamp) {
+	if (timestamp == 0)
+		timestamp = Trace::now();
+	m_capture.addStroke(p, id, pressure, timestamp);
+} 
 
-	// we dont need to delete the old vector because it will be deleted by the InkStroke object that 
-	// is created in the strokeEnd function
-	strokeEnd(std::get<0>(ref), std::get<1>(ref));
-	m_dynamicStroke.erase(id);
+void PDFHandler::AnnotationHandler::endStroke(Point2D<float> p, UINT32 id, UINT32 pressure, UINT64 timestamp) {
+	if (timestamp == 0)
+		timestamp = Trace::now();
+	m_capture.endStroke(p, id, timestamp);
+	m_strokeLatency.erase(id);
 } 
 
 void PDFHandler::AnnotationHandler::eraser(Point2D<float> p) {
+	TRACE_SCOPE("eraser", "ink");
+	static auto& erasedstrokes = Metrics::counter("ink.strokes_erased");
 	// first check on which page we are
-	bool foundpage = false;
-	size_t page = 0;
-	for (size_t i = 0; i < m_pdf->getNumberOfPages(); i++) {
-		if (m_pdfbuilder->getSizeAndPositionOfPage(i).intersects(p)) {
-			page = i;
-			foundpage = true;
-			break;
-		}
-	}
-	
-	//return if no page was found
-	if (!foundpage)
+	auto page = m_capture.findPage(p);
+	if (page == -1)
 		return;
 
-	// keep track if any line was removed
-	bool removedLine = false;
+	// the strokes are saved relative to their page
+	p -= m_capture.getPage(page).upperleft;
+
+	float eraserwidth = m_pdfbuilder->m_rendercontext->DptoPx(m_currentEraserWidht);
 
 	// do the custom strokes
-	auto it = m_inkstrokes[page]->begin();
-	while (it != m_inkstrokes[page]->end()) {
-		// check if bounding box intersects
-		bool isLineRemoved = false;
-		if (it->m_boundingBox.intersects(p)) {
-			// iterate through all points that define the stroke
-			for (size_t i = 1; i < it->m_points->size(); i++) {
-				// check if the distance between a line and the eraser tip is smaller than the widht of the line
-				// and the size of the eraser tip
-				if (pointToLineDistance(it->m_points->at(i), it->m_points->at(i - 1), p) < m_pdfbuilder->m_rendercontext->DptoPx(m_currentEraserWidht) + it->m_strokeWidth) { 
-					it = m_inkstrokes[page]->erase(it);
-					removedLine = true;
-					isLineRemoved = true;
-					break;
-				}
-			}
-		}
-		if (!isLineRemoved)
-			++it;
-	}
+	StrokeCapture::erase(*m_inkstrokes[page], p, eraserwidth, [&](InkStroke& stroke) {
+		trackStroke(false, stroke.m_points, stroke.m_pressure, stroke.m_outlineSize);
+		erasedstrokes.add();
+		// only the area of the stroke has to be drawn again
+		m_pdfbuilder->m_rendercontext->invalidate(getStrokeArea(page, stroke));
+	});
 
 	// do the pdf strokes
-	auto it2 = m_pdfinkannotations[page]->begin();
-	while (it2 != m_pdfinkannotations[page]->end()) {
-		bool isLineRemoved = false;
-		if (it2->m_boundingBox.intersects(p)) {
-			// edge case were m_points == 1
-			if (it2->m_points->size() == 1) {
-				if (it2->m_points->at(0).distance(p) < m_pdfbuilder->m_rendercontext->DptoPx(m_currentEraserWidht) + it2->m_strokeWidth) {
-					pdf_delete_annot(m_pdf->m_pdfcontext->getctx(), m_pdf->getPage(page), it2->m_annot);
-					it2 = m_pdfinkannotations[page]->erase(it2);
-					removedLine = true;
-					isLineRemoved = true;
-				}
-			}
-			else {
-				for (size_t i = 1; i < it2->m_points->size(); i++) {
-					if (pointToLineDistance(it2->m_points->at(i), it2->m_points->at(i - 1), p) < m_pdfbuilder->m_rendercontext->DptoPx(m_currentEraserWidht) + it2->m_strokeWidth) {
-						pdf_delete_annot(m_pdf->m_pdfcontext->getctx(), m_pdf->getPage(page), it2->m_annot);
-						it2 = m_pdfinkannotations[page]->erase(it2);
-						removedLine = true;
-						isLineRemoved = true;
-						break;
-					}
-				}
-			}
-		}
-		if (!isLineRemoved)
-			++it2;
-	}
+	auto erased = StrokeCapture::erase(*m_pdfinkannotations[page], p, eraserwidth, [&](PdfStroke& stroke) {
+		trackStroke(false, stroke.m_points, stroke.m_pressure);
+		erasedstrokes.add();
+		pdf_delete_annot(m_pdf->m_pdfcontext->getctx(), m_pdf->getPage(page), stroke.m_annot);
+	});
+	// the annotations are part of the rendered page
+	if (erased != 0)
+		m_pdfbuilder->invalidatePage(page);
+}
 
-	if (removedLine) {
-		m_pdfbuilder->m_rendercontext->render();
-	}
+Rect2D<float> PDFHandler::AnnotationHandler::getStrokeArea(size_t page, const InkStroke& stroke) const {
+	// the outline is at most half of the widest line away from the points. The rest is room for the curve fitting
+	float margin = pressureToWidth(stroke.m_strokeWidth, PRESSURE_MAX);
+	auto box = stroke.m_boundingBox + m_pdfbuilder->getSizeAndPositionOfPage(page).upperleft;
+	return Rect2D<float>({ box.upperleft.x - margin, box.upperleft.y - margin }, box.width + 2 * margin, box.height + 2 * margin);
 }
 
 void PDFHandler::AnnotationHandler::bakeAnnotations() {
+	TRACE_SCOPE("bakeAnnotations", "save");
 	auto ctx = m_pdf->m_pdfcontext->getctx();
 
 	for (size_t i = 0; i < m_inkstrokes.size(); i++) {
@@ -519,11 +491,16 @@ void PDFHandler::AnnotationHandler::bakeAnnotations() {
 			// create annottation
 			pdf_annot* annot = nullptr;
 			annot = pdf_create_annot(ctx, page, PDF_ANNOT_INK);
+			// the points are already relative to the page
+			auto points = it->m_points.decode();
 			// add stroke and the points to the annotation
 			pdf_add_annot_ink_list_stroke(ctx, annot);
-			for (size_t j = 0; j < it->m_points->size(); j++) {
-				pdf_add_annot_ink_list_stroke_vertex(ctx, annot, it->m_points->at(j) - m_pdfbuilder->getSizeAndPositionOfPage(i).upperleft);
+			for (size_t j = 0; j < points.size(); j++) {
+				pdf_add_annot_ink_list_stroke_vertex(ctx, annot, points[j]);
 			}
+			// save the pressure so the stroke can be edited again
+			if (it->m_pressure != nullptr)
+				pdf_dict_puts_drop(ctx, pdf_annot_obj(ctx, annot), PRESSURE_ANNOT_KEY, pdf_new_string(ctx, (const char*)it->m_pressure->data(), it->m_pressure->size()));
 			// set the width
 			pdf_set_annot_border_width(ctx, annot, it->m_strokeWidth);
 			// and get color
@@ -534,14 +511,20 @@ void PDFHandler::AnnotationHandler::bakeAnnotations() {
 			pdf_set_annot_color(ctx, annot, 3, (float*)&color);
 			//update the annotation
 			pdf_update_annot(ctx, annot); 
-			// get the offset of the page
-			auto offset = m_pdfbuilder->getSizeAndPositionOfPage(i).upperleft;
+			// the generated appearance has a constant width so replace it with the variable width outline.
+			// This has to be the last change to the annotation, every setter after it would regenerate the appearance
+			setFilledAppearance(ctx, annot, tessellateStroke(&points, it->m_pressure, it->m_strokeWidth), color);
 			// push the annotation into the pdfinkannotation buffer
-			m_pdfinkannotations[i]->push_back(std::move(PdfStroke(ctx, annot, offset)));
+			m_pdfinkannotations[i]->push_back(std::move(PdfStroke(ctx, annot)));
+			trackStroke(false, it->m_points, it->m_pressure, it->m_outlineSize);
+			trackStroke(true, m_pdfinkannotations[i]->back().m_points, m_pdfinkannotations[i]->back().m_pressure);
 			// and remove reference from here
 			pdf_drop_annot(ctx, annot);
 			++it;
 		}
+		// the strokes are part of the rendered page now so the old renders and the cached ones are outdated
+		if (m_inkstrokes[i]->size() != 0)
+			m_pdfbuilder->invalidatePage(i);
 	}
 
 
@@ -550,12 +533,34 @@ void PDFHandler::AnnotationHandler::bakeAnnotations() {
 	}
 }
 
+void PDFHandler::AnnotationHandler::trackStroke(bool added, const QuantizedStroke& points, const std::vector<byte>* pressure, size_t outline) {
+	static auto& strokes = Metrics::gauge("ink.strokes");
+	static auto& memory = Metrics::gauge("ink.stroke_memory_bytes");
+	static auto& memoryperpage = Metrics::gauge("ink.memory_per_page_bytes");
+
+	INT64 sign = added ? 1 : -1;
+	INT64 size = (INT64)(points.getMemorySize() + (pressure != nullptr ? pressure->capacity() : 0));
+	strokes.add(sign);
+	memory.add(sign * size);
+	memoryperpage.set(memory.get() / (INT64)max(m_inkstrokes.size(), (size_t)1));
+	if (m_memory != nullptr)
+		m_memory->addSize(sign * (size + (INT64)outline));
+}
+
 RenderHandler::StrokeBuilder* PDFHandler::AnnotationHandler::getStrokeBuilder() const {
 	return m_strokeBuilder;
 }
 
 bool PDFHandler::AnnotationHandler::isStrokeinProgress() const {
-	return m_dynamicStroke.size() != 0;
+	return m_capture.isStrokeInProgress();
+}
+
+void PDFHandler::AnnotationHandler::setStrokeFilterSettings(const StrokeFilter::Settings& s) {
+	m_capture.setFilterSettings(s);
+}
+
+std::tuple<size_t, size_t> PDFHandler::AnnotationHandler::getStrokeFilterStatistics() const {
+	return std::tuple<size_t, size_t>(m_capture.getDroppedSamples(), m_capture.getTotalSamples());
 }
 
 RenderHandler::Direct2DContext* PDFHandler::AnnotationHandler::getContext() const {
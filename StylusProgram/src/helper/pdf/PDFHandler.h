@@ -4,6 +4,17 @@
 #include "util/FileHandler.h"
 #include <mupdf/fitz.h>
 #include "util/Logger.h"
+#include "util/StrokeFilter.h"
+#include "util/StrokeCapture.h"
+#include "util/StrokeGeometry.h"
+#include "util/QuantizedStroke.h"
+#include "util/Trace.h"
+#include "util/Metrics.h"
+#include "util/MemoryBudget.h"
+#include "pdf/PageRender.h"
+#include "pdf/RenderWorker.h"
+#include "pdf/RenderCache.h"
+#include "pdf/ThumbnailService.h"
 #include "mupdf/pdf.h"
 
 #ifndef PDF_HANDLER_H
@@ -25,7 +36,10 @@ namespace PDFHandler {
 		fz_context* ctx = nullptr;
 	public:
 		fz_page* page = nullptr;
+		// what mupdf kept while the page was loaded
+		size_t memory = 0;
 
+		PdfPage() = default;
 		PdfPage(fz_context* ctx, fz_page* page); 
 		PdfPage(const PdfPage& p) = delete;
 		PdfPage& operator=(const PdfPage& p) = delete;
@@ -41,7 +55,12 @@ namespace PDFHandler {
 	struct PDF : public FileHandler::File {
 		fz_document* m_doc = nullptr;
 		MUPDF* m_pdfcontext = nullptr;
+		// a page is loaded again by getPage after it was released
 		std::vector<PdfPage> m_pages;
+		// the memory of all loaded pages
+		size_t m_pageMemory = 0;
+
+		void loadPage(size_t page);
 
 		PDF() = default;
 		PDF(MUPDF* context, fz_document* doc);
@@ -52,26 +71,95 @@ namespace PDFHandler {
 		~PDF();
 
 		RenderHandler::Bitmap createBitmapFromPage(RenderHandler::Direct2DContext* context, unsigned int page, Rect2D<float> rec, float dpi = 72);
-		RenderHandler::Bitmap createBitmapFromPage(RenderHandler::Direct2DContext* context, unsigned int page, Rect2D<float> destination, Rect2D<float> source, float dpi = 72);
+		// a draft renders faster with less quality. It is used while the view is moving
+		RenderHandler::Bitmap createBitmapFromPage(RenderHandler::Direct2DContext* context, unsigned int page, Rect2D<float> destination, Rect2D<float> source, float dpi = 72, bool draft = false);
+		// the pixels createBitmapFromPage uploads. The pixmap has to be dropped
+		fz_pixmap* renderPixmap(unsigned int page, Rect2D<float> destination, Rect2D<float> source, float dpi = 72, bool draft = false);
+		// uploads a pixmap of the render worker. The pixmap is not dropped
+		RenderHandler::Bitmap createBitmapFromPixmap(RenderHandler::Direct2DContext* context, fz_pixmap* pix, float dpi = 72);
+		// records the page for the render worker. Returns null if the page couldn't be recorded. The memory of the
+		// list is claimed from the mupdf memory and has to be given back when it is dropped
+		fz_display_list* createDisplayList(unsigned int page, size_t* memory = nullptr);
 		Rect2D<float> getPageSize(unsigned int page, float dpi = 72);
 
-		void save(const std::wstring& s);
-		// returns a pdfpage
+		// returns the hash of the saved file
+		UINT64 save(const std::wstring& s);
+		// returns a pdfpage. Loads it if it was released
 		PdfPage& getPage(size_t page);
 		size_t getNumberOfPages();
+		// Drops the loaded page and returns the freed bytes. Pages with annotations are kept because the strokes
+		// point to their annotations
+		size_t releasePage(size_t page);
+		size_t getPageMemory() const;
 	};
 
+	// Binary file next to the pdf that holds the strokes of all pages. The tables and the point data are laid out so the
+	// file can be mapped into memory and the strokes can use the data directly without parsing anything.
+	// The pdf annotations stay the format for other programs. The sidecar is only used if it was written for the exact
+	// same pdf file and the stroke tables are in the same order as the ink annotations of each page.
+	// Layout: [Header][PageEntry * pages][StrokeEntry * strokes][point data and pressure of every stroke]
+	namespace Sidecar {
+		constexpr char MAGIC[4] = { 'S', 'P', 'I', 'K' };
+		// has to be increased if the layout changes
+		constexpr UINT32 VERSION = 1;
+		// every block of point data starts at a multiple of this
+		constexpr UINT64 DATA_ALIGNMENT = 8;
+
+		struct Header {
+			char m_magic[4];
+			UINT32 m_version;
+			// hash of the pdf file the sidecar belongs to
+			UINT64 m_pdfHash;
+			UINT64 m_pageCount;
+			UINT64 m_strokeCount;
+			// offsets from the start of the file
+			UINT64 m_pageTableOffset;
+			UINT64 m_strokeTableOffset;
+		};
+
+		struct PageEntry {
+			// index into the stroke table
+			UINT64 m_firstStroke;
+			UINT64 m_strokeCount;
+		};
+
+		struct StrokeEntry {
+			// offsets from the start of the file
+			UINT64 m_dataOffset;
+			// 0 if the stroke has no pressure. Otherwise one byte per point
+			UINT64 m_pressureOffset;
+			QuantizedStroke::Header m_points;
+			float m_strokeWidth;
+			// bounding box of the annotation. x, y, width, height
+			float m_boundingBox[4];
+		};
+
+		static_assert(sizeof(Header) == 48, "the sidecar header must not have padding");
+		static_assert(sizeof(PageEntry) == 16, "the sidecar page entry must not have padding");
+		static_assert(sizeof(StrokeEntry) == 72, "the sidecar stroke entry must not have padding");
+
+		// the sidecar file of the pdf
+		std::wstring getPath(const std::wstring& pdfpath);
+	}
+
+	// All strokes are saved relative to the upper left corner of their page. The position of the page
+	// is only applied when the strokes are rendered or hit tested so the layout of the pages can change freely
 	class AnnotationHandler {
 		struct InkStroke {
 			// the points that define a stroke
-			std::vector<Point2D<float>>* m_points;
-			ID2D1PathGeometry* m_bezierCurveGeometry = nullptr;
+			QuantizedStroke m_points;
+			// the pressure of every point
+			std::vector<byte>* m_pressure = nullptr;
+			// the filled outline of the stroke. It is only created once and reused every frame
+			ID2D1PathGeometry* m_outlineGeometry = nullptr;
 			ID2D1SolidColorBrush* m_strokeBrush = nullptr;
 			ID2D1StrokeStyle* m_strokeStyle = nullptr;
 			float m_strokeWidth = 1.0f;
 			Rect2D<float> m_boundingBox;
+			// about the memory of the outline geometry. Direct2D doesn't tell so it is the size of its vertices
+			size_t m_outlineSize = 0;
 
-			InkStroke(std::vector<Point2D<float>>* p);
+			InkStroke(QuantizedStroke&& p, std::vector<byte>* pressure);
 
 			~InkStroke();
 
@@ -87,12 +175,19 @@ namespace PDFHandler {
 		struct PdfStroke {
 			fz_context* ctx = nullptr;
 			pdf_annot* m_annot = nullptr;
-			std::vector<Point2D<float>>* m_points = nullptr;
+			QuantizedStroke m_points;
+			// can be null if the annotation has no pressure information or it is still in the sidecar
+			std::vector<byte>* m_pressure = nullptr;
+			// the pressure of every point in the mapped sidecar. It is copied into m_pressure when the sidecar is released
+			const byte* m_pressureView = nullptr;
 			float m_strokeWidth = 1.0f;
 			Rect2D<float> m_boundingBox;
 
 			//pdf annot are supposed to be only of type PDF_ANNOT_INK
-			PdfStroke(fz_context* ctx, pdf_annot* annot, Point2D<float> offset);
+			PdfStroke(fz_context* ctx, pdf_annot* annot);
+			// takes the points from a mapped sidecar file instead of reading every vertex of the annotation.
+			// The points and the pressure stay in the file so it has to stay mapped
+			PdfStroke(fz_context* ctx, pdf_annot* annot, const Sidecar::StrokeEntry& entry, const byte* file);
 
 			~PdfStroke();
 
@@ -108,7 +203,15 @@ namespace PDFHandler {
 		std::vector<std::vector<PdfStroke>*> m_pdfinkannotations;
 		std::vector<std::list<InkStroke>*> m_inkstrokes;
 
-		std::map<UINT32, std::tuple<std::vector<Point2D<float>>*, long>> m_dynamicStroke;
+		// the sidecar that was loaded with the pdf. The pdf strokes point into it
+		FileHandler::MappedFile m_sidecar;
+		// the strokes can't be created again so they only count towards the memory budget
+		MemoryBudget::Cache* m_memory = nullptr;
+
+		// filters the points of the strokes that are currently drawn and decides where they end
+		StrokeCapture m_capture;
+		// where the pen to ink latency of the stroke is reported. Can be null
+		std::map<UINT32, Metrics::Histogram*> m_strokeLatency;
 
 		//Render Stuff
 		ID2D1SolidColorBrush* m_currentInkBrush = nullptr;
@@ -118,12 +221,29 @@ namespace PDFHandler {
 
 		RenderHandler::StrokeBuilder* m_strokeBuilder;
 
-		void strokeEnd(std::vector<Point2D<float>>* points, long page);
+		// connects the stroke capture to the pages and the dynamic lines of this handler
+		void initCapture();
+		// draws a new part of the dynamic stroke
+		void strokeLine(UINT32 id, Point2D<float> from, Point2D<float> to, byte pressure, UINT64 timestamp, bool merged);
+		void strokeEnd(StrokeCapture::Stroke&& stroke);
+
+		// maps the sidecar and checks if it belongs to the pdf. Returns false if it can't be used
+		bool loadSidecar(const std::wstring& path);
+		// returns the stroke entry of the nth ink annotation of the page or nullptr if there is no sidecar
+		const Sidecar::StrokeEntry* getSidecarStroke(size_t page, size_t index) const;
+		// copies the points and the pressure of every stroke out of the sidecar and unmaps it
+		void releaseSidecar();
+
+		// the area the stroke covers on the screen in document space. Includes the width of the stroke
+		Rect2D<float> getStrokeArea(size_t page, const InkStroke& stroke) const;
+
+		// keeps the stroke count and memory metrics up to date. The outline is the m_outlineSize of an ink stroke
+		void trackStroke(bool added, const QuantizedStroke& points, const std::vector<byte>* pressure, size_t outline = 0);
 
 	public:
 		AnnotationHandler() = default;
-		// PDF and PDFBuilder are borrowed
-		AnnotationHandler(PDF* pdf, RenderHandler::PDFBuilder* context);
+		// PDF and PDFBuilder are borrowed. If the sidecar exists and belongs to the pdf the strokes are loaded from it
+		AnnotationHandler(PDF* pdf, RenderHandler::PDFBuilder* context, const std::wstring& sidecar = L"");
 		AnnotationHandler(const AnnotationHandler& a) = delete;
 		AnnotationHandler& operator=(const AnnotationHandler& a) = delete;
 		AnnotationHandler(AnnotationHandler&& a);
@@ -131,32 +251,68 @@ namespace PDFHandler {
 		~AnnotationHandler();
 
 
-		void startStroke(Point2D<float> p, UINT32 id);
-		void addStroke(Point2D<float> p, UINT32 id);
-		void endStroke(Point2D<float> p, UINT32 id);
+		// the pressure is the raw pressure of the pointer (0 - 1024). 0 if the pointer has no pressure information.
+		// The timestamp is when the pointer captured the point (Trace::now timebase). 0 means now.
+		// Once a point is on the screen its latency is recorded into the histogram
+		void startStroke(Point2D<float> p, UINT32 id, UINT32 pressure = 0, UINT64 timestamp = 0, Metrics::Histogram* latency = nullptr);
+		void addStroke(Point2D<float> p, UINT32 id, UINT32 pressure = 0, UINT64 timestamp = 0);
+		void endStroke(Point2D<float> p, UINT32 id, UINT32 pressure = 0, UINT64 timestamp = 0);
 		void eraser(Point2D<float> p);
 
 		// Will put the annotations into the pdf pages
 		void bakeAnnotations();
+		// Writes all baked strokes into the sidecar. The hash is the hash of the saved pdf file
+		void saveSidecar(const std::wstring& path, UINT64 pdfhash);
 
 		RenderHandler::StrokeBuilder* getStrokeBuilder() const;
 
 		bool isStrokeinProgress() const;
 
+		void setStrokeFilterSettings(const StrokeFilter::Settings& s);
+		// returns the amount of dropped samples and the amount of all samples
+		std::tuple<size_t, size_t> getStrokeFilterStatistics() const;
+
 		RenderHandler::Direct2DContext* getContext() const;
 
 		friend RenderHandler::StrokeBuilder;
 	};
 
+	// Every allocation of mupdf is counted so its memory is part of the memory budget. The memory of the pages and
+	// display lists is reported by their own caches and claimed so it isn't counted twice. What is left is mostly the
+	// store and the glyph cache which are scavenged when the budget is exceeded
 	class MUPDF {
 		fz_context* ctx = nullptr;
+		// the context is shared with the render worker so every lock of mupdf needs a mutex
+		std::mutex m_locks[FZ_LOCK_MAX];
+		fz_locks_context m_lockscontext;
+		fz_alloc_context m_alloccontext;
+		// the allocated bytes minus the claimed ones
+		MemoryBudget::Cache* m_memory = nullptr;
+
+		static void lock(void* user, int lock);
+		static void unlock(void* user, int lock);
+		static void* allocate(void* user, size_t size);
+		static void* reallocate(void* user, void* p, size_t size);
+		static void release(void* user, void* p);
+		// frees about the bytes from the store and the glyph cache
+		size_t evict(size_t bytes);
 	public:
+		// the part of the memory budget the store can use at most
+		static constexpr float STORE_BUDGET = 0.25f;
+
 		MUPDF();
 		~MUPDF();
 
 		PDF loadPDF(const std::wstring& s);
 
 		fz_context* getctx() const;
+		// the memory is reported by another cache. Negative if that cache freed it
+		void claimMemory(INT64 bytes);
+		// the store was used
+		void touchMemory();
+		// The bytes mupdf allocated minus the ones it freed on the calling thread. The difference before and after a
+		// call is the memory that call kept
+		static INT64 getThreadAllocations();
 	};
 }
 
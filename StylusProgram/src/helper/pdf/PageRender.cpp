@@ -0,0 +1,133 @@
+#include "PageRender.h"
+#include <mupdf/pdf.h>
+
+// the matrix that maps the source rect onto the pixels and a white pixmap with the size of the destination
+static fz_matrix createPixmap(fz_context* ctx, Rect2D<float> destination, Rect2D<float> source, float dpi, fz_pixmap** pix) {
+	auto scale = fz_scale((destination.width / source.width) * (dpi / 72.0f), (destination.height / source.height) * (dpi / 72.0f));
+	auto transform = fz_translate(-source.upperleft.x, -source.upperleft.y);
+
+	auto fbox = fz_make_rect(0, 0, source.width, source.height);
+	auto bbox = fz_round_rect(fz_transform_rect(fbox, scale));
+	*pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), bbox, nullptr, 1);
+	fz_clear_pixmap_with_value(ctx, *pix, 0xff);
+	return fz_concat(transform, scale);
+}
+
+// runs the page with the "View" usage of its optional content. Other documents than pdfs don't have optional content
+static void runPage(fz_context* ctx, fz_page* page, fz_device* dev, fz_matrix ctm) {
+	auto pdfpage = pdf_page_from_fz_page(ctx, page);
+	if (pdfpage != nullptr)
+		pdf_run_page_with_usage(ctx, pdfpage, dev, ctm, "View", nullptr);
+	else
+		fz_run_page(ctx, page, dev, ctm, nullptr);
+}
+
+fz_pixmap* PDFHandler::renderPage(fz_context* ctx, fz_page* page, Rect2D<float> destination, Rect2D<float> source, float dpi, bool draft) {
+	fz_pixmap* pix = nullptr;
+	fz_device* dev = nullptr;
+	int aalevel = fz_aa_level(ctx);
+	fz_var(pix);
+	fz_var(dev);
+	fz_try(ctx) {
+		auto ctm = createPixmap(ctx, destination, source, dpi, &pix);
+		dev = fz_new_draw_device(ctx, fz_identity, pix);
+		if (draft) {
+			fz_set_aa_level(ctx, DRAFT_AA_LEVEL);
+			fz_enable_device_hints(ctx, dev, FZ_DONT_INTERPOLATE_IMAGES);
+		}
+		runPage(ctx, page, dev, ctm);
+		fz_close_device(ctx, dev);
+	}
+	fz_always(ctx) {
+		fz_set_aa_level(ctx, aalevel);
+		fz_drop_device(ctx, dev);
+	}
+	fz_catch(ctx) {
+		fz_drop_pixmap(ctx, pix);
+		fz_rethrow(ctx);
+	}
+
+	return pix;
+}
+
+fz_display_list* PDFHandler::createDisplayList(fz_context* ctx, fz_page* page) {
+	fz_display_list* list = nullptr;
+	fz_device* dev = nullptr;
+	fz_var(list);
+	fz_var(dev);
+	fz_try(ctx) {
+		list = fz_new_display_list(ctx, fz_bound_page(ctx, page));
+		dev = fz_new_list_device(ctx, list);
+		runPage(ctx, page, dev, fz_identity);
+		fz_close_device(ctx, dev);
+	}
+	fz_always(ctx) {
+		fz_drop_device(ctx, dev);
+	}
+	fz_catch(ctx) {
+		fz_drop_display_list(ctx, list);
+		fz_rethrow(ctx);
+	}
+
+	return list;
+}
+
+fz_pixmap* PDFHandler::renderDisplayList(fz_context* ctx, fz_display_list* list, Rect2D<float> destination, Rect2D<float> source, float dpi, fz_cookie* cookie, bool draft) {
+	fz_pixmap* pix = nullptr;
+	fz_device* dev = nullptr;
+	int aalevel = fz_aa_level(ctx);
+	fz_var(pix);
+	fz_var(dev);
+	fz_try(ctx) {
+		auto ctm = createPixmap(ctx, destination, source, dpi, &pix);
+		dev = fz_new_draw_device(ctx, fz_identity, pix);
+		if (draft) {
+			fz_set_aa_level(ctx, DRAFT_AA_LEVEL);
+			fz_enable_device_hints(ctx, dev, FZ_DONT_INTERPOLATE_IMAGES);
+		}
+		fz_run_display_list(ctx, list, dev, ctm, fz_infinite_rect, cookie);
+		fz_close_device(ctx, dev);
+	}
+	fz_always(ctx) {
+		fz_set_aa_level(ctx, aalevel);
+		fz_drop_device(ctx, dev);
+	}
+	fz_catch(ctx) {
+		fz_drop_pixmap(ctx, pix);
+		fz_rethrow(ctx);
+	}
+
+	return pix;
+}
+
+unsigned char* PDFHandler::deflatePixmap(fz_context* ctx, fz_pixmap* pix, size_t* length) {
+	// the samples are already in memory so speed matters more than the size
+	return fz_new_deflated_data(ctx, length, pix->samples, (size_t)pix->stride * pix->h, FZ_DEFLATE_BEST_SPEED);
+}
+
+fz_pixmap* PDFHandler::inflatePixmap(fz_context* ctx, const unsigned char* data, size_t length, int width, int height) {
+	fz_pixmap* pix = nullptr;
+	fz_stream* memory = nullptr;
+	fz_stream* flate = nullptr;
+	fz_var(pix);
+	fz_var(memory);
+	fz_var(flate);
+	fz_try(ctx) {
+		pix = fz_new_pixmap(ctx, fz_device_rgb(ctx), width, height, nullptr, 1);
+		memory = fz_open_memory(ctx, data, length);
+		flate = fz_open_flated(ctx, memory, 15);
+		size_t size = (size_t)pix->stride * pix->h;
+		if (fz_read(ctx, flate, pix->samples, size) != size)
+			fz_throw(ctx, FZ_ERROR_GENERIC, "the deflated pixmap is too small");
+	}
+	fz_always(ctx) {
+		fz_drop_stream(ctx, flate);
+		fz_drop_stream(ctx, memory);
+	}
+	fz_catch(ctx) {
+		fz_drop_pixmap(ctx, pix);
+		fz_rethrow(ctx);
+	}
+
+	return pix;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "util/Util.h"
+#include <mupdf/fitz.h>
+
+#ifndef PAGE_RENDER_H
+#define PAGE_RENDER_H
+
+namespace PDFHandler {
+	// the anti aliasing (in bits) of a draft render. Full quality uses the default of mupdf
+	constexpr int DRAFT_AA_LEVEL = 2;
+
+	// Renders the source rect of the page (in pdf units, 72 dpi) into a pixmap that has the size of the destination at
+	// the dpi. This is the part of PDF::createBitmapFromPage that doesn't need Direct2D so it can be used headless.
+	// A draft is rendered with less anti aliasing and without image interpolation.
+	// The caller has to drop the pixmap
+	fz_pixmap* renderPage(fz_context* ctx, fz_page* page, Rect2D<float> destination, Rect2D<float> source, float dpi, bool draft = false);
+
+	// records the page so it can be rendered on other threads with a cloned context. The caller has to drop the list
+	fz_display_list* createDisplayList(fz_context* ctx, fz_page* page);
+	// same as renderPage but with a display list. The render can be aborted with the cookie
+	fz_pixmap* renderDisplayList(fz_context* ctx, fz_display_list* list, Rect2D<float> destination, Rect2D<float> source, float dpi, fz_cookie* cookie = nullptr, bool draft = false);
+
+	// compresses the samples of a pixmap so it can be kept in memory or on disk. The caller has to free the data
+	unsigned char* deflatePixmap(fz_context* ctx, fz_pixmap* pix, size_t* length);
+	// creates the rgba pixmap with the size again. The caller has to drop the pixmap
+	fz_pixmap* inflatePixmap(fz_context* ctx, const unsigned char* data, size_t length, int width, int height);
+}
+
+#endif // !PAGE_RENDER_H
@@ -5,17 +5,23 @@ PDFHandler::PdfPage::PdfPage(fz_context* ctx, fz_page* page) : ctx(ctx), page(pa
 PDFHandler::PdfPage::PdfPage(PdfPage&& p) {
     this->ctx = p.ctx;
     this->page = p.page;
+    this->memory = p.memory;
 
     p.ctx = nullptr;
     p.page = nullptr;
+    p.memory = 0;
 }
 
 PDFHandler::PdfPage& PDFHandler::PdfPage::operator=(PdfPage&& p) {
+    if (page != nullptr)
+        fz_drop_page(ctx, page);
     this->ctx = p.ctx;
     this->page = p.page;
+    this->memory = p.memory;
 
     p.ctx = nullptr;
     p.page = nullptr;
+    p.memory = 0;
     return *this;
 }
 
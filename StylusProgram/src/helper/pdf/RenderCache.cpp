@@ -0,0 +1,223 @@
+#include "RenderCache.h"
+#include "util/Logger.h"
+#include "util/Trace.h"
+#include "util/Metrics.h"
+#include <algorithm>
+#include <filesystem>
+
+PDFHandler::RenderCache::RenderCache(UINT64 pdfhash, UINT64 settings) {
+	m_pdfHash = pdfhash;
+	m_settings = settings;
+
+	std::error_code error;
+	auto directory = getDirectory();
+	std::filesystem::create_directories(directory, error);
+	if (error) {
+		LOG_WARNING(L"Couldn't create the render cache: {}", directory);
+		return;
+	}
+
+	wchar_t name[32];
+	swprintf(name, 32, L"%016llx.cache", pdfhash);
+	m_path = (std::filesystem::path(directory) / name).wstring();
+	load();
+}
+
+PDFHandler::RenderCache::~RenderCache() {
+	save();
+}
+
+std::wstring PDFHandler::RenderCache::getDirectory() {
+	std::error_code error;
+	auto temp = std::filesystem::temp_directory_path(error);
+	return (temp / L"StylusProgram" / L"RenderCache").wstring();
+}
+
+std::pair<size_t, UINT32> PDFHandler::RenderCache::getKey(size_t page, float dpi) {
+	return { page, (UINT32)std::lround(dpi * 100) };
+}
+
+bool PDFHandler::RenderCache::load() {
+	TRACE_SCOPE("RenderCache::load", "pdf");
+	// the document wasn't opened before
+	if (!std::filesystem::exists(m_path))
+		return false;
+
+	auto file = FileHandler::mapFile(m_path);
+	if (file.data == nullptr)
+		return false;
+
+	if (file.size < sizeof(Header)) {
+		LOG_WARNING(L"Render cache is too small: {}", m_path);
+		return false;
+	}
+
+	// an older version or other settings are written again when the cache is saved
+	auto header = (const Header*)file.data;
+	if (memcmp(header->m_magic, MAGIC, sizeof(MAGIC)) != 0 || header->m_version != VERSION
+		|| header->m_pdfHash != m_pdfHash || header->m_settings != m_settings) {
+		return false;
+	}
+
+	// make sure that nothing points outside of the file so a broken cache can't crash the program
+	if (header->m_entryTableOffset > file.size || header->m_entryCount > (file.size - header->m_entryTableOffset) / sizeof(Entry)) {
+		LOG_WARNING(L"Render cache is corrupted: {}", m_path);
+		return false;
+	}
+	auto entries = (const Entry*)(file.data + header->m_entryTableOffset);
+	for (size_t i = 0; i < header->m_entryCount; i++) {
+		if (entries[i].m_dataOffset > file.size || entries[i].m_dataSize > file.size - entries[i].m_dataOffset) {
+			LOG_WARNING(L"Render cache is corrupted: {}", m_path);
+			return false;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	for (size_t i = 0; i < header->m_entryCount; i++) {
+		Item item;
+		item.m_width = entries[i].m_width;
+		item.m_height = entries[i].m_height;
+		item.m_mapped = file.data + entries[i].m_dataOffset;
+		item.m_size = entries[i].m_dataSize;
+		m_items[getKey(entries[i].m_page, entries[i].m_dpi)] = std::move(item);
+	}
+	m_file = std::move(file);
+
+	// the age of a container is the last time it was used
+	std::error_code error;
+	std::filesystem::last_write_time(m_path, std::filesystem::file_time_type::clock::now(), error);
+	return true;
+}
+
+bool PDFHandler::RenderCache::contains(size_t page, float dpi) {
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_items.find(getKey(page, dpi)) != m_items.end();
+}
+
+bool PDFHandler::RenderCache::get(size_t page, float dpi, std::vector<unsigned char>& data, int& width, int& height) {
+	static auto& hits = Metrics::counter("rendercache.hits");
+	static auto& misses = Metrics::counter("rendercache.misses");
+	std::lock_guard<std::mutex> lock(m_lock);
+	auto it = m_items.find(getKey(page, dpi));
+	if (it == m_items.end()) {
+		misses.add();
+		return false;
+	}
+
+	hits.add();
+	auto& item = it->second;
+	if (item.m_mapped != nullptr)
+		data.assign(item.m_mapped, item.m_mapped + item.m_size);
+	else
+		data = item.m_data;
+	width = item.m_width;
+	height = item.m_height;
+	return true;
+}
+
+void PDFHandler::RenderCache::put(size_t page, float dpi, int width, int height, const unsigned char* data, size_t size) {
+	std::lock_guard<std::mutex> lock(m_lock);
+	// the render was made from the edited page
+	if (m_changedPages.count(page) != 0)
+		return;
+	Item item;
+	item.m_width = width;
+	item.m_height = height;
+	item.m_data.assign(data, data + size);
+	item.m_size = size;
+	m_items[getKey(page, dpi)] = std::move(item);
+	m_changed = true;
+}
+
+void PDFHandler::RenderCache::remove(size_t page) {
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_changedPages.insert(page);
+	auto it = m_items.lower_bound({ page, 0 });
+	while (it != m_items.end() && it->first.first == page) {
+		it = m_items.erase(it);
+		m_changed = true;
+	}
+}
+
+void PDFHandler::RenderCache::save() {
+	TRACE_SCOPE("RenderCache::save", "pdf");
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (m_path.empty())
+		return;
+
+	if (m_changed) {
+		// calculate where everything goes
+		Header header = {};
+		memcpy(header.m_magic, MAGIC, sizeof(MAGIC));
+		header.m_version = VERSION;
+		header.m_pdfHash = m_pdfHash;
+		header.m_settings = m_settings;
+		header.m_entryCount = m_items.size();
+		header.m_entryTableOffset = sizeof(Header);
+
+		UINT64 offset = header.m_entryTableOffset + header.m_entryCount * sizeof(Entry);
+		std::vector<Entry> entries;
+		entries.reserve(m_items.size());
+		for (auto& [key, item] : m_items) {
+			Entry entry = {};
+			entry.m_page = key.first;
+			entry.m_dpi = key.second / 100.0f;
+			entry.m_width = item.m_width;
+			entry.m_height = item.m_height;
+			entry.m_dataOffset = offset;
+			entry.m_dataSize = item.m_size;
+			entries.push_back(entry);
+			offset += item.m_size;
+		}
+
+		// the mapped data is copied before the file is closed so it can be overwritten
+		std::vector<byte> file(offset);
+		memcpy(file.data(), &header, sizeof(Header));
+		memcpy(file.data() + header.m_entryTableOffset, entries.data(), entries.size() * sizeof(Entry));
+		size_t i = 0;
+		for (auto& [key, item] : m_items) {
+			auto data = item.m_mapped != nullptr ? item.m_mapped : item.m_data.data();
+			memcpy(file.data() + entries[i].m_dataOffset, data, item.m_size);
+			i++;
+		}
+
+		// the items can't point into the old file anymore
+		for (auto& [key, item] : m_items) {
+			if (item.m_mapped == nullptr)
+				continue;
+			item.m_data.assign(item.m_mapped, item.m_mapped + item.m_size);
+			item.m_mapped = nullptr;
+		}
+		m_file.close();
+		FileHandler::saveFile(m_path, file.data(), file.size());
+		m_changed = false;
+	}
+	else {
+		// the age of a container is the last time it was used
+		std::error_code error;
+		std::filesystem::last_write_time(m_path, std::filesystem::file_time_type::clock::now(), error);
+	}
+	trim();
+}
+
+void PDFHandler::RenderCache::trim() {
+	static auto& deleted = Metrics::counter("rendercache.deleted");
+	std::error_code error;
+	std::vector<std::tuple<std::filesystem::file_time_type, UINT64, std::filesystem::path>> containers;
+	for (auto& file : std::filesystem::directory_iterator(getDirectory(), error)) {
+		if (file.path().extension() != L".cache")
+			continue;
+		containers.push_back({ file.last_write_time(error), file.file_size(error), file.path() });
+	}
+
+	// the newest first
+	std::sort(containers.begin(), containers.end(), [](auto& a, auto& b) { return std::get<0>(a) > std::get<0>(b); });
+	UINT64 size = 0;
+	for (auto& [time, filesize, path] : containers) {
+		size += filesize;
+		if (size <= SIZE_LIMIT || path == m_path)
+			continue;
+		std::filesystem::remove(path, error);
+		deleted.add();
+	}
+}
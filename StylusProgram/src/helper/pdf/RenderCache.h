@@ -0,0 +1,100 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "util/Util.h"
+#include "util/FileHandler.h"
+
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+namespace PDFHandler {
+	// Keeps rendered pages on disk so a document that is opened again shows its previews and its first view right
+	// away. Every document has one container in the cache directory that is named after the hash of the pdf file. An
+	// entry is found by the page and the dpi it was rendered with. The render settings are stored in the header, a
+	// container with other settings is ignored. The containers that weren't used for the longest time are deleted once
+	// the directory gets larger than SIZE_LIMIT. A page that was edited isn't cached anymore because its renders don't
+	// belong to the hash.
+	// Layout: [Header][Entry * entries][deflated rgba samples of every entry]
+	class RenderCache {
+	public:
+		static constexpr char MAGIC[4] = { 'S', 'P', 'R', 'C' };
+		// has to be increased if the layout changes
+		static constexpr UINT32 VERSION = 1;
+		// the size of all containers in bytes
+		static constexpr UINT64 SIZE_LIMIT = 512ull * 1024 * 1024;
+
+		struct Header {
+			char m_magic[4];
+			UINT32 m_version;
+			// hash of the pdf file the pages belong to
+			UINT64 m_pdfHash;
+			// everything besides the page and the dpi that changes the pixels
+			UINT64 m_settings;
+			UINT64 m_entryCount;
+			// offset from the start of the file
+			UINT64 m_entryTableOffset;
+		};
+
+		struct Entry {
+			UINT64 m_page;
+			float m_dpi;
+			INT32 m_width;
+			INT32 m_height;
+			UINT32 m_reserved;
+			// offset from the start of the file
+			UINT64 m_dataOffset;
+			UINT64 m_dataSize;
+		};
+
+	private:
+		struct Item {
+			int m_width = 0;
+			int m_height = 0;
+			// points into the mapped container until the item is replaced
+			const byte* m_mapped = nullptr;
+			size_t m_size = 0;
+			// the data of the items that were added since the container was loaded
+			std::vector<unsigned char> m_data;
+		};
+
+		std::wstring m_path;
+		UINT64 m_pdfHash = 0;
+		UINT64 m_settings = 0;
+		FileHandler::MappedFile m_file;
+		// the key is the page and the dpi in 1/100
+		std::map<std::pair<size_t, UINT32>, Item> m_items;
+		// the pages whose content differs from the pdf file the hash belongs to. Their renders aren't stored
+		std::set<size_t> m_changedPages;
+		bool m_changed = false;
+		std::mutex m_lock;
+
+		static std::pair<size_t, UINT32> getKey(size_t page, float dpi);
+		bool load();
+		// deletes the containers that weren't used for the longest time until all of them fit into SIZE_LIMIT
+		void trim();
+	public:
+		RenderCache(UINT64 pdfhash, UINT64 settings);
+		RenderCache(const RenderCache& c) = delete;
+		RenderCache& operator=(const RenderCache& c) = delete;
+		// saves the container
+		~RenderCache();
+
+		// where the containers are stored
+		static std::wstring getDirectory();
+
+		bool contains(size_t page, float dpi);
+		// copies the deflated samples of the page. Returns false if it isn't cached
+		bool get(size_t page, float dpi, std::vector<unsigned char>& data, int& width, int& height);
+		void put(size_t page, float dpi, int width, int height, const unsigned char* data, size_t size);
+		// the content of the page changed. The page isn't cached anymore until the document is closed
+		void remove(size_t page);
+		// writes the container if something changed and deletes the old containers. Can be called from any thread
+		void save();
+	};
+}
+
+#endif // !RENDER_CACHE_H
@@ -0,0 +1,140 @@
+#include "RenderWorker.h"
+#include "PageRender.h"
+#include "util/PixelCodec.h"
+#include "util/Logger.h"
+#include "util/Trace.h"
+#include "util/Metrics.h"
+
+PDFHandler::RenderWorker::RenderWorker(fz_context* ctx, std::function<void()> onFinished) {
+	m_onFinished = onFinished;
+	m_ctx = fz_clone_context(ctx);
+	if (m_ctx == nullptr) {
+		Logger::err(L"Couldn't clone the mupdf context for the render worker");
+		return;
+	}
+	m_thread = std::thread(&RenderWorker::run, this);
+}
+
+PDFHandler::RenderWorker::~RenderWorker() {
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_stop = true;
+		m_cookie.abort = 1;
+	}
+	m_wake.notify_one();
+	if (m_thread.joinable())
+		m_thread.join();
+	if (m_ctx == nullptr)
+		return;
+
+	for (auto& job : m_jobs)
+		fz_drop_display_list(m_ctx, job.m_list);
+	for (auto& result : m_results)
+		fz_drop_pixmap(m_ctx, result.m_pixmap);
+	fz_drop_context(m_ctx);
+}
+
+void PDFHandler::RenderWorker::add(const Job& job) {
+	if (m_ctx == nullptr)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_jobs.push_back(job);
+		fz_keep_display_list(m_ctx, job.m_list);
+		m_busy = true;
+	}
+	m_wake.notify_one();
+}
+
+void PDFHandler::RenderWorker::cancel() {
+	std::lock_guard<std::mutex> lock(m_lock);
+	for (auto& job : m_jobs)
+		fz_drop_display_list(m_ctx, job.m_list);
+	m_jobs.clear();
+	m_cookie.abort = 1;
+}
+
+void PDFHandler::RenderWorker::cancel(const std::function<bool(const Job&)>& predicate) {
+	std::lock_guard<std::mutex> lock(m_lock);
+	for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+		if (!predicate(*it)) {
+			it++;
+			continue;
+		}
+		fz_drop_display_list(m_ctx, it->m_list);
+		it = m_jobs.erase(it);
+	}
+	if (m_running && predicate(m_current))
+		m_cookie.abort = 1;
+}
+
+std::vector<PDFHandler::RenderWorker::Result> PDFHandler::RenderWorker::takeResults() {
+	std::lock_guard<std::mutex> lock(m_lock);
+	std::vector<Result> results;
+	results.swap(m_results);
+	return results;
+}
+
+bool PDFHandler::RenderWorker::isBusy() {
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_busy || !m_results.empty();
+}
+
+void PDFHandler::RenderWorker::run() {
+	Trace::setThreadName("RenderWorker");
+	static auto& rendertime = Metrics::histogram("mupdf.refine_page_us");
+	static auto& encodedpercent = Metrics::histogram("tilecache.encoded_percent");
+	static auto& encodetime = Metrics::histogram("tilecache.encode_us");
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_busy = !m_jobs.empty();
+			m_wake.wait(lock, [&]() { return m_stop || !m_jobs.empty(); });
+			if (m_stop)
+				return;
+			job = m_jobs.front();
+			m_jobs.pop_front();
+			m_cookie = {};
+			m_current = job;
+			m_running = true;
+			m_busy = true;
+		}
+
+		TRACE_SCOPE("refinePage", "pdf");
+		auto start = Trace::now();
+		Result result = { job.m_id, job.m_page, nullptr };
+		fz_try(m_ctx) {
+			result.m_pixmap = renderDisplayList(m_ctx, job.m_list, job.m_destination, job.m_source, job.m_dpi, &m_cookie, job.m_draft);
+		}
+		fz_catch(m_ctx) {
+			LOG_WARNING(L"Couldn't render page {} in the background", job.m_page);
+		}
+		fz_drop_display_list(m_ctx, job.m_list);
+		rendertime.record((Trace::now() - start) / 1000);
+
+		// coded here so the thread that renders only has to decode it
+		if (result.m_pixmap != nullptr && m_cookie.abort == 0) {
+			auto pix = result.m_pixmap;
+			auto encodestart = Trace::now();
+			result.m_encoded = PixelCodec::encode(pix->samples, pix->w, pix->h, (UINT32)pix->stride);
+			encodetime.record((Trace::now() - encodestart) / 1000);
+			UINT64 raw = (UINT64)pix->w * pix->h * 4;
+			if (raw != 0)
+				encodedpercent.record(result.m_encoded.size() * 100 / raw);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_running = false;
+			// a canceled render is incomplete
+			if (m_cookie.abort != 0) {
+				fz_drop_pixmap(m_ctx, result.m_pixmap);
+				continue;
+			}
+			m_results.push_back(std::move(result));
+		}
+		if (m_onFinished)
+			m_onFinished();
+	}
+}
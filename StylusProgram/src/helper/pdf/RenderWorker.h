@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "util/Util.h"
+#include <mupdf/fitz.h>
+
+#ifndef RENDER_WORKER_H
+#define RENDER_WORKER_H
+
+namespace PDFHandler {
+	// Renders display lists on a background thread with its own clone of the mupdf context. The context that is
+	// cloned has to be created with locks. The pixmaps are handed back to the thread that owns the Direct2D
+	// resources through takeResults. They are also coded with PixelCodec on the thread
+	class RenderWorker {
+	public:
+		struct Job {
+			// chosen by the caller so it can match the result to its request
+			UINT64 m_id = 0;
+			size_t m_page = 0;
+			fz_display_list* m_list = nullptr;
+			Rect2D<float> m_destination;
+			Rect2D<float> m_source;
+			float m_dpi = 72;
+			// rendered with the quality of renderPage's draft
+			bool m_draft = false;
+		};
+
+		struct Result {
+			UINT64 m_id = 0;
+			size_t m_page = 0;
+			// null if the render failed or was canceled. Has to be dropped by the caller
+			fz_pixmap* m_pixmap = nullptr;
+			// the pixels of the pixmap coded with PixelCodec so the bitmap can be thrown away once it is off screen
+			std::vector<byte> m_encoded;
+		};
+
+	private:
+		fz_context* m_ctx = nullptr;
+		std::thread m_thread;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::deque<Job> m_jobs;
+		std::vector<Result> m_results;
+		// the cookie of the job that is rendered right now. Setting abort stops it
+		fz_cookie m_cookie = {};
+		Job m_current;
+		bool m_running = false;
+		bool m_busy = false;
+		bool m_stop = false;
+		// called on the worker thread after a result was added
+		std::function<void()> m_onFinished;
+
+		void run();
+	public:
+		// ctx is cloned and has to stay alive until the worker is destroyed
+		RenderWorker(fz_context* ctx, std::function<void()> onFinished);
+		RenderWorker(const RenderWorker& w) = delete;
+		RenderWorker& operator=(const RenderWorker& w) = delete;
+		// cancels all jobs and waits for the thread
+		~RenderWorker();
+
+		// the worker keeps its own reference of the display list
+		void add(const Job& job);
+		// removes all jobs that weren't started and aborts the running one
+		void cancel();
+		// same as cancel but only for the jobs the predicate returns true for
+		void cancel(const std::function<bool(const Job&)>& predicate);
+		// the finished jobs since the last call
+		std::vector<Result> takeResults();
+		// true while there are jobs that weren't taken with takeResults
+		bool isBusy();
+	};
+}
+
+#endif // !RENDER_WORKER_H
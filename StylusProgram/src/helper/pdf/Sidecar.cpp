@@ -0,0 +1,190 @@
+#include "PDFHandler.h"
+#include <filesystem>
+#include <algorithm>
+
+static UINT64 alignOffset(UINT64 offset) {
+	return (offset + PDFHandler::Sidecar::DATA_ALIGNMENT - 1) / PDFHandler::Sidecar::DATA_ALIGNMENT * PDFHandler::Sidecar::DATA_ALIGNMENT;
+}
+
+std::wstring PDFHandler::Sidecar::getPath(const std::wstring& pdfpath) {
+	return pdfpath + L".ink";
+}
+
+PDFHandler::AnnotationHandler::PdfStroke::PdfStroke(fz_context* ctx, pdf_annot* annot, const Sidecar::StrokeEntry& entry, const byte* file) {
+	this->ctx = ctx;
+	pdf_keep_annot(ctx, annot);
+	m_annot = annot;
+
+	m_boundingBox = Rect2D<float>(Point2D<float>(entry.m_boundingBox[0], entry.m_boundingBox[1]), entry.m_boundingBox[2], entry.m_boundingBox[3]);
+	m_points = QuantizedStroke::fromView(entry.m_points, file + entry.m_dataOffset);
+	m_strokeWidth = entry.m_strokeWidth;
+
+	if (entry.m_pressureOffset != 0)
+		m_pressureView = file + entry.m_pressureOffset;
+}
+
+bool PDFHandler::AnnotationHandler::loadSidecar(const std::wstring& path) {
+	// the sidecar is optional
+	if (!std::filesystem::exists(path))
+		return false;
+
+	auto file = FileHandler::mapFile(path);
+	if (file.data == nullptr)
+		return false;
+
+	if (file.size < sizeof(Sidecar::Header)) {
+		Logger::add(L"Sidecar is too small: " + path, LOGGER_TYPE::WARNING);
+		return false;
+	}
+
+	auto header = (const Sidecar::Header*)file.data;
+	if (memcmp(header->m_magic, Sidecar::MAGIC, sizeof(Sidecar::MAGIC)) != 0 || header->m_version != Sidecar::VERSION) {
+		Logger::add(L"Sidecar has an unknown format: " + path, LOGGER_TYPE::WARNING);
+		return false;
+	}
+
+	// the pdf was changed by another program
+	if (header->m_pdfHash != FileHandler::hashData(m_pdf->data, m_pdf->size)) {
+		Logger::add(L"Sidecar doesn't belong to the pdf: " + path, LOGGER_TYPE::WARNING);
+		return false;
+	}
+
+	// make sure that nothing points outside of the file so a broken sidecar can't crash the program
+	if (header->m_pageCount != m_pdf->getNumberOfPages()
+		|| header->m_pageTableOffset > file.size || header->m_strokeTableOffset > file.size
+		|| header->m_pageCount > (file.size - header->m_pageTableOffset) / sizeof(Sidecar::PageEntry)
+		|| header->m_strokeCount > (file.size - header->m_strokeTableOffset) / sizeof(Sidecar::StrokeEntry)) {
+		Logger::add(L"Sidecar is corrupted: " + path, LOGGER_TYPE::WARNING);
+		return false;
+	}
+
+	auto pages = (const Sidecar::PageEntry*)(file.data + header->m_pageTableOffset);
+	for (size_t i = 0; i < header->m_pageCount; i++) {
+		if (pages[i].m_firstStroke > header->m_strokeCount || pages[i].m_strokeCount > header->m_strokeCount - pages[i].m_firstStroke) {
+			Logger::add(L"Sidecar is corrupted: " + path, LOGGER_TYPE::WARNING);
+			return false;
+		}
+	}
+
+	auto strokes = (const Sidecar::StrokeEntry*)(file.data + header->m_strokeTableOffset);
+	for (size_t i = 0; i < header->m_strokeCount; i++) {
+		auto datasize = QuantizedStroke::getDataSize(strokes[i].m_points);
+		bool valid = strokes[i].m_dataOffset <= file.size && datasize <= file.size - strokes[i].m_dataOffset;
+		if (strokes[i].m_pressureOffset != 0)
+			valid = valid && strokes[i].m_pressureOffset <= file.size && strokes[i].m_points.m_size <= file.size - strokes[i].m_pressureOffset;
+		if (!valid) {
+			Logger::add(L"Sidecar is corrupted: " + path, LOGGER_TYPE::WARNING);
+			return false;
+		}
+	}
+
+	m_sidecar = std::move(file);
+	return true;
+}
+
+const PDFHandler::Sidecar::StrokeEntry* PDFHandler::AnnotationHandler::getSidecarStroke(size_t page, size_t index) const {
+	if (m_sidecar.data == nullptr)
+		return nullptr;
+
+	// the sidecar was validated when it was loaded
+	auto header = (const Sidecar::Header*)m_sidecar.data;
+	auto pages = (const Sidecar::PageEntry*)(m_sidecar.data + header->m_pageTableOffset);
+	auto strokes = (const Sidecar::StrokeEntry*)(m_sidecar.data + header->m_strokeTableOffset);
+	if (page >= header->m_pageCount || index >= pages[page].m_strokeCount)
+		return nullptr;
+
+	return &strokes[pages[page].m_firstStroke + index];
+}
+
+void PDFHandler::AnnotationHandler::releaseSidecar() {
+	if (m_sidecar.data == nullptr)
+		return;
+
+	for (size_t i = 0; i < m_pdfinkannotations.size(); i++) {
+		for (auto& stroke : *m_pdfinkannotations[i]) {
+			// the copies are memory of the strokes now
+			trackStroke(false, stroke.m_points, stroke.m_pressure);
+			stroke.m_points.detach();
+			if (stroke.m_pressureView != nullptr) {
+				stroke.m_pressure = new std::vector<byte>(stroke.m_pressureView, stroke.m_pressureView + stroke.m_points.size());
+				stroke.m_pressureView = nullptr;
+			}
+			trackStroke(true, stroke.m_points, stroke.m_pressure);
+		}
+	}
+	m_sidecar.close();
+}
+
+void PDFHandler::AnnotationHandler::saveSidecar(const std::wstring& path, UINT64 pdfhash) {
+	// the file can't be overwritten while it is mapped
+	releaseSidecar();
+
+	if (std::any_of(m_inkstrokes.begin(), m_inkstrokes.end(), [](auto strokes) { return strokes->size() != 0; })) {
+		Logger::add(L"The sidecar only contains baked strokes", LOGGER_TYPE::WARNING);
+	}
+
+	size_t strokecount = 0;
+	for (size_t i = 0; i < m_pdfinkannotations.size(); i++) {
+		strokecount += m_pdfinkannotations[i]->size();
+	}
+
+	// calculate where everything goes
+	Sidecar::Header header = {};
+	memcpy(header.m_magic, Sidecar::MAGIC, sizeof(Sidecar::MAGIC));
+	header.m_version = Sidecar::VERSION;
+	header.m_pdfHash = pdfhash;
+	header.m_pageCount = m_pdfinkannotations.size();
+	header.m_strokeCount = strokecount;
+	header.m_pageTableOffset = sizeof(Sidecar::Header);
+	header.m_strokeTableOffset = header.m_pageTableOffset + header.m_pageCount * sizeof(Sidecar::PageEntry);
+
+	std::vector<Sidecar::PageEntry> pages(header.m_pageCount);
+	std::vector<Sidecar::StrokeEntry> strokes;
+	strokes.reserve(strokecount);
+
+	UINT64 offset = header.m_strokeTableOffset + strokecount * sizeof(Sidecar::StrokeEntry);
+	for (size_t i = 0; i < m_pdfinkannotations.size(); i++) {
+		pages[i].m_firstStroke = strokes.size();
+		pages[i].m_strokeCount = m_pdfinkannotations[i]->size();
+
+		for (auto& stroke : *m_pdfinkannotations[i]) {
+			Sidecar::StrokeEntry entry = {};
+			entry.m_points = stroke.m_points.getHeader();
+			entry.m_strokeWidth = stroke.m_strokeWidth;
+			entry.m_boundingBox[0] = stroke.m_boundingBox.upperleft.x;
+			entry.m_boundingBox[1] = stroke.m_boundingBox.upperleft.y;
+			entry.m_boundingBox[2] = stroke.m_boundingBox.width;
+			entry.m_boundingBox[3] = stroke.m_boundingBox.height;
+
+			offset = alignOffset(offset);
+			entry.m_dataOffset = offset;
+			offset += stroke.m_points.getDataSize();
+			if (stroke.m_pressure != nullptr && stroke.m_pressure->size() == stroke.m_points.size()) {
+				entry.m_pressureOffset = offset;
+				offset += stroke.m_pressure->size();
+			}
+			strokes.push_back(entry);
+		}
+	}
+
+	// write everything into one buffer
+	std::vector<byte> buffer(offset, 0);
+	memcpy(buffer.data(), &header, sizeof(Sidecar::Header));
+	if (pages.size() != 0)
+		memcpy(buffer.data() + header.m_pageTableOffset, pages.data(), pages.size() * sizeof(Sidecar::PageEntry));
+	if (strokes.size() != 0)
+		memcpy(buffer.data() + header.m_strokeTableOffset, strokes.data(), strokes.size() * sizeof(Sidecar::StrokeEntry));
+
+	size_t index = 0;
+	for (size_t i = 0; i < m_pdfinkannotations.size(); i++) {
+		for (auto& stroke : *m_pdfinkannotations[i]) {
+			auto& entry = strokes[index++];
+			memcpy(buffer.data() + entry.m_dataOffset, stroke.m_points.getData(), stroke.m_points.getDataSize());
+			if (entry.m_pressureOffset != 0)
+				memcpy(buffer.data() + entry.m_pressureOffset, stroke.m_pressure->data(), stroke.m_pressure->size());
+		}
+	}
+
+	FileHandler::saveFile(path, buffer.data(), buffer.size());
+	LOG_INFO(L"Saved {} strokes into the sidecar", strokecount);
+}
@@ -0,0 +1,249 @@
+#include "ThumbnailService.h"
+#include "PageRender.h"
+#include "util/Logger.h"
+#include "util/Trace.h"
+#include "util/Metrics.h"
+
+PDFHandler::ThumbnailService::ThumbnailService(fz_context* ctx, size_t pages, RenderCache* cache, std::function<void()> onFinished) {
+	m_onFinished = onFinished;
+	m_cache = cache;
+	m_entries.resize(pages);
+	// the thumbnails are small and render quickly
+	m_memory = MemoryBudget::add("thumbnails", 1, [this](size_t bytes) { return evict(bytes); });
+	m_ctx = fz_clone_context(ctx);
+	if (m_ctx == nullptr) {
+		Logger::err(L"Couldn't clone the mupdf context for the thumbnails");
+		return;
+	}
+	m_thread = std::thread(&ThumbnailService::run, this);
+}
+
+PDFHandler::ThumbnailService::~ThumbnailService() {
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_stop = true;
+	}
+	m_wake.notify_one();
+	if (m_thread.joinable())
+		m_thread.join();
+	MemoryBudget::remove(m_memory);
+	if (m_ctx == nullptr)
+		return;
+
+	for (auto& job : m_jobs)
+		fz_drop_display_list(m_ctx, job.m_list);
+	for (auto& result : m_results)
+		fz_drop_pixmap(m_ctx, result.m_pixmap);
+	fz_drop_context(m_ctx);
+}
+
+bool PDFHandler::ThumbnailService::isDeflated(size_t page, float dpi) {
+	std::lock_guard<std::mutex> lock(m_lock);
+	return hasDeflated(page, dpi);
+}
+
+bool PDFHandler::ThumbnailService::hasDeflated(size_t page, float dpi) {
+	auto& entry = m_entries[page];
+	if (!entry.m_deflated.empty() && isEqual(entry.m_dpi, dpi))
+		return true;
+	return m_cache != nullptr && m_cache->contains(page, dpi);
+}
+
+void PDFHandler::ThumbnailService::request(size_t page, fz_display_list* list, Rect2D<float> size, float dpi) {
+	if (m_ctx == nullptr)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		auto& entry = m_entries[page];
+		entry.m_lastUse = Trace::now();
+		if (entry.m_queued)
+			return;
+		bool deflated = hasDeflated(page, dpi);
+		if (!deflated && list == nullptr)
+			return;
+
+		Job job = { page, deflated ? nullptr : fz_keep_display_list(m_ctx, list), size, dpi, entry.m_generation };
+		m_jobs.push_back(job);
+		entry.m_queued = true;
+	}
+	m_wake.notify_one();
+}
+
+void PDFHandler::ThumbnailService::cancel() {
+	std::lock_guard<std::mutex> lock(m_lock);
+	for (auto& job : m_jobs) {
+		fz_drop_display_list(m_ctx, job.m_list);
+		m_entries[job.m_page].m_queued = false;
+	}
+	m_jobs.clear();
+}
+
+void PDFHandler::ThumbnailService::clear(size_t page) {
+	std::lock_guard<std::mutex> lock(m_lock);
+	auto& entry = m_entries[page];
+	m_deflatedSize -= entry.m_deflated.size();
+	entry.m_deflated = std::vector<unsigned char>();
+	entry.m_generation++;
+	entry.m_queued = false;
+	m_memory->setSize(m_deflatedSize);
+}
+
+size_t PDFHandler::ThumbnailService::evict(size_t bytes) {
+	std::lock_guard<std::mutex> lock(m_lock);
+	auto before = m_deflatedSize;
+	trim(before - min(bytes, before));
+	return before - m_deflatedSize;
+}
+
+std::vector<PDFHandler::ThumbnailService::Thumbnail> PDFHandler::ThumbnailService::takeResults() {
+	std::lock_guard<std::mutex> lock(m_lock);
+	std::vector<Thumbnail> results;
+	results.swap(m_results);
+	return results;
+}
+
+void PDFHandler::ThumbnailService::run() {
+	Trace::setThreadName("Thumbnails");
+	static auto& rendertime = Metrics::histogram("thumbnails.render_us");
+	static auto& inflatetime = Metrics::histogram("thumbnails.inflate_us");
+	while (true) {
+		Job job;
+		std::vector<unsigned char> deflated;
+		int width = 0, height = 0;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_wake.wait(lock, [&]() { return m_stop || !m_jobs.empty(); });
+			if (m_stop)
+				return;
+			job = m_jobs.front();
+			m_jobs.pop_front();
+			// the deflated data is copied so the lock isn't held while it is inflated
+			auto& entry = m_entries[job.m_page];
+			if (job.m_list == nullptr && isEqual(entry.m_dpi, job.m_dpi)) {
+				deflated = entry.m_deflated;
+				width = entry.m_width;
+				height = entry.m_height;
+			}
+		}
+		// the thumbnail was rendered when the document was opened before
+		bool fromcache = job.m_list == nullptr && deflated.empty() && m_cache != nullptr && m_cache->get(job.m_page, job.m_dpi, deflated, width, height);
+
+		TRACE_SCOPE("thumbnail", "pdf");
+		auto start = Trace::now();
+		auto pix = job.m_list != nullptr ? render(job) : inflate(job, deflated, width, height);
+		(job.m_list != nullptr ? rendertime : inflatetime).record((Trace::now() - start) / 1000);
+		if (job.m_list != nullptr)
+			store(job, pix);
+		fz_drop_display_list(m_ctx, job.m_list);
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			auto& entry = m_entries[job.m_page];
+			// the page changed while it was rendered
+			if (entry.m_generation != job.m_generation) {
+				fz_drop_pixmap(m_ctx, pix);
+				continue;
+			}
+			entry.m_queued = false;
+			if (pix == nullptr)
+				continue;
+			// so the disk isn't read again the next time
+			if (fromcache) {
+				m_deflatedSize -= entry.m_deflated.size();
+				entry.m_deflated = std::move(deflated);
+				entry.m_width = width;
+				entry.m_height = height;
+				entry.m_dpi = job.m_dpi;
+				m_deflatedSize += entry.m_deflated.size();
+				trim(DEFLATED_BUDGET);
+			}
+			m_results.push_back({ job.m_page, job.m_dpi, pix });
+		}
+		if (m_onFinished)
+			m_onFinished();
+	}
+}
+
+fz_pixmap* PDFHandler::ThumbnailService::render(const Job& job) {
+	fz_pixmap* pix = nullptr;
+	fz_var(pix);
+	fz_try(m_ctx) {
+		pix = renderDisplayList(m_ctx, job.m_list, job.m_size, { { 0, 0 }, job.m_size.width, job.m_size.height }, job.m_dpi);
+	}
+	fz_catch(m_ctx) {
+		LOG_WARNING(L"Couldn't render the thumbnail of page {}", job.m_page);
+		pix = nullptr;
+	}
+	return pix;
+}
+
+fz_pixmap* PDFHandler::ThumbnailService::inflate(const Job& job, const std::vector<unsigned char>& deflated, int width, int height) {
+	// the deflated thumbnail was thrown away after it was requested
+	if (deflated.empty())
+		return nullptr;
+	fz_pixmap* pix = nullptr;
+	fz_var(pix);
+	fz_try(m_ctx) {
+		pix = inflatePixmap(m_ctx, deflated.data(), deflated.size(), width, height);
+	}
+	fz_catch(m_ctx) {
+		LOG_WARNING(L"Couldn't inflate the thumbnail of page {}", job.m_page);
+		pix = nullptr;
+	}
+	return pix;
+}
+
+void PDFHandler::ThumbnailService::store(const Job& job, fz_pixmap* pix) {
+	static auto& ratio = Metrics::histogram("thumbnails.deflate_percent");
+	if (pix == nullptr)
+		return;
+
+	unsigned char* data = nullptr;
+	size_t length = 0;
+	fz_var(data);
+	fz_try(m_ctx) {
+		data = deflatePixmap(m_ctx, pix, &length);
+	}
+	fz_catch(m_ctx) {
+		LOG_WARNING(L"Couldn't deflate the thumbnail of page {}", job.m_page);
+		return;
+	}
+	ratio.record(length * 100 / max((size_t)pix->stride * pix->h, (size_t)1));
+
+	// a thumbnail of an outdated generation shows the page before it changed
+	bool current = false;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		auto& entry = m_entries[job.m_page];
+		current = entry.m_generation == job.m_generation;
+		if (current) {
+			m_deflatedSize -= entry.m_deflated.size();
+			entry.m_deflated.assign(data, data + length);
+			entry.m_width = pix->w;
+			entry.m_height = pix->h;
+			entry.m_dpi = job.m_dpi;
+			m_deflatedSize += length;
+			trim(DEFLATED_BUDGET);
+		}
+	}
+	if (current && m_cache != nullptr)
+		m_cache->put(job.m_page, job.m_dpi, pix->w, pix->h, data, length);
+	fz_free(m_ctx, data);
+}
+
+void PDFHandler::ThumbnailService::trim(size_t budget) {
+	static auto& evicted = Metrics::counter("thumbnails.evicted");
+	while (m_deflatedSize > budget) {
+		Entry* oldest = nullptr;
+		for (auto& entry : m_entries) {
+			if (!entry.m_deflated.empty() && (oldest == nullptr || entry.m_lastUse < oldest->m_lastUse))
+				oldest = &entry;
+		}
+		if (oldest == nullptr)
+			break;
+		m_deflatedSize -= oldest->m_deflated.size();
+		oldest->m_deflated = std::vector<unsigned char>();
+		evicted.add();
+	}
+	m_memory->setSize(m_deflatedSize);
+}
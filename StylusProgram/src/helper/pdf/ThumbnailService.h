@@ -0,0 +1,106 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "util/Util.h"
+#include "util/MemoryBudget.h"
+#include "pdf/RenderCache.h"
+#include <mupdf/fitz.h>
+
+#ifndef THUMBNAIL_SERVICE_H
+#define THUMBNAIL_SERVICE_H
+
+namespace PDFHandler {
+	// Renders the low resolution images of the pages on its own thread so they never wait for the render worker.
+	// Every thumbnail is kept deflated once it was rendered. Showing it again only has to inflate it which is also
+	// done on the thread. The deflated thumbnails that weren't requested for the longest time are thrown away when
+	// they need more than DEFLATED_BUDGET or the memory budget is exceeded. With a render cache the thumbnails are
+	// also kept on disk and a thumbnail that is in the cache is never rendered
+	class ThumbnailService {
+	public:
+		// the memory (in bytes) of all deflated thumbnails
+		static constexpr size_t DEFLATED_BUDGET = 64 * 1024 * 1024;
+
+		struct Thumbnail {
+			size_t m_page = 0;
+			float m_dpi = 72;
+			// has to be dropped by the caller
+			fz_pixmap* m_pixmap = nullptr;
+		};
+
+	private:
+		struct Job {
+			size_t m_page = 0;
+			// null if the deflated thumbnail is inflated
+			fz_display_list* m_list = nullptr;
+			Rect2D<float> m_size;
+			float m_dpi = 72;
+			// the generation of the entry when the job was added
+			UINT64 m_generation = 0;
+		};
+
+		struct Entry {
+			// the samples of an rgba pixmap. Empty if the page wasn't rendered yet
+			std::vector<unsigned char> m_deflated;
+			int m_width = 0;
+			int m_height = 0;
+			float m_dpi = 0;
+			bool m_queued = false;
+			// when the thumbnail was requested the last time
+			UINT64 m_lastUse = 0;
+			// changes when the page changed. Older jobs are ignored
+			UINT64 m_generation = 0;
+		};
+
+		fz_context* m_ctx = nullptr;
+		std::thread m_thread;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::deque<Job> m_jobs;
+		std::vector<Thumbnail> m_results;
+		std::vector<Entry> m_entries;
+		size_t m_deflatedSize = 0;
+		// can be null
+		RenderCache* m_cache = nullptr;
+		// the deflated thumbnails
+		MemoryBudget::Cache* m_memory = nullptr;
+		bool m_stop = false;
+		// called on the thread after a thumbnail was added
+		std::function<void()> m_onFinished;
+
+		void run();
+		fz_pixmap* render(const Job& job);
+		fz_pixmap* inflate(const Job& job, const std::vector<unsigned char>& deflated, int width, int height);
+		void store(const Job& job, fz_pixmap* pix);
+		// the thumbnail is deflated in memory or in the render cache. m_lock has to be held
+		bool hasDeflated(size_t page, float dpi);
+		// throws away the least recently used deflated thumbnails until they fit into the budget. m_lock has to be held
+		void trim(size_t budget);
+		// called by the memory budget
+		size_t evict(size_t bytes);
+	public:
+		// ctx is cloned and has to stay alive until the service is destroyed. So does the cache which can be null
+		ThumbnailService(fz_context* ctx, size_t pages, RenderCache* cache, std::function<void()> onFinished);
+		ThumbnailService(const ThumbnailService& s) = delete;
+		ThumbnailService& operator=(const ThumbnailService& s) = delete;
+		~ThumbnailService();
+
+		// true if the thumbnail with the dpi can be created without a display list
+		bool isDeflated(size_t page, float dpi);
+		// queues the thumbnail of the page. The list is only needed if it isn't deflated. The service keeps its own
+		// reference of the list. Pages that are already queued are ignored
+		void request(size_t page, fz_display_list* list, Rect2D<float> size, float dpi);
+		// removes the jobs that weren't started. The running one is finished
+		void cancel();
+		// the content of the page changed
+		void clear(size_t page);
+		// the thumbnails that were finished since the last call
+		std::vector<Thumbnail> takeResults();
+	};
+}
+
+#endif // !THUMBNAIL_SERVICE_H
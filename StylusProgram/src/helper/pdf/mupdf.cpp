@@ -1,14 +1,31 @@
 #include "PDFHandler.h"
 #include "mupdf/pdf.h"
+#include <cstdlib>
+
+// every allocation has a header with its size so freeing it can be counted
+struct alignas(16) AllocationHeader {
+	size_t m_size;
+};
+
+static thread_local INT64 threadAllocations = 0;
 
 PDFHandler::MUPDF::MUPDF() {
-	ctx = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
+	// the store is cheap to fill again from the file in memory
+	m_memory = MemoryBudget::add("mupdf", 1, [this](size_t bytes) { return evict(bytes); });
+
+	m_lockscontext.user = m_locks;
+	m_lockscontext.lock = lock;
+	m_lockscontext.unlock = unlock;
+	m_alloccontext = { this, allocate, reallocate, release };
+	auto store = min((size_t)FZ_STORE_DEFAULT, (size_t)(MemoryBudget::getLimit() * STORE_BUDGET));
+	ctx = fz_new_context(&m_alloccontext, &m_lockscontext, store);
 
 	fz_register_document_handlers(ctx);
 }
 
 PDFHandler::MUPDF::~MUPDF() {
 	fz_drop_context(ctx);
+	MemoryBudget::remove(m_memory);
 }
 
 PDFHandler::PDF PDFHandler::MUPDF::loadPDF(const std::wstring& s) {
@@ -25,6 +42,76 @@ PDFHandler::PDF PDFHandler::MUPDF::loadPDF(const std::wstring& s) {
 	return std::move(pdf);
 }
 
+void PDFHandler::MUPDF::lock(void* user, int lock) {
+	((std::mutex*)user)[lock].lock();
+}
+
+void PDFHandler::MUPDF::unlock(void* user, int lock) {
+	((std::mutex*)user)[lock].unlock();
+}
+
+void* PDFHandler::MUPDF::allocate(void* user, size_t size) {
+	auto header = (AllocationHeader*)std::malloc(sizeof(AllocationHeader) + size);
+	if (header == nullptr)
+		return nullptr;
+	header->m_size = size;
+	threadAllocations += (INT64)size;
+	((MUPDF*)user)->m_memory->addSize((INT64)size);
+	return header + 1;
+}
+
+void* PDFHandler::MUPDF::reallocate(void* user, void* p, size_t size) {
+	if (p == nullptr)
+		return allocate(user, size);
+	auto header = (AllocationHeader*)p - 1;
+	auto old = header->m_size;
+	header = (AllocationHeader*)std::realloc(header, sizeof(AllocationHeader) + size);
+	if (header == nullptr)
+		return nullptr;
+	header->m_size = size;
+	threadAllocations += (INT64)size - (INT64)old;
+	((MUPDF*)user)->m_memory->addSize((INT64)size - (INT64)old);
+	return header + 1;
+}
+
+void PDFHandler::MUPDF::release(void* user, void* p) {
+	if (p == nullptr)
+		return;
+	auto header = (AllocationHeader*)p - 1;
+	threadAllocations -= (INT64)header->m_size;
+	((MUPDF*)user)->m_memory->addSize(-(INT64)header->m_size);
+	std::free(header);
+}
+
+size_t PDFHandler::MUPDF::evict(size_t bytes) {
+	static auto& shrinks = Metrics::counter("mupdf.store.shrinks");
+	auto before = m_memory->getSize();
+	if (before == 0)
+		return 0;
+
+	// the unclaimed memory is mostly the store. The render worker can allocate at the same time so the freed
+	// bytes are only an estimate
+	auto percent = (unsigned int)(100 - min(bytes * 100 / before + 1, (size_t)100));
+	fz_shrink_store(ctx, percent);
+	shrinks.add();
+	// the glyphs are rendered again quickly
+	if (before - min(m_memory->getSize(), before) < bytes)
+		fz_purge_glyph_cache(ctx);
+	return before - min(m_memory->getSize(), before);
+}
+
 fz_context* PDFHandler::MUPDF::getctx() const {
 	return ctx;
 }
+
+void PDFHandler::MUPDF::claimMemory(INT64 bytes) {
+	m_memory->addSize(-bytes);
+}
+
+void PDFHandler::MUPDF::touchMemory() {
+	m_memory->touch();
+}
+
+INT64 PDFHandler::MUPDF::getThreadAllocations() {
+	return threadAllocations;
+}
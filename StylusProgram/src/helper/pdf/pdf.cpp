@@ -26,8 +26,9 @@ PDFHandler::PDF::PDF(MUPDF* context, fz_document* doc) {
 	m_doc = doc;
 	m_pdfcontext = context;
 	
-	for (size_t i = 0; i < getNumberOfPages(); i++) {
-		m_pages.push_back(PdfPage(context->getctx() ,fz_load_page(context->getctx(), doc, i)));
+	m_pages.resize(getNumberOfPages());
+	for (size_t i = 0; i < m_pages.size(); i++) {
+		loadPage(i);
 	}
 }
 
@@ -55,6 +56,8 @@ PDFHandler::PDF::PDF(PDF&& f) : File(std::move(f)) {
 	f.m_doc = nullptr;
 
 	m_pages = std::move(f.m_pages);
+	m_pageMemory = f.m_pageMemory;
+	f.m_pageMemory = 0;
 
 	m_pdfcontext = f.m_pdfcontext;
 	f.m_pdfcontext = nullptr;
@@ -65,6 +68,8 @@ PDFHandler::PDF& PDFHandler::PDF::operator=(PDF&& f) {
 	f.m_doc = nullptr;
 
 	m_pages = std::move(f.m_pages);
+	m_pageMemory = f.m_pageMemory;
+	f.m_pageMemory = 0;
 
 	m_pdfcontext = f.m_pdfcontext;
 	f.m_pdfcontext = nullptr;
@@ -77,61 +82,66 @@ PDFHandler::PDF& PDFHandler::PDF::operator=(PDF&& f) {
 PDFHandler::PDF::~PDF() {
 	if (m_doc == nullptr)
 		return;
+	// the pages are dropped with the vector
+	m_pdfcontext->claimMemory(-(INT64)m_pageMemory);
+	m_pageMemory = 0;
 	fz_drop_document(m_pdfcontext->getctx(), m_doc);
 }
 
 RenderHandler::Bitmap PDFHandler::PDF::createBitmapFromPage(RenderHandler::Direct2DContext* context, unsigned int page, Rect2D<float> rec, float dpi) {
-	// TODO error handling 
+	// the whole page is the source
+	return createBitmapFromPage(context, page, rec, getPageSize(page, 72), dpi);
+}
+
+RenderHandler::Bitmap PDFHandler::PDF::createBitmapFromPage(RenderHandler::Direct2DContext* context, unsigned int page, Rect2D<float> destination, Rect2D<float> source, float dpi, bool draft) {
+	TRACE_SCOPE("createBitmapFromPage", "pdf");
 	auto ctx = m_pdfcontext->getctx();
+	auto pix = renderPixmap(page, destination, source, dpi, draft);
 
-	auto& pdfpage = getPage(page);
-	auto docpage = pdfpage.page;
-	
-	auto ctm = fz_identity;
-	auto size = getPageSize(page, 72);
-	ctm = fz_scale((rec.width / size.width) * (dpi / 72.0f), (rec.height / size.height) * (dpi / 72.0f));
-	
-	auto fbox = fz_make_rect(0, 0, size.width, size.height);
-	auto bbox = fz_round_rect(fz_transform_rect(fbox, ctm));
-	auto pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), bbox, nullptr, 1);
-	fz_clear_pixmap_with_value(ctx, pix, 0xff);
-	auto dev = fz_new_draw_device(ctx, fz_identity, pix);
+	auto butmap = createBitmapFromPixmap(context, pix, dpi);
 
-	pdf_run_page_with_usage(ctx, (pdf_page*)docpage, dev, ctm, "View", nullptr); 
-	
-	RenderHandler::Bitmap butmap(context, pix->samples, {{0, 0}, (unsigned int)bbox.x1, (unsigned int)bbox.y1}, pix->stride, dpi);
-	
 	fz_drop_pixmap(ctx, pix);
-	fz_drop_device(ctx, dev);
 
 	return std::move(butmap);
 }
 
-RenderHandler::Bitmap PDFHandler::PDF::createBitmapFromPage(RenderHandler::Direct2DContext* context, unsigned int page, Rect2D<float> destination, Rect2D<float> source, float dpi) {
+fz_pixmap* PDFHandler::PDF::renderPixmap(unsigned int page, Rect2D<float> destination, Rect2D<float> source, float dpi, bool draft) {
+	static auto& rendertime = Metrics::histogram("mupdf.render_page_us");
+	auto start = Trace::now();
+	// TODO error handling 
 	auto ctx = m_pdfcontext->getctx();
-	// load page
-	auto& pdfpage = getPage(page);
-	auto docpage = pdfpage.page;
-
-	// create the matrix
-	auto scale = fz_identity;
-	scale = fz_scale((destination.width / source.width) * (dpi / 72.0f), (destination.height / source.height) * (dpi / 72.0f));
-	auto transform = fz_translate(-source.upperleft.x, -source.upperleft.y);
-
-	auto fbox = fz_make_rect(0, 0, source.width, source.height);
-	auto bbox = fz_round_rect(fz_transform_rect(fbox, scale));
-	auto pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), bbox, nullptr, 1);
-	fz_clear_pixmap_with_value(ctx, pix, 0xff);
-	auto dev = fz_new_draw_device(ctx, fz_identity, pix);
-	pdf_run_page_with_usage(ctx, (pdf_page*)docpage, dev, fz_concat(transform, scale), "View", nullptr);
 
+	auto pix = renderPage(ctx, getPage(page).page, destination, source, dpi, draft);
+	m_pdfcontext->touchMemory();
 
-	RenderHandler::Bitmap butmap(context, pix->samples, { {0, 0}, (unsigned int)bbox.x1, (unsigned int)bbox.y1 }, pix->stride, dpi);
+	rendertime.record((Trace::now() - start) / 1000);
+	return pix;
+}
 
-	fz_drop_pixmap(ctx, pix);
-	fz_drop_device(ctx, dev);
+RenderHandler::Bitmap PDFHandler::PDF::createBitmapFromPixmap(RenderHandler::Direct2DContext* context, fz_pixmap* pix, float dpi) {
+	return RenderHandler::Bitmap(context, pix->samples, { {0, 0}, (unsigned int)pix->w, (unsigned int)pix->h }, pix->stride, dpi);
+}
 
-	return std::move(butmap);
+fz_display_list* PDFHandler::PDF::createDisplayList(unsigned int page, size_t* memory) {
+	auto ctx = m_pdfcontext->getctx();
+	auto& pdfpage = getPage(page);
+	auto start = MUPDF::getThreadAllocations();
+	fz_display_list* list = nullptr;
+	fz_var(list);
+	fz_try(ctx) {
+		list = PDFHandler::createDisplayList(ctx, pdfpage.page);
+	}
+	fz_catch(ctx) {
+		Logger::err(L"Couldn't record page " + std::to_wstring(page));
+		list = nullptr;
+	}
+	m_pdfcontext->touchMemory();
+	if (memory != nullptr) {
+		// the fonts and images the list loaded into the store are part of it until the store drops them
+		*memory = list != nullptr ? (size_t)max(MUPDF::getThreadAllocations() - start, (INT64)0) : 0;
+		m_pdfcontext->claimMemory((INT64)*memory);
+	}
+	return list;
 }
 
 Rect2D<float> PDFHandler::PDF::getPageSize(unsigned int page, float dpi) {
@@ -143,22 +153,56 @@ Rect2D<float> PDFHandler::PDF::getPageSize(unsigned int page, float dpi) {
 	return { {0, 0}, rect.x1 * (dpi / 72.0f), rect.y1 * (dpi / 72.0f) };
 }
 
-void PDFHandler::PDF::save(const std::wstring& s) {
+UINT64 PDFHandler::PDF::save(const std::wstring& s) {
+	TRACE_SCOPE("PDF::save", "save");
 	auto ctx = m_pdfcontext->getctx();
 	fz_buffer* buf = fz_new_buffer(ctx, 0);
 	fz_output* output = fz_new_output_with_buffer(ctx, buf);
 	pdf_write_document(ctx, (pdf_document*)m_doc, output, &default_write_options);
 	FileHandler::saveFile(s, buf->data, buf->len);
+	auto hash = FileHandler::hashData(buf->data, buf->len);
 
 	fz_close_output(ctx, output);
 	fz_drop_output(ctx, output);
 	fz_drop_buffer(ctx, buf);
+
+	return hash;
+}
+
+void PDFHandler::PDF::loadPage(size_t page) {
+	auto ctx = m_pdfcontext->getctx();
+	auto start = MUPDF::getThreadAllocations();
+	auto& pdfpage = m_pages[page];
+	pdfpage = PdfPage(ctx, fz_load_page(ctx, m_doc, (int)page));
+	pdfpage.memory = (size_t)max(MUPDF::getThreadAllocations() - start, (INT64)0);
+	m_pageMemory += pdfpage.memory;
+	m_pdfcontext->claimMemory((INT64)pdfpage.memory);
 }
 
 PDFHandler::PdfPage& PDFHandler::PDF::getPage(size_t page) {
+	if (m_pages[page].page == nullptr)
+		loadPage(page);
 	return m_pages[page];
 }
 
+size_t PDFHandler::PDF::releasePage(size_t page) {
+	auto& pdfpage = m_pages[page];
+	if (pdfpage.page == nullptr)
+		return 0;
+	if (pdf_first_annot(m_pdfcontext->getctx(), pdfpage) != nullptr)
+		return 0;
+
+	auto memory = pdfpage.memory;
+	pdfpage = PdfPage();
+	m_pageMemory -= memory;
+	m_pdfcontext->claimMemory(-(INT64)memory);
+	return memory;
+}
+
+size_t PDFHandler::PDF::getPageMemory() const {
+	return m_pageMemory;
+}
+
 size_t PDFHandler::PDF::getNumberOfPages() {
 	auto ctx = m_pdfcontext->getctx();
 	return fz_count_pages(ctx, m_doc);
@@ -1,10 +1,11 @@
 #include "RenderHandler.h"
 #include "util/Logger.h"
+#include "util/Trace.h"
 #include <d2d1_1.h>
 
 ID2D1Factory* RenderHandler::Direct2DContext::m_pD2DFactory;
 
-RenderHandler::Direct2DContext::Direct2DContext(WindowHandler::Window* w) {
+RenderHandler::Direct2DContext::Direct2DContext(WindowHandler::Window* w) : m_frameScheduler(Trace::now) {
 	if (w == nullptr) {
 		Logger::err(L"An Unknown Error has occured");
 		return;
@@ -79,6 +80,8 @@ void RenderHandler::Direct2DContext::render() {
 		return;
 
 	beginDraw();
+	m_renderRegion = Rect2D<float>(m_displayViewSize);
+	m_isPartialRender = false;
 		
 	if (RenderCallbackFunction != nullptr)
 		RenderCallbackFunction(this->m_hwndRendertarget);
@@ -93,6 +96,55 @@ void RenderHandler::Direct2DContext::render() {
 	endDraw();
 }
 
+void RenderHandler::Direct2DContext::render(const std::vector<Rect2D<float>>& region) {
+	if (m_hwndRendertarget == nullptr)
+		return;
+
+	beginDraw();
+	m_isPartialRender = true;
+	for (auto& r : region) {
+		// the clip keeps the callback from touching anything outside of the rect. Clear respects it too
+		m_renderRegion = r;
+		m_hwndRendertarget->SetTransform(D2D1::Matrix3x2F::Identity());
+		m_hwndRendertarget->PushAxisAlignedClip(r, D2D1_ANTIALIAS_MODE_ALIASED);
+
+		if (RenderCallbackFunction != nullptr)
+			RenderCallbackFunction(this->m_hwndRendertarget);
+
+		m_hwndRendertarget->SetTransform(D2D1::Matrix3x2F::Identity());
+		if (m_renderDebugInfo)
+			renderText();
+		m_hwndRendertarget->PopAxisAlignedClip();
+	}
+	m_renderRegion = Rect2D<float>(m_displayViewSize);
+	m_isPartialRender = false;
+	endDraw();
+}
+
+void RenderHandler::Direct2DContext::invalidate(UINT32 flags) {
+	m_frameScheduler.invalidate(flags);
+}
+
+void RenderHandler::Direct2DContext::invalidate(const Rect2D<float>& rect) {
+	auto r = transformRect(rect);
+	// whole pixels so the anti aliased edges are part of the rect
+	auto left = std::floor(r.upperleft.x) - 1;
+	auto top = std::floor(r.upperleft.y) - 1;
+	m_frameScheduler.invalidate(Rect2D<float>({ left, top }, std::ceil(r.upperleft.x + r.width) + 1 - left, std::ceil(r.upperleft.y + r.height) + 1 - top));
+}
+
+Rect2D<float> RenderHandler::Direct2DContext::getRenderRegion() const {
+	return m_renderRegion;
+}
+
+bool RenderHandler::Direct2DContext::isPartialRender() const {
+	return m_isPartialRender;
+}
+
+FrameScheduler& RenderHandler::Direct2DContext::getFrameScheduler() {
+	return m_frameScheduler;
+}
+
 ID2D1Factory* RenderHandler::Direct2DContext::getFactory() const {
 	return m_pD2DFactory;
 }
@@ -149,7 +201,8 @@ void RenderHandler::Direct2DContext::renderText() {
 	beginDraw();
 	IDWriteTextLayout* textLayout;
 	auto r = m_hwndRendertarget->GetPixelSize();
-	m_writeFactory->CreateTextLayout(m_debugString.c_str(), m_debugString.size(), m_debugtextformat, (float)r.width, (float)r.height, &textLayout);
+	auto text = m_debugSummary.empty() ? m_debugString : m_debugSummary + L"\n" + m_debugString;
+	m_writeFactory->CreateTextLayout(text.c_str(), text.size(), m_debugtextformat, (float)r.width, (float)r.height, &textLayout);
 	if (textLayout == nullptr)
 		return;
 	m_hwndRendertarget->DrawTextLayout(D2D1::Point2F(), textLayout, m_debugBrush);
@@ -210,6 +263,10 @@ void RenderHandler::Direct2DContext::setCurrentViewPortMatrixActive() {
 	m_hwndRendertarget->SetTransform(m_transformationMatrix * m_scaleMatrix);
 }
 
+void RenderHandler::Direct2DContext::setCurrentViewPortMatrixActive(Point2D<float> offset) {
+	m_hwndRendertarget->SetTransform(D2D1::Matrix3x2F::Translation(offset) * m_transformationMatrix * m_scaleMatrix);
+}
+
 void RenderHandler::Direct2DContext::setIdentityViewPortMatrixActive() {
 	m_hwndRendertarget->SetTransform(D2D1::Matrix3x2F::Identity());
 }
@@ -302,8 +359,15 @@ void RenderHandler::Direct2DContext::addDebugText(const std::wstring& s, bool fo
 		m_debugString.erase(m_maxDebugStringSize, m_debugString.npos);
 	}
 
+	// the text is drawn with the next frame. Only repaint right away if it was requested
+	InvalidateRect(m_hwndRendertarget->GetHwnd(), nullptr, false);
+	if (forceDraw)
+		UpdateWindow(m_hwndRendertarget->GetHwnd());
+}
+
+void RenderHandler::Direct2DContext::setDebugSummary(const std::wstring& s) {
+	m_debugSummary = s;
 	InvalidateRect(m_hwndRendertarget->GetHwnd(), nullptr, false);
-	UpdateWindow(m_hwndRendertarget->GetHwnd());
 }
 
 void RenderHandler::Direct2DContext::addRepaintCallbackFunction(void (*fun)(ID2D1HwndRenderTarget* const)) {
@@ -331,7 +395,9 @@ RenderHandler::Bitmap::Bitmap(const Bitmap& f) {
 }
 
 RenderHandler::Bitmap& RenderHandler::Bitmap::operator=(const Bitmap& f) {
-	f.m_bitmap->AddRef();
+	if (f.m_bitmap != nullptr)
+		f.m_bitmap->AddRef();
+	SafeRelease(&m_bitmap);
 	m_bitmap = f.m_bitmap;
 	return *this;
 }
@@ -342,6 +408,10 @@ RenderHandler::Bitmap::Bitmap(Bitmap&& f) {
 }
 
 RenderHandler::Bitmap& RenderHandler::Bitmap::operator=(Bitmap&& f) {
+	if (this == &f)
+		return *this;
+	// the old bitmap would leak otherwise
+	SafeRelease(&m_bitmap);
 	m_bitmap = f.m_bitmap;
 	f.m_bitmap = nullptr;
 
@@ -1,5 +1,6 @@
 #include "pdf/PDFHandler.h"
 #include "util/Logger.h"
+#include "util/PixelCodec.h"
 
 RenderHandler::PDFBuilder::PDFBuilder(Direct2DContext* context, PDFHandler::PDF* pdf) {
 	m_pdf = pdf;
@@ -10,35 +11,72 @@ RenderHandler::PDFBuilder::PDFBuilder(Direct2DContext* context, PDFHandler::PDF*
 	m_bitmapbuffer.resize(pages);
 
 	for (size_t i = 0; i < pages; i++) {
-		if (i == 0) {
-			m_bitmapbuffer[i] = new CachedPDFBitmap();
-			m_bitmapbuffer[i]->m_positionandsize = m_pdf->getPageSize(i);
-			m_bitmapbuffer[i]->m_scale = 1;
-			continue;
-		}
-		auto prevbitmap = m_bitmapbuffer[i - 1];
-		auto bitmap = new CachedPDFBitmap();
-		bitmap->m_positionandsize = m_pdf->getPageSize(i);
-		bitmap->m_positionandsize.upperleft.y = prevbitmap->m_positionandsize.upperleft.y + prevbitmap->m_positionandsize.height + padding;
-
-		m_bitmapbuffer[i] = bitmap;
+		m_bitmapbuffer[i] = new CachedPDFBitmap();
+		m_bitmapbuffer[i]->m_positionandsize = m_pdf->getPageSize(i);
 	}
 
+	// an empty message wakes the main loop so the finished bitmaps are uploaded
+	auto hwnd = m_rendercontext->getRenderTarget()->GetHwnd();
+	auto wake = [this, hwnd]() {
+		m_resultsReady = true;
+		PostMessage(hwnd, WM_NULL, 0, 0);
+	};
+	m_worker = new PDFHandler::RenderWorker(m_pdf->m_pdfcontext->getctx(), wake);
+	// the cache only belongs to this exact file. The anti aliasing is the only render setting that can change
+	auto ctx = m_pdf->m_pdfcontext->getctx();
+	m_cache = new PDFHandler::RenderCache(FileHandler::hashData(m_pdf->data, m_pdf->size), (UINT64)fz_aa_level(ctx));
+	m_thumbnails = new PDFHandler::ThumbnailService(ctx, pages, m_cache, wake);
+
+	// the costs are how long it takes to create the content again. A page has to be rendered, a coded bitmap only
+	// decoded and a preview is still deflated by the thumbnail service
+	m_bitmapMemory = MemoryBudget::add("pdfbuilder.bitmaps", 4, [this](size_t bytes) { return evictBitmaps(bytes); });
+	m_encodedMemory = MemoryBudget::add("pdfbuilder.encoded", 3, [this](size_t bytes) {
+		auto before = m_encodedSize;
+		trimEncoded(before - min(bytes, before));
+		return before - m_encodedSize;
+	});
+	m_previewMemory = MemoryBudget::add("pdfbuilder.previews", 1, [this](size_t bytes) { return evictPreviews(bytes); });
+	m_displayListMemory = MemoryBudget::add("pdfbuilder.displaylists", 2, [this](size_t bytes) { return evictDisplayLists(bytes); });
+	m_pageMemory = MemoryBudget::add("pdf.pages", 2, [this](size_t bytes) { return evictPages(bytes); });
+
+	calculatePageLayout();
 	calculateOutOfBoundsPDF();
+	loadCachedPages();
 	createPreviewBitmaps(m_previewScale);
 }
 
 RenderHandler::PDFBuilder::~PDFBuilder() {
 	// there should be no ownership of the pdf or the context so we wont delete it here
+	// the worker and the thumbnail service still use the display lists
+	delete m_worker;
+	delete m_thumbnails;
+	// writes the new pages to disk
+	delete m_cache;
 	for (size_t i = 0; i < m_bitmapbuffer.size(); i++) {
 		if (m_bitmapbuffer[i] == nullptr)
 			continue;
 
+		dropDisplayList(i);
 		delete m_bitmapbuffer[i];
 	}
+	MemoryBudget::remove(m_bitmapMemory);
+	MemoryBudget::remove(m_encodedMemory);
+	MemoryBudget::remove(m_previewMemory);
+	MemoryBudget::remove(m_displayListMemory);
+	MemoryBudget::remove(m_pageMemory);
+}
+
+void RenderHandler::PDFBuilder::calculatePageLayout() {
+	float y = 0;
+	for (size_t i = 0; i < m_bitmapbuffer.size(); i++) {
+		auto& pos = m_bitmapbuffer[i]->m_positionandsize;
+		pos.upperleft = { 0, y };
+		y += pos.height + m_padding;
+	}
 }
 
 void RenderHandler::PDFBuilder::calculateOutOfBoundsPDF() {
+	TRACE_SCOPE("calculateOutOfBoundsPDF", "render");
 	// get the window size
 	auto size = m_rendercontext->getDisplayViewport();
 	// transform the viewport
@@ -67,32 +105,169 @@ void RenderHandler::PDFBuilder::calculateOutOfBoundsPDF() {
 }
 
 void RenderHandler::PDFBuilder::createPreviewBitmaps(float scale) {
-	if (m_pdf == nullptr || m_rendercontext == nullptr)
+	TRACE_SCOPE("createPreviewBitmaps", "render");
+	static auto& previewhits = Metrics::counter("pdfbuilder.preview.hits");
+	static auto& previewmisses = Metrics::counter("pdfbuilder.preview.misses");
+	if (m_pdf == nullptr || m_rendercontext == nullptr || m_thumbnails == nullptr)
 		return;
 
-	size_t startIndex = 0;
-	if (m_previewPages < m_startpagerender)
-		startIndex = m_startpagerender - m_previewPages;
-	size_t endIndex = m_endpagerender + m_previewPages;
+	// the visible pages first, then the ones around them
+	std::vector<size_t> order;
+	for (size_t i = m_startpagerender; i < m_endpagerender; i++)
+		order.push_back(i);
+	if (m_velocity.y == 0) {
+		for (size_t n = 1; n <= m_bitmapbuffer.size(); n++) {
+			bool hasafter = m_endpagerender - 1 + n < m_bitmapbuffer.size();
+			bool hasbefore = n <= m_startpagerender;
+			if (!hasafter && !hasbefore)
+				break;
+			if (hasafter)
+				order.push_back(m_endpagerender - 1 + n);
+			if (hasbefore)
+				order.push_back(m_startpagerender - n);
+		}
+	}
+	else {
+		// while the view moves the pages ahead of it come first and only a few behind it are kept
+		bool down = m_velocity.y > 0;
+		size_t ahead = down ? m_bitmapbuffer.size() - m_endpagerender : m_startpagerender;
+		size_t behind = min(down ? m_startpagerender : m_bitmapbuffer.size() - m_endpagerender, PREVIEW_PAGES_BEHIND);
+		for (size_t n = 1; n <= ahead; n++)
+			order.push_back(down ? m_endpagerender - 1 + n : m_startpagerender - n);
+		for (size_t n = 1; n <= behind; n++)
+			order.push_back(down ? m_startpagerender - n : m_endpagerender - 1 + n);
+	}
+	// the pages that were left out lose their previews like the ones over the budget
+	size_t wanted = order.size();
+	if (wanted < m_bitmapbuffer.size()) {
+		std::vector<bool> ordered(m_bitmapbuffer.size(), false);
+		for (auto i : order)
+			ordered[i] = true;
+		for (size_t i = 0; i < m_bitmapbuffer.size(); i++) {
+			if (!ordered[i])
+				order.push_back(i);
+		}
+	}
 
-	for (size_t i = 0; i < m_pdf->getNumberOfPages(); i++) {
-		auto& bitmap = m_bitmapbuffer[i];
-		// remove the previous bitmaps for memory reasons
-		if (i < startIndex || i > endIndex) {
+	// the queued thumbnails are requested again in the new order
+	m_thumbnails->cancel();
+	m_previewQueue.clear();
+	m_previewRequestScale = scale;
+	auto dpi = m_rendercontext->getDpi() * scale;
+	UINT64 pixels = 0;
+	bool full = false;
+	for (size_t n = 0; n < order.size(); n++) {
+		auto i = order[n];
+		auto bitmap = m_bitmapbuffer[i];
+		auto& size = bitmap->m_positionandsize;
+		UINT64 pagepixels = (UINT64)std::ceil(size.width * dpi / 72.0f) * (UINT64)std::ceil(size.height * dpi / 72.0f);
+		full = full || n >= wanted || pixels + pagepixels > PREVIEW_PIXEL_BUDGET;
+		bitmap->m_previewWanted = !full;
+		if (full) {
+			// the thumbnail service still has it deflated
+			bitmap->m_previewbitmap = RenderHandler::Bitmap();
 			bitmap->m_previewscale = 0;
-			bitmap->m_previewbitmap.~Bitmap(); 
+			continue;
+		}
+		pixels += pagepixels;
+
+		if (bitmap->m_previewbitmap.m_bitmap != nullptr && isEqual(scale, bitmap->m_previewscale)) {
+			previewhits.add();
+			continue;
+		}
+		previewmisses.add();
+		m_previewQueue.push_back(i);
+	}
+	// this is called while the view moves, the display lists are recorded by the next update
+	requestPreviews(false);
+}
+
+void RenderHandler::PDFBuilder::loadCachedPages() {
+	TRACE_SCOPE("loadCachedPages", "render");
+	static auto& loaded = Metrics::counter("pdfbuilder.cache.loaded");
+	if (m_cache == nullptr)
+		return;
+
+	// the pages of the first view are cached as a whole so every part of them can be shown
+	auto ctx = m_pdf->m_pdfcontext->getctx();
+	auto pixelscale = getPixelScale(false);
+	auto dpi = m_rendercontext->getMatrixScaleOffset() * m_rendercontext->getDpi();
+	for (size_t i = m_startpagerender; i < m_endpagerender; i++) {
+		auto bitmap = m_bitmapbuffer[i];
+		auto area = getPixelArea(i, bitmap->m_positionandsize, pixelscale);
+		std::vector<unsigned char> data;
+		int width = 0, height = 0;
+		if (!m_cache->get(i, dpi, data, width, height) || width != area.width || height != area.height) {
+			renderPixelAreaInBackground(i, area, false);
+			bitmap->m_refineCache = true;
 			continue;
 		}
 
-		if (isEqual(scale, bitmap->m_previewscale))
+		// inflating is much faster than rendering the page
+		fz_pixmap* pix = nullptr;
+		fz_var(pix);
+		fz_try(ctx) {
+			pix = PDFHandler::inflatePixmap(ctx, data.data(), data.size(), width, height);
+		}
+		fz_catch(ctx) {
+			LOG_WARNING(L"Couldn't inflate the cached page {}", i);
 			continue;
+		}
+		bitmap->m_bitmap = m_pdf->createBitmapFromPixmap(m_rendercontext, pix, m_rendercontext->getDpi());
+		bitmap->m_bitmapArea = area;
+		bitmap->m_scale = m_rendercontext->getMatrixScaleOffset();
+		bitmap->m_draft = false;
+		setEncoded(i, PixelCodec::encode(pix->samples, pix->w, pix->h, (UINT32)pix->stride));
+		fz_drop_pixmap(ctx, pix);
+		loaded.add();
+	}
+}
 
-		bitmap->m_previewbitmap = m_pdf->createBitmapFromPage(m_rendercontext, i, bitmap->m_positionandsize, m_rendercontext->getDpi() * scale);
-		bitmap->m_previewscale = scale;
+void RenderHandler::PDFBuilder::storeCachedPage(size_t page, fz_pixmap* pix) {
+	static auto& stored = Metrics::counter("pdfbuilder.cache.stored");
+	auto ctx = m_pdf->m_pdfcontext->getctx();
+	unsigned char* data = nullptr;
+	size_t length = 0;
+	fz_var(data);
+	fz_try(ctx) {
+		data = PDFHandler::deflatePixmap(ctx, pix, &length);
+	}
+	fz_catch(ctx) {
+		LOG_WARNING(L"Couldn't deflate page {} for the render cache", page);
+		return;
 	}
+	m_cache->put(page, m_bitmapbuffer[page]->m_refineScale * m_rendercontext->getDpi(), pix->w, pix->h, data, length);
+	fz_free(ctx, data);
+	stored.add();
+}
+
+void RenderHandler::PDFBuilder::requestPreviews(bool record) {
+	auto dpi = m_rendercontext->getDpi() * m_previewRequestScale;
+	// the pages that still need a display list keep their order
+	std::vector<size_t> waiting;
+	for (auto i : m_previewQueue) {
+		auto bitmap = m_bitmapbuffer[i];
+		if (m_thumbnails->isDeflated(i, dpi)) {
+			m_thumbnails->request(i, nullptr, bitmap->m_positionandsize, dpi);
+			continue;
+		}
+
+		// recording a page takes a while. The rest is requested by the next update
+		if (bitmap->m_displayList == nullptr) {
+			if (!record) {
+				waiting.push_back(i);
+				continue;
+			}
+			createDisplayList(i);
+			record = false;
+		}
+		m_thumbnails->request(i, bitmap->m_displayList, bitmap->m_positionandsize, dpi);
+	}
+	m_previewQueue = std::move(waiting);
 }
 
 void RenderHandler::PDFBuilder::renderBitmap() {
+	TRACE_SCOPE("renderBitmap", "render");
 	if (m_pdf == nullptr || m_rendercontext == nullptr)
 		return;
 
@@ -103,6 +278,9 @@ void RenderHandler::PDFBuilder::renderBitmap() {
 }
 
 void RenderHandler::PDFBuilder::renderBitmap(size_t page, bool viewportintersection) {
+	static auto& reused = Metrics::counter("pdfbuilder.bitmap.reused");
+	static auto& shifted = Metrics::counter("pdfbuilder.bitmap.shifted");
+	static auto& drafts = Metrics::counter("pdfbuilder.bitmap.drafts");
 	if (m_pdf == nullptr || m_rendercontext == nullptr)
 		return;
 
@@ -111,40 +289,510 @@ void RenderHandler::PDFBuilder::renderBitmap(size_t page, bool viewportintersect
 		return;
 
 	CachedPDFBitmap* bitmap = m_bitmapbuffer[page];
-	Rect2D<float> transformedrect = m_rendercontext->scaleFromDisplayPixelsToViewPortPixels(bitmap->m_positionandsize);
+	// a page that was scrolled back into the view only has to be decoded. Pixels of another scale are rendered again anyway
+	if (bitmap->m_bitmap.m_bitmap == nullptr && isEqual(bitmap->m_scale, m_rendercontext->getMatrixScaleOffset()))
+		restoreBitmap(page);
+	auto& visible = viewportintersection ? bitmap->m_intersectionWithViewPort : bitmap->m_positionandsize;
+	// while the view moves a draft is rendered so the frame doesn't wait for a full quality render
+	bool draft = isInteracting();
+	auto pixelscale = getPixelScale(draft);
+	auto area = getPixelArea(page, visible, pixelscale);
+	if (area.width <= 0 || area.height <= 0)
+		return;
+
+	bool samescale = bitmap->m_bitmap.m_bitmap != nullptr && isEqual(bitmap->m_scale, m_rendercontext->getMatrixScaleOffset());
+	auto& old = bitmap->m_bitmapArea;
+	// Nothing to do if the old bitmap still covers the viewport, e.g. the page was scrolled back and forth.
+	// A draft is kept too because update refines it in the background
+	if (isBitmapCurrent(page, visible)) {
+		reused.add();
+		return;
+	}
+
+	// if the view only moved the pixels that are still visible are copied and only the newly exposed strips are rendered
+	if (samescale && bitmap->m_draft == draft && old.intersects(area)) {
+		shifted.add();
+		auto keep = old.intersection(area);
+		RenderHandler::Bitmap shiftedbitmap(m_rendercontext, Rect2D<unsigned int>(Rect2D<float>({ 0, 0 }, area.width, area.height)), m_rendercontext->getDpi());
+		if (shiftedbitmap.m_bitmap != nullptr) {
+			D2D1_POINT_2U to = { (UINT32)(keep.upperleft.x - area.upperleft.x), (UINT32)(keep.upperleft.y - area.upperleft.y) };
+			D2D1_RECT_U from = { (UINT32)(keep.upperleft.x - old.upperleft.x), (UINT32)(keep.upperleft.y - old.upperleft.y), (UINT32)(keep.upperleft.x - old.upperleft.x + keep.width), (UINT32)(keep.upperleft.y - old.upperleft.y + keep.height) };
+			shiftedbitmap.m_bitmap->CopyFromBitmap(&to, bitmap->m_bitmap.m_bitmap, &from);
+
+			// the coded pixels are put together the same way on the cpu so the bitmap can be released off screen.
+			// The gpu can't read its bitmaps back so without coded pixels of the old bitmap there are none
+			auto width = (UINT32)area.width;
+			auto height = (UINT32)area.height;
+			std::vector<byte> pixels;
+			if (!bitmap->m_encoded.empty()) {
+				auto oldwidth = (UINT32)old.width;
+				std::vector<byte> oldpixels((size_t)oldwidth * (UINT32)old.height * 4);
+				if (PixelCodec::decode(bitmap->m_encoded.data(), bitmap->m_encoded.size(), oldpixels.data(), oldwidth, (UINT32)old.height, oldwidth * 4)) {
+					pixels.resize((size_t)width * height * 4);
+					for (UINT32 y = 0; y < (UINT32)keep.height; y++) {
+						memcpy(pixels.data() + ((size_t)(to.y + y) * width + to.x) * 4,
+							oldpixels.data() + ((size_t)(from.top + y) * oldwidth + from.left) * 4, (size_t)keep.width * 4);
+					}
+				}
+			}
+
+			// the strips above and below the kept pixels span the whole width, the ones left and right only its height
+			float keepbottom = keep.upperleft.y + keep.height;
+			float keepright = keep.upperleft.x + keep.width;
+			Rect2D<float> strips[4] = {
+				{ area.upperleft, area.width, keep.upperleft.y - area.upperleft.y },
+				{ { area.upperleft.x, keepbottom }, area.width, area.upperleft.y + area.height - keepbottom },
+				{ { area.upperleft.x, keep.upperleft.y }, keep.upperleft.x - area.upperleft.x, keep.height },
+				{ { keepright, keep.upperleft.y }, area.upperleft.x + area.width - keepright, keep.height }
+			};
+			for (auto& strip : strips) {
+				if (strip.width <= 0 || strip.height <= 0)
+					continue;
+				auto pix = renderPixmap(page, strip, pixelscale, draft);
+				if (pix == nullptr) {
+					pixels.clear();
+					continue;
+				}
+				D2D1_POINT_2U stripto = { (UINT32)(strip.upperleft.x - area.upperleft.x), (UINT32)(strip.upperleft.y - area.upperleft.y) };
+				auto stripbitmap = m_pdf->createBitmapFromPixmap(m_rendercontext, pix, m_rendercontext->getDpi());
+				if (stripbitmap.m_bitmap != nullptr) {
+					D2D1_RECT_U stripfrom = { 0, 0, (UINT32)strip.width, (UINT32)strip.height };
+					shiftedbitmap.m_bitmap->CopyFromBitmap(&stripto, stripbitmap.m_bitmap, &stripfrom);
+				}
+				// the pixmap has the size of the strip. The copy is clamped so a rounding difference stays inside
+				if (!pixels.empty()) {
+					auto stripwidth = min((UINT32)pix->w, width - stripto.x);
+					auto stripheight = min((UINT32)pix->h, height - stripto.y);
+					for (UINT32 y = 0; y < stripheight; y++) {
+						memcpy(pixels.data() + ((size_t)(stripto.y + y) * width + stripto.x) * 4,
+							pix->samples + (size_t)y * pix->stride, (size_t)stripwidth * 4);
+					}
+				}
+				fz_drop_pixmap(m_pdf->m_pdfcontext->getctx(), pix);
+			}
+
+			bitmap->m_bitmap = std::move(shiftedbitmap);
+			bitmap->m_bitmapArea = area;
+			setEncoded(page, pixels.empty() ? std::vector<byte>() : PixelCodec::encode(pixels.data(), width, height, width * 4));
+			if (!bitmap->m_refineCache)
+				bitmap->m_refineJob = 0;
+			return;
+		}
+	}
+
 	// render the pdf onto a bitmap
-	//if (bitmap->m_bitmap.m_bitmap == nullptr || !isEqual(bitmap->m_scale, m_rendercontext->getMatrixScaleOffset())) {
-	bitmap->m_bitmap.~Bitmap();
-	if (viewportintersection)
-		bitmap->m_bitmap = m_pdf->createBitmapFromPage(m_rendercontext, page, m_rendercontext->scaleFromDisplayPixelsToViewPortPixels(bitmap->m_intersectionWithViewPort), { bitmap->m_intersectionWithViewPort.upperleft - bitmap->m_positionandsize.upperleft, bitmap->m_intersectionWithViewPort.width, bitmap->m_intersectionWithViewPort.height }, m_rendercontext->getDpi());
-	else
-		bitmap->m_bitmap = m_pdf->createBitmapFromPage(m_rendercontext, page, transformedrect, m_rendercontext->getDpi());
+	drafts.add(draft);
+	std::vector<byte> encoded;
+	bitmap->m_bitmap = renderPixelArea(page, area, pixelscale, draft, &encoded);
+	bitmap->m_bitmapArea = area;
 	bitmap->m_scale = m_rendercontext->getMatrixScaleOffset();
-	//}
+	bitmap->m_draft = draft;
+	setEncoded(page, std::move(encoded));
+	// A prefetch that is still running would replace the newer bitmap. The whole page for the render cache
+	// contains it
+	if (!bitmap->m_refineCache)
+		bitmap->m_refineJob = 0;
+}
+
+void RenderHandler::PDFBuilder::renderBitmapInBackground() {
+	TRACE_SCOPE("renderBitmapInBackground", "render");
+	if (m_pdf == nullptr || m_rendercontext == nullptr || m_worker == nullptr)
+		return;
+	if (m_rendercontext->getMatrixScaleOffset() < m_previewScale)
+		return;
+
+	for (size_t i = m_startpagerender; i < m_endpagerender; i++) {
+		auto bitmap = m_bitmapbuffer[i];
+		if (bitmap->m_bitmap.m_bitmap == nullptr)
+			restoreBitmap(i);
+		// one job per page so the bitmaps are replaced one after another while the view keeps moving
+		if (bitmap->m_refineJob != 0 || isBitmapCurrent(i, bitmap->m_intersectionWithViewPort))
+			continue;
+		auto area = getPixelArea(i, bitmap->m_intersectionWithViewPort, getPixelScale(true));
+		if (area.width <= 0 || area.height <= 0)
+			continue;
+		renderPixelAreaInBackground(i, area, true);
+	}
+}
+
+float RenderHandler::PDFBuilder::getPixelScale(bool draft) const {
+	// the same resolution createBitmapFromPage uses for the scale of the view
+	return m_rendercontext->getMatrixScaleOffset() * m_rendercontext->getDpi() / 72.0f * (draft ? DRAFT_RESOLUTION : 1);
+}
+
+float RenderHandler::PDFBuilder::getBitmapPixelScale(const CachedPDFBitmap* bitmap) const {
+	// the scale the bitmap was rendered with
+	return bitmap->m_scale * m_rendercontext->getDpi() / 72.0f * (bitmap->m_draft ? DRAFT_RESOLUTION : 1);
+}
+
+float RenderHandler::PDFBuilder::getScaleDistance(float scale) const {
+	auto current = m_rendercontext->getMatrixScaleOffset();
+	return max(scale / current, current / scale);
+}
+
+bool RenderHandler::PDFBuilder::isBitmapCurrent(size_t page, Rect2D<float> rect) const {
+	auto bitmap = m_bitmapbuffer[page];
+	// a released bitmap is current as long as it can be restored
+	if ((bitmap->m_bitmap.m_bitmap == nullptr && bitmap->m_encoded.empty()) || !isEqual(bitmap->m_scale, m_rendercontext->getMatrixScaleOffset()))
+		return false;
+	auto& old = bitmap->m_bitmapArea;
+	auto needed = getPixelArea(page, rect, getBitmapPixelScale(bitmap));
+	return old.upperleft.x <= needed.upperleft.x && old.upperleft.y <= needed.upperleft.y
+		&& old.upperleft.x + old.width >= needed.upperleft.x + needed.width && old.upperleft.y + old.height >= needed.upperleft.y + needed.height;
+}
+
+Rect2D<float> RenderHandler::PDFBuilder::getPixelArea(size_t page, Rect2D<float> rect, float pixelscale) const {
+	auto& pos = m_bitmapbuffer[page]->m_positionandsize;
+	float left = std::floor(max(rect.upperleft.x - pos.upperleft.x, 0.0f) * pixelscale);
+	float top = std::floor(max(rect.upperleft.y - pos.upperleft.y, 0.0f) * pixelscale);
+	float right = std::ceil(min(rect.upperleft.x + rect.width - pos.upperleft.x, pos.width) * pixelscale);
+	float bottom = std::ceil(min(rect.upperleft.y + rect.height - pos.upperleft.y, pos.height) * pixelscale);
+	return Rect2D<float>({ left, top }, right - left, bottom - top);
+}
+
+void RenderHandler::PDFBuilder::getRenderRects(Rect2D<float> area, float pixelscale, Rect2D<float>& destination, Rect2D<float>& source) const {
+	// the source is in pdf units and the destination is chosen so mupdf creates exactly the pixels of the area
+	auto dpi = m_rendercontext->getDpi();
+	source = Rect2D<float>({ area.upperleft.x / pixelscale, area.upperleft.y / pixelscale }, area.width / pixelscale, area.height / pixelscale);
+	destination = Rect2D<float>({ 0, 0 }, area.width * 72.0f / dpi, area.height * 72.0f / dpi);
+}
+
+fz_pixmap* RenderHandler::PDFBuilder::renderPixmap(size_t page, Rect2D<float> area, float pixelscale, bool draft) {
+	static auto& rasterized = Metrics::counter("pdfbuilder.rasterized_pixels");
+	rasterized.add((UINT64)(area.width * area.height));
+	m_pageMemory->touch();
+	Rect2D<float> destination, source;
+	getRenderRects(area, pixelscale, destination, source);
+	return m_pdf->renderPixmap(page, destination, source, m_rendercontext->getDpi(), draft);
+}
+
+RenderHandler::Bitmap RenderHandler::PDFBuilder::renderPixelArea(size_t page, Rect2D<float> area, float pixelscale, bool draft, std::vector<byte>* encoded) {
+	auto pix = renderPixmap(page, area, pixelscale, draft);
+	if (pix == nullptr)
+		return RenderHandler::Bitmap();
+	auto bitmap = m_pdf->createBitmapFromPixmap(m_rendercontext, pix, m_rendercontext->getDpi());
+	// the pixels are coded like the ones of the render worker so the bitmap can be released off screen
+	if (encoded != nullptr)
+		*encoded = PixelCodec::encode(pix->samples, pix->w, pix->h, (UINT32)pix->stride);
+	fz_drop_pixmap(m_pdf->m_pdfcontext->getctx(), pix);
+	return bitmap;
+}
+
+void RenderHandler::PDFBuilder::refineDrafts() {
+	static auto& refinements = Metrics::counter("pdfbuilder.bitmap.refinements");
+	if (m_worker == nullptr)
+		return;
+
+	for (size_t i = m_startpagerender; i < m_endpagerender; i++) {
+		auto bitmap = m_bitmapbuffer[i];
+		if (!bitmap->m_draft || bitmap->m_bitmap.m_bitmap == nullptr || bitmap->m_refineJob != 0)
+			continue;
+
+		auto area = getPixelArea(i, bitmap->m_intersectionWithViewPort, getPixelScale(false));
+		if (area.width <= 0 || area.height <= 0)
+			continue;
+		renderPixelAreaInBackground(i, area, false);
+		refinements.add();
+	}
+}
+
+Rect2D<float> RenderHandler::PDFBuilder::getPrefetchArea() const {
+	auto view = m_rendercontext->transformRectInv(Rect2D<float>(m_rendercontext->getDisplayViewport()));
+	auto ahead = view;
+	ahead.upperleft += m_velocity * (PREFETCH_TIME / 1'000'000'000.0f);
+	return view.merge(ahead);
+}
+
+void RenderHandler::PDFBuilder::prefetch() {
+	static auto& prefetched = Metrics::counter("pdfbuilder.prefetch.pages");
+	if (m_worker == nullptr || m_rendercontext->getMatrixScaleOffset() < m_previewScale)
+		return;
+	if (m_velocity.x == 0 && m_velocity.y == 0)
+		return;
+
+	// the pages are below each other so they are queued in the order the view reaches them
+	auto area = getPrefetchArea();
+	bool down = m_velocity.y >= 0;
+	for (size_t n = 0; n < m_bitmapbuffer.size(); n++) {
+		if (down ? m_endpagerender + n >= m_bitmapbuffer.size() : n >= m_startpagerender)
+			break;
+		size_t i = down ? m_endpagerender + n : m_startpagerender - n - 1;
+		auto bitmap = m_bitmapbuffer[i];
+		if (!area.intersects(bitmap->m_positionandsize))
+			break;
+		if (bitmap->m_refineJob != 0)
+			continue;
+
+		auto rect = area.intersection(bitmap->m_positionandsize);
+		if (isBitmapCurrent(i, rect))
+			continue;
+		auto pixelarea = getPixelArea(i, rect, getPixelScale(true));
+		if (pixelarea.width <= 0 || pixelarea.height <= 0)
+			continue;
+		renderPixelAreaInBackground(i, pixelarea, true);
+		prefetched.add();
+	}
+}
+
+void RenderHandler::PDFBuilder::renderPixelAreaInBackground(size_t page, Rect2D<float> area, bool draft) {
+	static auto& background = Metrics::counter("pdfbuilder.bitmap.background");
+	auto bitmap = m_bitmapbuffer[page];
+	createDisplayList(page);
+	if (bitmap->m_displayList == nullptr)
+		return;
+
+	PDFHandler::RenderWorker::Job job;
+	job.m_id = m_nextRefineJob++;
+	job.m_page = page;
+	job.m_list = bitmap->m_displayList;
+	job.m_dpi = m_rendercontext->getDpi();
+	job.m_draft = draft;
+	getRenderRects(area, getPixelScale(draft), job.m_destination, job.m_source);
+
+	bitmap->m_refineJob = job.m_id;
+	bitmap->m_refineArea = area;
+	bitmap->m_refineScale = m_rendercontext->getMatrixScaleOffset();
+	bitmap->m_refineDraft = draft;
+	bitmap->m_refineCache = false;
+	m_worker->add(job);
+	background.add();
+}
+
+void RenderHandler::PDFBuilder::setEncoded(size_t page, std::vector<byte> encoded) {
+	auto bitmap = m_bitmapbuffer[page];
+	m_encodedSize -= bitmap->m_encoded.size();
+	bitmap->m_encoded = std::move(encoded);
+	m_encodedSize += bitmap->m_encoded.size();
+	m_encodedMemory->setSize(m_encodedSize);
+}
+
+bool RenderHandler::PDFBuilder::restoreBitmap(size_t page) {
+	static auto& restored = Metrics::counter("tilecache.restored");
+	static auto& decodetime = Metrics::histogram("tilecache.decode_us");
+	auto bitmap = m_bitmapbuffer[page];
+	if (bitmap->m_encoded.empty())
+		return false;
+
+	TRACE_SCOPE("restoreBitmap", "render");
+	m_encodedMemory->touch();
+	auto start = Trace::now();
+	auto width = (UINT32)bitmap->m_bitmapArea.width;
+	auto height = (UINT32)bitmap->m_bitmapArea.height;
+	std::vector<byte> pixels((size_t)width * height * 4);
+	if (!PixelCodec::decode(bitmap->m_encoded.data(), bitmap->m_encoded.size(), pixels.data(), width, height, width * 4)) {
+		LOG_WARNING(L"Couldn't decode the bitmap of page {}", page);
+		setEncoded(page, {});
+		return false;
+	}
+	bitmap->m_bitmap = RenderHandler::Bitmap(m_rendercontext, pixels.data(), { {0, 0}, width, height }, width * 4, m_rendercontext->getDpi());
+	decodetime.record((Trace::now() - start) / 1000);
+	restored.add();
+	return bitmap->m_bitmap.m_bitmap != nullptr;
+}
+
+void RenderHandler::PDFBuilder::releaseOffscreenBitmaps() {
+	static auto& released = Metrics::counter("tilecache.released");
+	// while the view moves the pages it is about to reach stay on the gpu
+	bool interacting = isInteracting();
+	auto area = interacting ? getPrefetchArea() : Rect2D<float>();
+	for (size_t i = 0; i < m_bitmapbuffer.size(); i++) {
+		auto bitmap = m_bitmapbuffer[i];
+		if (i >= m_startpagerender && i < m_endpagerender)
+			continue;
+		if (bitmap->m_bitmap.m_bitmap == nullptr)
+			continue;
+		if (interacting && area.intersects(bitmap->m_positionandsize))
+			continue;
+		// a bitmap without coded pixels is rendered again when the page comes back
+		bitmap->m_bitmap = RenderHandler::Bitmap();
+		released.add();
+	}
+}
+
+void RenderHandler::PDFBuilder::trimEncoded(size_t budget) {
+	static auto& dropped = Metrics::counter("tilecache.dropped");
+	if (m_encodedSize <= budget)
+		return;
+
+	for (auto i : getEvictionOrder()) {
+		if (m_encodedSize <= budget)
+			break;
+		if (m_bitmapbuffer[i]->m_encoded.empty())
+			continue;
+		setEncoded(i, {});
+		dropped.add();
+	}
+}
+
+void RenderHandler::PDFBuilder::createDisplayList(size_t page) {
+	auto bitmap = m_bitmapbuffer[page];
+	m_displayListMemory->touch();
+	if (bitmap->m_displayList != nullptr)
+		return;
+	bitmap->m_displayList = m_pdf->createDisplayList(page, &bitmap->m_displayListSize);
+}
+
+void RenderHandler::PDFBuilder::dropDisplayList(size_t page) {
+	auto bitmap = m_bitmapbuffer[page];
+	if (bitmap->m_displayList == nullptr)
+		return;
+	// the worker and the thumbnail service keep their own reference until their jobs are done
+	fz_drop_display_list(m_pdf->m_pdfcontext->getctx(), bitmap->m_displayList);
+	bitmap->m_displayList = nullptr;
+	m_pdf->m_pdfcontext->claimMemory(-(INT64)bitmap->m_displayListSize);
+	bitmap->m_displayListSize = 0;
+}
+
+std::vector<size_t> RenderHandler::PDFBuilder::getEvictionOrder() const {
+	// the view reaches the pages furthest away last. before and after are the distances of the furthest pages above
+	// and below the view that aren't in the order yet
+	std::vector<size_t> order;
+	size_t end = min(m_endpagerender, m_bitmapbuffer.size());
+	size_t before = min(m_startpagerender, end);
+	size_t after = m_bitmapbuffer.size() - end;
+	while (before > 0 || after > 0) {
+		if (after >= before)
+			order.push_back(end + --after);
+		else
+			order.push_back(m_startpagerender - before--);
+	}
+	return order;
+}
+
+void RenderHandler::PDFBuilder::reportMemory() {
+	size_t bitmaps = 0, previews = 0, lists = 0;
+	for (auto bitmap : m_bitmapbuffer) {
+		if (bitmap->m_bitmap.m_bitmap != nullptr) {
+			auto size = bitmap->m_bitmap.m_bitmap->GetPixelSize();
+			bitmaps += (size_t)size.width * size.height * 4;
+		}
+		if (bitmap->m_previewbitmap.m_bitmap != nullptr) {
+			auto size = bitmap->m_previewbitmap.m_bitmap->GetPixelSize();
+			previews += (size_t)size.width * size.height * 4;
+		}
+		lists += bitmap->m_displayListSize;
+	}
+	m_bitmapMemory->setSize(bitmaps);
+	m_encodedMemory->setSize(m_encodedSize);
+	m_previewMemory->setSize(previews);
+	m_displayListMemory->setSize(lists);
+	m_pageMemory->setSize(m_pdf->getPageMemory());
+}
+
+size_t RenderHandler::PDFBuilder::evictBitmaps(size_t bytes) {
+	static auto& evicted = Metrics::counter("pdfbuilder.bitmap.evicted");
+	auto before = m_bitmapMemory->getSize();
+	auto order = getEvictionOrder();
+	size_t freed = 0;
+	// the bitmaps that can be decoded again go first
+	for (int pass = 0; pass < 2 && freed < bytes; pass++) {
+		for (auto i : order) {
+			auto bitmap = m_bitmapbuffer[i];
+			if (freed >= bytes)
+				break;
+			if (bitmap->m_bitmap.m_bitmap == nullptr || bitmap->m_encoded.empty() != (pass == 1))
+				continue;
+			auto size = bitmap->m_bitmap.m_bitmap->GetPixelSize();
+			freed += (size_t)size.width * size.height * 4;
+			bitmap->m_bitmap = RenderHandler::Bitmap();
+			evicted.add();
+		}
+	}
+	reportMemory();
+	return before - min(m_bitmapMemory->getSize(), before);
+}
+
+size_t RenderHandler::PDFBuilder::evictPreviews(size_t bytes) {
+	static auto& evicted = Metrics::counter("pdfbuilder.preview.evicted");
+	auto before = m_previewMemory->getSize();
+	size_t freed = 0;
+	for (auto i : getEvictionOrder()) {
+		auto bitmap = m_bitmapbuffer[i];
+		if (freed >= bytes)
+			break;
+		if (bitmap->m_previewbitmap.m_bitmap == nullptr)
+			continue;
+		auto size = bitmap->m_previewbitmap.m_bitmap->GetPixelSize();
+		freed += (size_t)size.width * size.height * 4;
+		// the thumbnail service still has it deflated. It is requested again once it is close to the view
+		bitmap->m_previewbitmap = RenderHandler::Bitmap();
+		bitmap->m_previewscale = 0;
+		bitmap->m_previewWanted = false;
+		evicted.add();
+	}
+	reportMemory();
+	return before - min(m_previewMemory->getSize(), before);
+}
+
+size_t RenderHandler::PDFBuilder::evictDisplayLists(size_t bytes) {
+	auto before = m_displayListMemory->getSize();
+	size_t freed = 0;
+	for (auto i : getEvictionOrder()) {
+		if (freed >= bytes)
+			break;
+		freed += m_bitmapbuffer[i]->m_displayListSize;
+		dropDisplayList(i);
+	}
+	reportMemory();
+	return before - min(m_displayListMemory->getSize(), before);
 }
 
+size_t RenderHandler::PDFBuilder::evictPages(size_t bytes) {
+	auto before = m_pageMemory->getSize();
+	size_t freed = 0;
+	for (auto i : getEvictionOrder()) {
+		if (freed >= bytes)
+			break;
+		freed += m_pdf->releasePage(i);
+	}
+	reportMemory();
+	return before - min(m_pageMemory->getSize(), before);
+}
 
-void RenderHandler::PDFBuilder::render() {
+void RenderHandler::PDFBuilder::render(bool renderMissing) {
+	static auto& bitmaphits = Metrics::counter("pdfbuilder.bitmap.hits");
+	static auto& bitmapmisses = Metrics::counter("pdfbuilder.bitmap.misses");
+	static auto& scaled = Metrics::counter("pdfbuilder.bitmap.scaled");
 	if (m_pdf == nullptr || m_rendercontext == nullptr)
 		return;
 	
 	m_rendercontext->beginDraw();
+	m_bitmapMemory->touch();
+	m_previewMemory->touch();
 
 	// let the pdfs start at 0, 0
 	m_rendercontext->setCurrentViewPortMatrixActive(); 
+	auto region = m_rendercontext->transformRectInv(m_rendercontext->getRenderRegion());
 	for (size_t i = m_startpagerender; i < m_endpagerender; i++) {
 		CachedPDFBitmap* pdf = m_bitmapbuffer[i];
+		if (!region.intersects(pdf->m_positionandsize))
+			continue;
 		auto& bitmap = pdf->m_bitmap;
 		auto& prevbitmap = pdf->m_previewbitmap;
 
+		// the coded pixels are shown even if they are for another scale, like the bitmap would have been
 		if (bitmap.m_bitmap == nullptr)
-			renderBitmap(i);
-		if (prevbitmap.m_bitmap == nullptr)
-			createPreviewBitmaps();
-
-		m_rendercontext->getRenderTarget()->DrawBitmap(prevbitmap.m_bitmap, pdf->m_positionandsize, 1, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, {0, 0, prevbitmap.m_bitmap->GetSize().width, prevbitmap.m_bitmap->GetSize().height});
-		if (m_rendercontext->getMatrixScaleOffset() > m_previewScale)
-			m_rendercontext->getRenderTarget()->DrawBitmap(bitmap.m_bitmap, pdf->m_intersectionWithViewPort, 1, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, {0, 0, bitmap.m_bitmap->GetSize().width, bitmap.m_bitmap->GetSize().height});
+			restoreBitmap(i);
+		if (bitmap.m_bitmap == nullptr) {
+			bitmapmisses.add();
+			if (renderMissing)
+				renderBitmap(i);
+		}
+		else {
+			bitmaphits.add();
+			scaled.add(!isEqual(pdf->m_scale, m_rendercontext->getMatrixScaleOffset()));
+		}
+		// the preview can still be rendered by the thumbnail service
+		if (prevbitmap.m_bitmap != nullptr)
+			m_rendercontext->getRenderTarget()->DrawBitmap(prevbitmap.m_bitmap, pdf->m_positionandsize, 1, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, {0, 0, prevbitmap.m_bitmap->GetSize().width, prevbitmap.m_bitmap->GetSize().height});
+		if (m_rendercontext->getMatrixScaleOffset() > m_previewScale && bitmap.m_bitmap != nullptr) {
+			// the bitmap can be larger than the visible part of the page. It is placed with the scale it was rendered with
+			// so a bitmap of another zoom level is stretched until it is replaced
+			auto pixelscale = getBitmapPixelScale(pdf);
+			auto& area = pdf->m_bitmapArea;
+			Rect2D<float> position(pdf->m_positionandsize.upperleft + area.upperleft / pixelscale, area.width / pixelscale, area.height / pixelscale);
+			m_rendercontext->getRenderTarget()->DrawBitmap(bitmap.m_bitmap, position, 1, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, {0, 0, bitmap.m_bitmap->GetSize().width, bitmap.m_bitmap->GetSize().height});
+		}
 	}
 
 	m_invalid = false;
@@ -159,15 +807,17 @@ void RenderHandler::PDFBuilder::renderpreview() {
 
 	// let the pdfs start at 0, 0
 	m_rendercontext->setCurrentViewPortMatrixActive();
+	auto region = m_rendercontext->transformRectInv(m_rendercontext->getRenderRegion());
 	for (size_t i = m_startpagerender; i < m_endpagerender; i++) {
 		CachedPDFBitmap* pdf = m_bitmapbuffer[i];
+		if (!region.intersects(pdf->m_positionandsize))
+			continue;
 		auto& bitmap = pdf->m_bitmap;
 		auto& prevbitmap = pdf->m_previewbitmap;
 
-		if (prevbitmap.m_bitmap == nullptr)
-			createPreviewBitmaps();
-
-		m_rendercontext->getRenderTarget()->DrawBitmap(prevbitmap.m_bitmap, pdf->m_positionandsize, 1, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, { 0, 0, prevbitmap.m_bitmap->GetSize().width, prevbitmap.m_bitmap->GetSize().height });
+		// the preview can still be rendered by the thumbnail service
+		if (prevbitmap.m_bitmap != nullptr)
+			m_rendercontext->getRenderTarget()->DrawBitmap(prevbitmap.m_bitmap, pdf->m_positionandsize, 1, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, { 0, 0, prevbitmap.m_bitmap->GetSize().width, prevbitmap.m_bitmap->GetSize().height });
 	}
 
 	m_invalid = false;
@@ -190,6 +840,133 @@ bool RenderHandler::PDFBuilder::isInvalid() const {
 	return m_invalid;
 }
 
+void RenderHandler::PDFBuilder::invalidatePage(size_t page) {
+	if (page >= m_bitmapbuffer.size())
+		return;
+	// the bitmap is created again the next time the page is drawn and the preview by the thumbnail service
+	auto bitmap = m_bitmapbuffer[page];
+	bitmap->m_bitmap = RenderHandler::Bitmap();
+	setEncoded(page, {});
+	bitmap->m_previewbitmap = RenderHandler::Bitmap();
+	bitmap->m_previewscale = 0;
+	m_thumbnails->clear(page);
+	m_cache->remove(page);
+	if (bitmap->m_previewWanted)
+		m_previewQueue.insert(m_previewQueue.begin(), page);
+	// the recording is outdated too. A refinement that is still running is ignored
+	dropDisplayList(page);
+	bitmap->m_refineJob = 0;
+	m_rendercontext->invalidate(bitmap->m_positionandsize);
+}
+
+void RenderHandler::PDFBuilder::markInteraction(bool cancel) {
+	auto now = Trace::now();
+	auto view = m_rendercontext->transformRectInv(Rect2D<float>(m_rendercontext->getDisplayViewport()));
+	Point2D<float> center = view.upperleft + Point2D<float>(view.width / 2, view.height / 2);
+	if (m_lastInteraction == 0 || now - m_lastInteraction > VELOCITY_TIMEOUT) {
+		m_velocity = { 0, 0 };
+	}
+	else if (now > m_lastInteraction) {
+		// smoothed because the wheel and the touch input move the view in steps
+		auto current = (center - m_lastViewCenter) * (1'000'000'000.0f / (now - m_lastInteraction));
+		m_velocity = m_velocity * 0.5f + current * 0.5f;
+	}
+	m_lastViewCenter = center;
+	m_lastInteraction = now;
+
+	if (m_worker == nullptr)
+		return;
+	// the refinements are for the old view and the prefetches behind the view aren't needed anymore
+	auto area = getPrefetchArea();
+	auto outdated = [&](size_t page) {
+		bool visible = page >= m_startpagerender && page < m_endpagerender;
+		return visible ? cancel : !area.intersects(m_bitmapbuffer[page]->m_positionandsize);
+	};
+	m_worker->cancel([&](const PDFHandler::RenderWorker::Job& job) { return outdated(job.m_page); });
+	for (size_t i = 0; i < m_bitmapbuffer.size(); i++) {
+		if (m_bitmapbuffer[i]->m_refineJob != 0 && outdated(i))
+			m_bitmapbuffer[i]->m_refineJob = 0;
+	}
+}
+
+bool RenderHandler::PDFBuilder::isInteracting() const {
+	return m_lastInteraction != 0 && Trace::now() - m_lastInteraction < REFINE_DELAY;
+}
+
+void RenderHandler::PDFBuilder::update() {
+	TRACE_SCOPE("PDFBuilder::update", "render");
+	static auto& uploads = Metrics::counter("pdfbuilder.preview.uploads");
+	if (m_worker == nullptr || m_thumbnails == nullptr)
+		return;
+
+	// the results that are finished after this are taken with the next update
+	m_resultsReady = false;
+	auto ctx = m_pdf->m_pdfcontext->getctx();
+	for (auto& thumbnail : m_thumbnails->takeResults()) {
+		auto bitmap = m_bitmapbuffer[thumbnail.m_page];
+		// the page could have left the budget since it was requested
+		if (bitmap->m_previewWanted && isEqual(thumbnail.m_dpi, m_rendercontext->getDpi() * m_previewRequestScale)) {
+			bitmap->m_previewbitmap = m_pdf->createBitmapFromPixmap(m_rendercontext, thumbnail.m_pixmap, thumbnail.m_dpi);
+			bitmap->m_previewscale = m_previewRequestScale;
+			uploads.add();
+			if (thumbnail.m_page >= m_startpagerender && thumbnail.m_page < m_endpagerender)
+				m_rendercontext->invalidate(bitmap->m_intersectionWithViewPort);
+		}
+		fz_drop_pixmap(ctx, thumbnail.m_pixmap);
+	}
+	// recording blocks this thread, so waiting input is handled first and the pages are recorded by a later update
+	bool inputPending = HIWORD(GetQueueStatus(QS_INPUT)) != 0;
+	requestPreviews(!inputPending);
+
+	for (auto& result : m_worker->takeResults()) {
+		auto bitmap = m_bitmapbuffer[result.m_page];
+		// The page could have changed since the job was started. If the view was zoomed the result is still used as
+		// long as it is closer to the current scale than the cached bitmap
+		bool empty = bitmap->m_bitmap.m_bitmap == nullptr && bitmap->m_encoded.empty();
+		bool closer = empty || getScaleDistance(bitmap->m_refineScale) <= getScaleDistance(bitmap->m_scale);
+		if (result.m_pixmap != nullptr && result.m_id == bitmap->m_refineJob && closer) {
+			bitmap->m_bitmap = m_pdf->createBitmapFromPixmap(m_rendercontext, result.m_pixmap, m_rendercontext->getDpi());
+			bitmap->m_bitmapArea = bitmap->m_refineArea;
+			bitmap->m_scale = bitmap->m_refineScale;
+			bitmap->m_draft = bitmap->m_refineDraft;
+			setEncoded(result.m_page, std::move(result.m_encoded));
+			// a prefetched page is drawn once it becomes visible
+			if (result.m_page >= m_startpagerender && result.m_page < m_endpagerender)
+				m_rendercontext->invalidate(bitmap->m_intersectionWithViewPort);
+		}
+		// the page is cached even if the view was zoomed since
+		if (result.m_pixmap != nullptr && result.m_id == bitmap->m_refineJob && bitmap->m_refineCache)
+			storeCachedPage(result.m_page, result.m_pixmap);
+		if (result.m_id == bitmap->m_refineJob)
+			bitmap->m_refineJob = 0;
+		fz_drop_pixmap(ctx, result.m_pixmap);
+	}
+
+	trimEncoded(ENCODED_BUDGET);
+	releaseOffscreenBitmaps();
+
+	if (!isInteracting())
+		refineDrafts();
+	else
+		prefetch();
+	reportMemory();
+}
+
+UINT64 RenderHandler::PDFBuilder::getUpdateTimeout() const {
+	// the finished bitmaps are uploaded and the rest of the previews is requested right away
+	if (m_resultsReady || !m_previewQueue.empty())
+		return 0;
+	// the worker wakes the window when it is done so only the start of the refinement needs a timeout
+	for (size_t i = m_startpagerender; i < m_endpagerender; i++) {
+		auto bitmap = m_bitmapbuffer[i];
+		if (bitmap->m_draft && bitmap->m_refineJob == 0) {
+			auto now = Trace::now();
+			return m_lastInteraction + REFINE_DELAY > now ? m_lastInteraction + REFINE_DELAY - now : 0;
+		}
+	}
+	return FrameScheduler::NO_TIMEOUT;
+}
+
 std::tuple<size_t, size_t> RenderHandler::PDFBuilder::getVisibleStartAndEndPage() const {
 	return std::tuple<size_t, size_t>(m_startpagerender, m_endpagerender);
 }
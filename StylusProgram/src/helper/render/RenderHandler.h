@@ -5,8 +5,12 @@
 #include <d2d1.h>
 #include <dwrite.h>
 #include <list>
+#include <atomic>
 
 #include "util/Util.h"
+#include "util/Metrics.h"
+#include "util/MemoryBudget.h"
+#include "util/FrameScheduler.h"
 #include "window/WindowHandler.h"
 #include "pdf/PDFHandler.h"
 
@@ -43,7 +47,15 @@ namespace RenderHandler {
 
 		void (*RenderCallbackFunction)(ID2D1HwndRenderTarget* const);
 
+		// decides when the invalidated parts are drawn
+		FrameScheduler m_frameScheduler;
+		// the part of the window that is currently drawn. The whole window if it isn't a partial render
+		Rect2D<float> m_renderRegion;
+		bool m_isPartialRender = false;
+
 		std::wstring m_debugString;
+		// is drawn above the debug text and replaced instead of appended
+		std::wstring m_debugSummary;
 		size_t m_maxDebugStringSize = 2500;
 		bool m_renderDebugInfo = true;
 
@@ -57,13 +69,27 @@ namespace RenderHandler {
 	public:
 
 		void render();
+		// only redraws the rects (in the space of the render target). Everything outside of them stays untouched
+		void render(const std::vector<Rect2D<float>>& region);
+		// marks the window as outdated. It is drawn with the next frame of the frame scheduler
+		void invalidate(UINT32 flags = FrameScheduler::FULL);
+		// only marks the rect (in document space) as outdated
+		void invalidate(const Rect2D<float>& rect);
+		// the part of the window that is drawn right now (in the space of the render target). The repaint callback
+		// can skip everything outside of it
+		Rect2D<float> getRenderRegion() const;
+		bool isPartialRender() const;
+		FrameScheduler& getFrameScheduler();
 		void resize(Rect2D<UINT> r);
 		void clearCanvas();
 
 		void beginDraw();
 		void endDraw();
 
+		// the window is invalidated so the text is drawn with the next frame. forceDraw repaints the window immediately
 		void addDebugText(const std::wstring& s, bool forceDraw = false);
+		// replaces the text above the debug messages (e.g. the metrics) and draws it with the next frame
+		void setDebugSummary(const std::wstring& s);
 
 		// Will always call this callback function when render() is called.
 		void addRepaintCallbackFunction(void (*fun)(ID2D1HwndRenderTarget* const));
@@ -79,6 +105,8 @@ namespace RenderHandler {
 		void addMatrixScaleOffset(float f, Point2D<float> center);
 
 		void setCurrentViewPortMatrixActive();
+		// the offset is applied before the viewport matrix. Can be used to draw things that are relative to a page
+		void setCurrentViewPortMatrixActive(Point2D<float> offset);
 		void setIdentityViewPortMatrixActive();
 
 		void resetMatrixOffsets();
@@ -136,12 +164,17 @@ namespace RenderHandler {
 
 	class StrokeBuilder {
 		PDFHandler::AnnotationHandler* m_annotationHandler = nullptr;
-		std::vector<std::tuple<Point2D<double>, Point2D<double>>> m_dynamicLines;
+		// start, end, width, when the pointer captured the end point (Trace::now) and where its latency is recorded
+		std::vector<std::tuple<Point2D<double>, Point2D<double>, float, UINT64, Metrics::Histogram*>> m_dynamicLines;
 	public:
 		StrokeBuilder() = default;
 		void renderAllStrokes();
+		// draws the new lines and records the time from capturing the points until they were presented
 		void renderDynamicLines();
-		void addDynamicLine(Point2D<double> p1, Point2D<double> p2);
+		void addDynamicLine(Point2D<double> p1, Point2D<double> p2, float width, UINT64 timestamp, Metrics::Histogram* latency = nullptr);
+		// if the last line that wasn't rendered yet ends at p1 it will be extended to p2. Otherwise a new line is added.
+		// An extended line keeps its timestamp because it has been waiting since then
+		void extendDynamicLine(Point2D<double> p1, Point2D<double> p2, float width, UINT64 timestamp, Metrics::Histogram* latency = nullptr);
 
 		/*
 		struct Stroke {
@@ -200,7 +233,7 @@ namespace RenderHandler {
 	};
 
 	class PDFBuilder {
-		size_t padding = 10;
+		float m_padding = 10;
 		Direct2DContext* m_rendercontext = nullptr;
 		PDFHandler::PDF* m_pdf = nullptr;
 
@@ -209,36 +242,166 @@ namespace RenderHandler {
 			Rect2D<float> m_positionandsize;
 			Rect2D<float> m_intersectionWithViewPort;
 			RenderHandler::Bitmap m_bitmap;
+			// the part of the page the bitmap shows in pixels of the bitmap relative to the page. The edges are
+			// whole pixels so the bitmaps of the same scale can be stitched together
+			Rect2D<float> m_bitmapArea;
+			// the bitmap was rendered with less quality while the view was moving
+			bool m_draft = false;
+			// the pixels of the bitmap coded with PixelCodec. They stay when the bitmap is released off screen and the
+			// area, scale and draft describe them until it is restored. Empty if they couldn't be coded, then the bitmap
+			// is rendered again after it was released
+			std::vector<byte> m_encoded;
 
 			float m_previewscale = 0;
 			RenderHandler::Bitmap m_previewbitmap;
+			// the preview is in the pixel budget. Otherwise it is only kept deflated by the thumbnail service
+			bool m_previewWanted = false;
+
+			// the recorded page for the render worker. Is created the first time the page is refined
+			fz_display_list* m_displayList = nullptr;
+			// the memory mupdf needed to record the list
+			size_t m_displayListSize = 0;
+			// the job that refines the draft. 0 if there is none
+			UINT64 m_refineJob = 0;
+			Rect2D<float> m_refineArea;
+			float m_refineScale = 1;
+			bool m_refineDraft = false;
+			// the result of the job is written to the render cache
+			bool m_refineCache = false;
 		};
 		std::vector<CachedPDFBitmap*> m_bitmapbuffer;
+		// the bytes of all coded bitmaps
+		size_t m_encodedSize = 0;
+
+		// the parts of the memory budget. Everything that isn't visible can be given back
+		MemoryBudget::Cache* m_bitmapMemory = nullptr;
+		MemoryBudget::Cache* m_encodedMemory = nullptr;
+		MemoryBudget::Cache* m_previewMemory = nullptr;
+		MemoryBudget::Cache* m_displayListMemory = nullptr;
+		MemoryBudget::Cache* m_pageMemory = nullptr;
 
 		size_t m_startpagerender = 0;
 		size_t m_endpagerender = 1;
 
-		size_t m_previewPages = 10;
 		float m_previewScale = 0.5;
+		// renders the previews in the background
+		PDFHandler::ThumbnailService* m_thumbnails = nullptr;
+		// the previews and the pages of the first view from the last time the document was opened
+		PDFHandler::RenderCache* m_cache = nullptr;
+		// the previews that still have to be requested from the thumbnail service, the most important one first
+		std::vector<size_t> m_previewQueue;
+		// the scale of the previews that are requested
+		float m_previewRequestScale = 0.5;
 
 		size_t m_currentPage = 0;
 
 		bool m_invalid = true;
+
+		// renders the full quality bitmaps in the background after the view stopped moving
+		PDFHandler::RenderWorker* m_worker = nullptr;
+		UINT64 m_nextRefineJob = 1;
+		// when the view was moved the last time (Trace::now)
+		UINT64 m_lastInteraction = 0;
+		// the render worker or the thumbnail service finished something that update hasn't taken yet
+		std::atomic<bool> m_resultsReady = false;
+		// how fast the view moves in document units per second. Used to prefetch the pages it will reach
+		Point2D<float> m_velocity = { 0, 0 };
+		Point2D<float> m_lastViewCenter = { 0, 0 };
+
+		// the pixels per pdf unit of the bitmaps. Drafts have less pixels
+		float getPixelScale(bool draft = false) const;
+		float getBitmapPixelScale(const CachedPDFBitmap* bitmap) const;
+		// the smallest pixel area of the page that covers the rect (relative to the page)
+		Rect2D<float> getPixelArea(size_t page, Rect2D<float> rect, float pixelscale) const;
+		// the rects createBitmapFromPage needs so mupdf creates exactly the pixels of the area
+		void getRenderRects(Rect2D<float> area, float pixelscale, Rect2D<float>& destination, Rect2D<float>& source) const;
+		// renders the pixels of the area of the page. The pixmap has to be dropped
+		fz_pixmap* renderPixmap(size_t page, Rect2D<float> area, float pixelscale, bool draft = false);
+		// renders the pixel area of the page. The pixels are coded into encoded if it isn't null
+		RenderHandler::Bitmap renderPixelArea(size_t page, Rect2D<float> area, float pixelscale, bool draft = false, std::vector<byte>* encoded = nullptr);
+		// sends the visible drafts to the render worker
+		void refineDrafts();
+		// Shows the visible pages from the render cache. The pages that aren't cached are rendered again in the
+		// background and written to the cache so they are there the next time the document is opened
+		void loadCachedPages();
+		// writes a page that was rendered as a whole to the render cache
+		void storeCachedPage(size_t page, fz_pixmap* pix);
+		// passes the queued previews to the thumbnail service. A page without a display list stays queued unless record
+		// is set, then at most one is recorded so the thread that renders isn't blocked for long. Only update records
+		// and only if there is no input waiting
+		void requestPreviews(bool record);
+		// sends the pixel area of the page to the render worker
+		void renderPixelAreaInBackground(size_t page, Rect2D<float> area, bool draft);
+		// how far the scale is from the scale of the view. 1 if it is the same, larger the further it is away
+		float getScaleDistance(float scale) const;
+		// the bitmap of the page has the scale of the view and covers the rect (in document space)
+		bool isBitmapCurrent(size_t page, Rect2D<float> rect) const;
+		// the part of the document the view will move over within PREFETCH_TIME at the current velocity. Contains
+		// the viewport but nothing behind it
+		Rect2D<float> getPrefetchArea() const;
+		// sends the pages outside of the viewport that are in the prefetch area to the render worker
+		void prefetch();
+		// replaces the coded pixels of the page and keeps m_encodedSize up to date
+		void setEncoded(size_t page, std::vector<byte> encoded);
+		// creates the bitmap of the page from its coded pixels. False if there are none
+		bool restoreBitmap(size_t page);
+		// throws away the bitmaps of the pages that aren't visible. The pages the view moves to are kept
+		void releaseOffscreenBitmaps();
+		// throws away the coded pixels of the pages furthest from the view until they fit into the budget
+		void trimEncoded(size_t budget);
+		// records the display list of the page if it doesn't have one
+		void createDisplayList(size_t page);
+		void dropDisplayList(size_t page);
+		// the pages that aren't visible, the one furthest from the view first. The caches give back their memory in
+		// this order
+		std::vector<size_t> getEvictionOrder() const;
+		// sets the sizes of the caches in the memory budget
+		void reportMemory();
+		// called by the memory budget. They free about the bytes and return how many were freed
+		size_t evictBitmaps(size_t bytes);
+		size_t evictPreviews(size_t bytes);
+		size_t evictDisplayLists(size_t bytes);
+		size_t evictPages(size_t bytes);
 	public:
+		// the view has to be idle for this long (in ns) before the drafts are refined
+		static constexpr UINT64 REFINE_DELAY = 150'000'000;
+		// the resolution of a draft compared to a full quality bitmap
+		static constexpr float DRAFT_RESOLUTION = 0.5f;
+		// the pixels of all previews that are kept as bitmaps. About 20 letter sized pages at the default scale
+		static constexpr UINT64 PREVIEW_PIXEL_BUDGET = 4'500'000;
+		// while the view moves only this many pages behind it get a preview, the budget is used for the pages ahead
+		static constexpr size_t PREVIEW_PAGES_BEHIND = 2;
+		// how far ahead (in ns) the pages are prefetched. The faster the view moves the more pages are prefetched
+		static constexpr UINT64 PREFETCH_TIME = 500'000'000;
+		// interactions that are further apart (in ns) don't belong to the same movement
+		static constexpr UINT64 VELOCITY_TIMEOUT = 200'000'000;
+		// the memory (in bytes) of the coded bitmaps. Text pages shrink to about a tenth so this holds several
+		// hundred megabytes of pixels
+		static constexpr size_t ENCODED_BUDGET = 64 * 1024 * 1024;
+
 		//constructor
 		PDFBuilder(Direct2DContext* context, PDFHandler::PDF* pdf);
 		~PDFBuilder();
 
+		// will position all pages below each other. Strokes are relative to the pages so they dont have to be touched
+		void calculatePageLayout();
+
 		// will calculate the out of bounds pdf 
 		void calculateOutOfBoundsPDF(); 
-		// will render a lower resolution pdf onto a bitmap and save it in a buffer
+		// Chooses the previews that fit into PREVIEW_PIXEL_BUDGET, the visible pages and then the ones closest to the
+		// view, and requests the missing ones from the thumbnail service. Doesn't render anything itself, the previews
+		// are uploaded by update
 		void createPreviewBitmaps(float scale = 0.5);
 		// Will retrieve the current viewport and render the pdf onto a cached bitmap.
 		void renderBitmap();
 		// Will render a given page
 		void renderBitmap(size_t page, bool viewportintersection = true);
-		// Will render all visible pages
-		void render();
+		// Same as renderBitmap but the missing or outdated bitmaps are rendered as drafts by the render worker.
+		// Until they are replaced the cached bitmaps are drawn scaled to the view
+		void renderBitmapInBackground();
+		// Will render all visible pages. Without renderMissing only the cached bitmaps are drawn, even if they were
+		// rendered for another scale
+		void render(bool renderMissing = true);
 		// Will render a low res version of the pages definded by the scale given into the createPreviewBitmaps method
 		void renderpreview();
 
@@ -247,9 +410,26 @@ namespace RenderHandler {
 
 		void invalidate();
 		bool isInvalid() const;
+		// throws away the rendered bitmaps of the page and redraws its area. Has to be called if the content of
+		// the page changed
+		void invalidatePage(size_t page);
 
 		std::tuple<size_t, size_t> getVisibleStartAndEndPage() const;
 
+		// Has to be called whenever the view moved. The pages are rendered as drafts until the view was idle for
+		// REFINE_DELAY. With cancel the running refinements are stopped because they are for the old view. The
+		// prefetches that are behind the new direction are always stopped
+		void markInteraction(bool cancel = true);
+		bool isInteracting() const;
+		// uploads the bitmaps the render worker and the thumbnail service finished, prefetches the pages ahead while the view moves and starts
+		// refining the drafts once the view is idle. The bitmaps that went off screen are released and only kept
+		// coded. The memory of the caches is reported to the memory budget. Has to be called from the thread that
+		// renders when getUpdateTimeout is 0 or before a frame is drawn
+		void update();
+		// the time in ns until update has to be called again. 0 if there are results to take and
+		// FrameScheduler::NO_TIMEOUT if there is nothing to do
+		UINT64 getUpdateTimeout() const;
+
 		friend PDFHandler::AnnotationHandler;
 	};
 
@@ -4,13 +4,21 @@
 
 
 void RenderHandler::StrokeBuilder::renderAllStrokes() {
+	TRACE_SCOPE("renderAllStrokes", "render");
 	auto startAndEndpage = m_annotationHandler->m_pdfbuilder->getVisibleStartAndEndPage();
 	auto context = m_annotationHandler->getContext();
+	// only the strokes that reach into the drawn part of the window
+	auto region = context->transformRectInv(context->getRenderRegion());
 	context->beginDraw();
-	context->setCurrentViewPortMatrixActive();
 	for (size_t i = std::get<0>(startAndEndpage); i < std::get<1>(startAndEndpage); i++) {
+		if (!region.intersects(m_annotationHandler->m_pdfbuilder->getSizeAndPositionOfPage(i)))
+			continue;
+		// the strokes are relative to the page
+		context->setCurrentViewPortMatrixActive(m_annotationHandler->m_pdfbuilder->getSizeAndPositionOfPage(i).upperleft);
 		for (auto& ink : *(m_annotationHandler->m_inkstrokes[i])) {
-			context->getRenderTarget()->DrawGeometry(ink.m_bezierCurveGeometry, ink.m_strokeBrush, ink.m_strokeWidth, ink.m_strokeStyle);			
+			if (context->isPartialRender() && !region.intersects(m_annotationHandler->getStrokeArea(i, ink)))
+				continue;
+			context->getRenderTarget()->FillGeometry(ink.m_outlineGeometry, ink.m_strokeBrush);
 		}
 	}
 
@@ -18,6 +26,7 @@ void RenderHandler::StrokeBuilder::renderAllStrokes() {
 }
 
 void RenderHandler::StrokeBuilder::renderDynamicLines() {
+	TRACE_SCOPE("renderDynamicLines", "render");
 	if (m_dynamicLines.size() == 0)
 		return;
 	auto context = m_annotationHandler->getContext();
@@ -25,14 +34,37 @@ void RenderHandler::StrokeBuilder::renderDynamicLines() {
 	context->setCurrentViewPortMatrixActive();
 	auto hwndtarget = context->m_hwndRendertarget;
 	for (auto& l : m_dynamicLines) {
-		hwndtarget->DrawLine(std::get<0>(l), std::get<1>(l), m_annotationHandler->m_currentInkBrush, m_annotationHandler->m_currentStrokeWidht);
+		hwndtarget->DrawLine(std::get<0>(l), std::get<1>(l), m_annotationHandler->m_currentInkBrush, std::get<2>(l), m_annotationHandler->m_currentLineStyle);
 	}
-	m_dynamicLines.clear();
 	context->endDraw();
+
+	// the time from capturing the point until the line is on the screen
+	auto presented = Trace::now();
+	for (auto& l : m_dynamicLines) {
+		auto latency = std::get<4>(l);
+		if (latency != nullptr && presented > std::get<3>(l))
+			latency->record((presented - std::get<3>(l)) / 1000);
+	}
+	m_dynamicLines.clear();
+}
+
+void RenderHandler::StrokeBuilder::addDynamicLine(Point2D<double> p1, Point2D<double> p2, float width, UINT64 timestamp, Metrics::Histogram* latency) {
+	m_dynamicLines.push_back(std::make_tuple(p1, p2, width, timestamp, latency)); 
+	m_annotationHandler->getContext()->invalidate(FrameScheduler::INK);
 }
 
-void RenderHandler::StrokeBuilder::addDynamicLine(Point2D<double> p1, Point2D<double> p2) {
-	m_dynamicLines.push_back(std::make_tuple(p1, p2)); 
+void RenderHandler::StrokeBuilder::extendDynamicLine(Point2D<double> p1, Point2D<double> p2, float width, UINT64 timestamp, Metrics::Histogram* latency) {
+	if (m_dynamicLines.size() != 0) {
+		auto& line = m_dynamicLines.back();
+		auto& end = std::get<1>(line);
+		if (isEqual(end.x, p1.x) && isEqual(end.y, p1.y)) {
+			end = p2;
+			std::get<2>(line) = max(std::get<2>(line), width);
+			m_annotationHandler->getContext()->invalidate(FrameScheduler::INK);
+			return;
+		}
+	}
+	addDynamicLine(p1, p2, width, timestamp, latency);
 }
 
 /*
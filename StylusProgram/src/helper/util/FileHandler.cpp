@@ -33,6 +33,51 @@ FileHandler::File::~File() {
 	delete[] data;
 }
 
+FileHandler::MappedFile::MappedFile(MappedFile&& f) {
+	data = f.data;
+	size = f.size;
+	m_file = f.m_file;
+	m_mapping = f.m_mapping;
+
+	f.data = nullptr;
+	f.size = 0;
+	f.m_file = INVALID_HANDLE_VALUE;
+	f.m_mapping = NULL;
+}
+
+FileHandler::MappedFile& FileHandler::MappedFile::operator=(MappedFile&& f) {
+	close();
+
+	data = f.data;
+	size = f.size;
+	m_file = f.m_file;
+	m_mapping = f.m_mapping;
+
+	f.data = nullptr;
+	f.size = 0;
+	f.m_file = INVALID_HANDLE_VALUE;
+	f.m_mapping = NULL;
+	return *this;
+}
+
+FileHandler::MappedFile::~MappedFile() {
+	close();
+}
+
+void FileHandler::MappedFile::close() {
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+
+	data = nullptr;
+	size = 0;
+	m_mapping = NULL;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
 
 FileHandler::File FileHandler::openFile(const std::wstring& s) {
 	// open file using CreateFileW from the win32 api
@@ -64,6 +109,36 @@ FileHandler::File FileHandler::openFile(const std::wstring& s) {
 	return std::move(file);
 }
 
+FileHandler::MappedFile FileHandler::mapFile(const std::wstring& s) {
+	MappedFile file;
+	file.m_file = CreateFileW(s.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file.m_file == INVALID_HANDLE_VALUE) {
+		Logger::add(L"Failed to open file: " + s, LOGGER_TYPE::ERROR);
+		return MappedFile();
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file.m_file, &fileSize) || fileSize.QuadPart == 0) {
+		Logger::add(L"Failed to get file size: " + s, LOGGER_TYPE::ERROR);
+		return MappedFile();
+	}
+
+	file.m_mapping = CreateFileMappingW(file.m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (file.m_mapping == NULL) {
+		Logger::add(L"Failed to map file: " + s, LOGGER_TYPE::ERROR);
+		return MappedFile();
+	}
+
+	file.data = (const byte*)MapViewOfFile(file.m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (file.data == nullptr) {
+		Logger::add(L"Failed to map file: " + s, LOGGER_TYPE::ERROR);
+		return MappedFile();
+	}
+	file.size = (size_t)fileSize.QuadPart;
+
+	return file;
+}
+
 void FileHandler::saveFile(const std::wstring& s, const File& f) {
 	// open file using CreateFileW from the win32 api
 	HANDLE hFile = CreateFileW(s.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -88,3 +163,20 @@ void FileHandler::saveFile(const std::wstring& s, byte* data, size_t size) {
 	saveFile(s, f);
 	f.data = nullptr;
 }
+
+UINT64 FileHandler::hashData(const byte* data, size_t size) {
+	constexpr UINT64 prime = 1099511628211ull;
+	UINT64 hash = 14695981039346656037ull;
+
+	size_t i = 0;
+	for (; i + sizeof(UINT64) <= size; i += sizeof(UINT64)) {
+		UINT64 word;
+		memcpy(&word, data + i, sizeof(UINT64));
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < size; i++) {
+		hash = (hash ^ data[i]) * prime;
+	}
+	// so files that only differ in trailing zeros don't collide
+	return (hash ^ size) * prime;
+}
@@ -19,9 +19,31 @@ namespace FileHandler {
 		~File();
 	};
 
+	// read only view of a file that is mapped into memory. The file can't be overwritten while it is mapped
+	struct MappedFile {
+		const byte* data = nullptr;
+		size_t size = 0;
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = NULL;
+
+		MappedFile() = default;
+		MappedFile(const MappedFile& f) = delete;
+		MappedFile& operator=(const MappedFile& f) = delete;
+		MappedFile(MappedFile&& f);
+		MappedFile& operator=(MappedFile&& f);
+		~MappedFile();
+
+		// unmaps the file. Every pointer into the data is invalid afterwards
+		void close();
+	};
+
 	File openFile(const std::wstring& s);
+	MappedFile mapFile(const std::wstring& s);
 	void saveFile(const std::wstring& s, const File& f);
 	void saveFile(const std::wstring& s, byte* data, size_t size);
+
+	// fast non cryptographic hash (FNV-1a on 8 byte words) to check if a file has changed
+	UINT64 hashData(const byte* data, size_t size);
 }
 
 #endif // !FILE_HANDLER_H
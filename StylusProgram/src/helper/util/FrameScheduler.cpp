@@ -0,0 +1,107 @@
+#include "FrameScheduler.h"
+
+FrameScheduler::FrameScheduler(Clock clock) {
+	m_clock = clock;
+}
+
+UINT64 FrameScheduler::getDueTime() const {
+	// never more than one frame per refresh. The first frame is always due
+	if (m_lastFrame == 0)
+		return m_firstInvalidation;
+	return max(m_firstInvalidation, m_lastFrame + m_refreshInterval);
+}
+
+void FrameScheduler::invalidate(UINT32 flags) {
+	if (flags == NOTHING)
+		return;
+	m_invalidations++;
+	if (m_pending == NOTHING)
+		m_firstInvalidation = m_clock();
+	m_pending |= flags;
+}
+
+void FrameScheduler::invalidate(const Rect2D<float>& rect) {
+	if (rect.width <= 0 || rect.height <= 0)
+		return;
+	invalidate(REGION);
+	// the whole window is drawn anyway
+	if (m_pending & FULL)
+		return;
+
+	// merge the rect with all rects it touches. The merged rect can touch more rects so repeat until nothing changes
+	auto merged = rect;
+	for (size_t i = 0; i < m_dirtyRects.size();) {
+		if (!merged.intersects(m_dirtyRects[i])) {
+			i++;
+			continue;
+		}
+		merged = merged.merge(m_dirtyRects[i]);
+		m_dirtyRects[i] = m_dirtyRects.back();
+		m_dirtyRects.pop_back();
+		i = 0;
+	}
+	m_dirtyRects.push_back(merged);
+
+	// many small rects cost more than drawing the area around them once
+	if (m_dirtyRects.size() > MAX_DIRTY_RECTS) {
+		for (size_t i = 1; i < m_dirtyRects.size(); i++)
+			m_dirtyRects[0] = m_dirtyRects[0].merge(m_dirtyRects[i]);
+		m_dirtyRects.resize(1);
+	}
+}
+
+UINT64 FrameScheduler::getTimeout() const {
+	if (m_pending == NOTHING)
+		return NO_TIMEOUT;
+	auto due = getDueTime();
+	auto now = m_clock();
+	return due > now ? due - now : 0;
+}
+
+UINT32 FrameScheduler::beginFrame() {
+	if (m_pending == NOTHING)
+		return NOTHING;
+	auto now = m_clock();
+	if (getDueTime() > now)
+		return NOTHING;
+
+	auto flags = m_pending;
+	// a full frame draws the dirty rects too
+	if (flags & FULL)
+		flags &= ~REGION;
+	m_frameRects.clear();
+	if (flags & REGION)
+		m_frameRects.swap(m_dirtyRects);
+	m_dirtyRects.clear();
+
+	m_lastFrameDelay = now - m_firstInvalidation;
+	m_lastFrame = now;
+	m_pending = NOTHING;
+	m_firstInvalidation = 0;
+	m_frames++;
+	return flags;
+}
+
+UINT64 FrameScheduler::getFrameDelay() const {
+	return m_lastFrameDelay;
+}
+
+const std::vector<Rect2D<float>>& FrameScheduler::getDirtyRects() const {
+	return m_frameRects;
+}
+
+void FrameScheduler::setRefreshInterval(UINT64 ns) {
+	m_refreshInterval = ns;
+}
+
+UINT64 FrameScheduler::getRefreshInterval() const {
+	return m_refreshInterval;
+}
+
+UINT64 FrameScheduler::getFrameCount() const {
+	return m_frames;
+}
+
+UINT64 FrameScheduler::getInvalidationCount() const {
+	return m_invalidations;
+}
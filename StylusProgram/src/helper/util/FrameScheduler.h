@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include "Util.h"
+
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+// Collects the invalidations of the program and decides when the next frame is drawn. All invalidations between
+// two frames are merged into one frame and there is at most one frame per display refresh. If the last frame is
+// older than one refresh interval the next one is due immediately, so new ink is drawn as soon as it arrives.
+// The clock can be replaced so the scheduling can be simulated without a window (see tools/replay)
+class FrameScheduler {
+public:
+	// what has to be redrawn. The flags of all invalidations until the next frame are combined
+	enum INVALIDATION : UINT32 {
+		NOTHING = 0,
+		// only the new lines of the strokes in progress
+		INK = 1 << 0,
+		// the whole window, e.g. after scrolling or zooming
+		FULL = 1 << 1,
+		// only the dirty rects, e.g. after erasing a stroke
+		REGION = 1 << 2
+	};
+
+	// returns the time in ns. Has to be monotonic and never 0
+	using Clock = UINT64(*)();
+
+	// returned by getTimeout if nothing is invalidated
+	static constexpr UINT64 NO_TIMEOUT = ~(UINT64)0;
+	// 60 Hz
+	static constexpr UINT64 DEFAULT_REFRESH_INTERVAL = 16'666'667;
+	// if there are more dirty rects they are merged into one
+	static constexpr size_t MAX_DIRTY_RECTS = 8;
+
+private:
+	Clock m_clock;
+	UINT64 m_refreshInterval = DEFAULT_REFRESH_INTERVAL;
+
+	UINT32 m_pending = NOTHING;
+	// when the first invalidation since the last frame happened. Is 0 if nothing is pending
+	UINT64 m_firstInvalidation = 0;
+	// when the last frame started. Is 0 before the first frame
+	UINT64 m_lastFrame = 0;
+	UINT64 m_lastFrameDelay = 0;
+
+	// the dirty rects that weren't drawn yet and the ones of the current frame
+	std::vector<Rect2D<float>> m_dirtyRects;
+	std::vector<Rect2D<float>> m_frameRects;
+
+	UINT64 m_frames = 0;
+	UINT64 m_invalidations = 0;
+
+	UINT64 getDueTime() const;
+public:
+	FrameScheduler(Clock clock);
+
+	void invalidate(UINT32 flags);
+	// Marks a part of the window as dirty. Overlapping rects are merged. The rect is in the space of the
+	// render target
+	void invalidate(const Rect2D<float>& rect);
+
+	// the time in ns until the next frame is due. 0 if it is due now and NO_TIMEOUT if nothing has to be drawn
+	UINT64 getTimeout() const;
+
+	// If a frame is due the pending flags are returned and reset, otherwise NOTHING is returned.
+	// The caller has to draw everything the flags say
+	UINT32 beginFrame();
+
+	// the time between the first invalidation and the start of the frame that drew it. Only valid directly
+	// after beginFrame returned a frame
+	UINT64 getFrameDelay() const;
+	// the parts that have to be drawn if the frame has the REGION flag. Only valid directly after beginFrame
+	const std::vector<Rect2D<float>>& getDirtyRects() const;
+
+	// the interval of the display. 0 disables the limit
+	void setRefreshInterval(UINT64 ns);
+	UINT64 getRefreshInterval() const;
+
+	// the amount of frames that were started
+	UINT64 getFrameCount() const;
+	// the amount of invalidations. Each frame merges all invalidations since the last one
+	UINT64 getInvalidationCount() const;
+};
+
+#endif // !FRAME_SCHEDULER_H
@@ -0,0 +1,120 @@
+#include "InputRecording.h"
+#include <cstring>
+#include <cstdint>
+
+static_assert(sizeof(InputRecording::Header) == 16, "The header is written directly into the file");
+static_assert(sizeof(InputRecording::Page) == 16, "The pages are written directly into the file");
+static_assert(sizeof(InputRecording::Event) == 24, "The events are written directly into the file");
+
+template <typename T>
+static void append(std::vector<byte>& data, const T& value) {
+	auto p = reinterpret_cast<const byte*>(&value);
+	data.insert(data.end(), p, p + sizeof(T));
+}
+
+void InputRecording::Recorder::addEvent(Event e, UINT64 timestamp) {
+	// the capture time of a pointer can be older than the last key event. The order of the events is what matters
+	if (timestamp > m_lastTimestamp) {
+		e.m_delta = (UINT32)min((timestamp - m_lastTimestamp) / 1000, (UINT64)UINT32_MAX);
+		m_lastTimestamp = timestamp;
+	}
+	append(m_data, e);
+}
+
+void InputRecording::Recorder::start(float dpiScale, const std::vector<Rect2D<float>>& pages, UINT64 timestamp) {
+	m_data.clear();
+	m_recording = true;
+	m_lastTimestamp = timestamp;
+	m_viewScale = 0;
+
+	Header h;
+	h.m_dpiScale = dpiScale;
+	h.m_pageCount = (UINT32)pages.size();
+	append(m_data, h);
+	for (auto& r : pages)
+		append(m_data, Page{ r.upperleft.x, r.upperleft.y, r.width, r.height });
+}
+
+std::vector<byte> InputRecording::Recorder::stop() {
+	m_recording = false;
+	return std::move(m_data);
+}
+
+bool InputRecording::Recorder::isRecording() const {
+	return m_recording;
+}
+
+void InputRecording::Recorder::addPointer(EVENT_TYPE type, UINT32 id, byte pointerType, byte buttons, Point2D<float> pos, UINT32 pressure, UINT64 timestamp) {
+	if (!m_recording)
+		return;
+	Event e;
+	e.m_type = type;
+	e.m_id = id;
+	e.m_pointerType = pointerType;
+	e.m_buttons = buttons;
+	e.m_x = pos.x;
+	e.m_y = pos.y;
+	e.m_value = (float)pressure;
+	addEvent(e, timestamp);
+}
+
+void InputRecording::Recorder::addKey(EVENT_TYPE type, UINT32 key, UINT64 timestamp) {
+	if (!m_recording)
+		return;
+	Event e;
+	e.m_type = type;
+	e.m_id = key;
+	addEvent(e, timestamp);
+}
+
+void InputRecording::Recorder::setView(float scale, Point2D<float> translation, UINT64 timestamp) {
+	if (!m_recording)
+		return;
+	if (scale == m_viewScale && translation.x == m_viewTranslation.x && translation.y == m_viewTranslation.y)
+		return;
+	m_viewScale = scale;
+	m_viewTranslation = translation;
+
+	Event e;
+	e.m_type = VIEW;
+	e.m_x = translation.x;
+	e.m_y = translation.y;
+	e.m_value = scale;
+	addEvent(e, timestamp);
+}
+
+size_t InputRecording::Recorder::getEventCount() const {
+	if (m_data.size() < sizeof(Header))
+		return 0;
+	Header h;
+	std::memcpy(&h, m_data.data(), sizeof(Header));
+	return (m_data.size() - sizeof(Header) - h.m_pageCount * sizeof(Page)) / sizeof(Event);
+}
+
+bool InputRecording::parse(const byte* data, size_t size, Recording& out) {
+	if (data == nullptr || size < sizeof(Header))
+		return false;
+
+	std::memcpy(&out.m_header, data, sizeof(Header));
+	if (std::memcmp(out.m_header.m_magic, MAGIC, sizeof(MAGIC)) != 0 || out.m_header.m_version != VERSION)
+		return false;
+
+	size_t offset = sizeof(Header);
+	if ((size - offset) / sizeof(Page) < out.m_header.m_pageCount)
+		return false;
+
+	out.m_pages.clear();
+	out.m_pages.reserve(out.m_header.m_pageCount);
+	for (UINT32 i = 0; i < out.m_header.m_pageCount; i++) {
+		Page p;
+		std::memcpy(&p, data + offset, sizeof(Page));
+		offset += sizeof(Page);
+		out.m_pages.push_back(Rect2D<float>({ p.m_x, p.m_y }, p.m_width, p.m_height));
+	}
+
+	// a recording that was cut off keeps every complete event
+	out.m_events.resize((size - offset) / sizeof(Event));
+	if (out.m_events.size() != 0)
+		std::memcpy(out.m_events.data(), data + offset, out.m_events.size() * sizeof(Event));
+	return true;
+}
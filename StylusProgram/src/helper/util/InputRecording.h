@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include "Util.h"
+
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+// Compact binary recording of the pointer and key input of a session. It doesn't depend on windows
+// so a recording can be replayed headless (tools/replay).
+// File layout: [Header][Rect page * pageCount][Event * n]
+namespace InputRecording {
+	constexpr char MAGIC[4] = { 'S', 'P', 'I', 'R' };
+	constexpr UINT32 VERSION = 1;
+
+	enum EVENT_TYPE : byte {
+		POINTER_DOWN,
+		POINTER_MOVE,
+		POINTER_UP,
+		KEY_DOWN,
+		KEY_UP,
+		// the view transform changed. Only recorded before a pointer event
+		VIEW
+	};
+
+	struct Header {
+		char m_magic[4] = { MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3] };
+		UINT32 m_version = VERSION;
+		// converts dips into pixels
+		float m_dpiScale = 1;
+		UINT32 m_pageCount = 0;
+	};
+
+	// position and size of a page in document space
+	struct Page {
+		float m_x = 0;
+		float m_y = 0;
+		float m_width = 0;
+		float m_height = 0;
+	};
+
+	struct Event {
+		// microseconds since the last event. The pointer events use the capture timestamp
+		UINT32 m_delta = 0;
+		EVENT_TYPE m_type = POINTER_MOVE;
+		// WindowHandler::POINTER_TYPE
+		byte m_pointerType = 0;
+		// bit 0 - 4 are the buttons 1 - 5
+		byte m_buttons = 0;
+		byte m_reserved = 0;
+		// pointer id or WindowHandler::VK
+		UINT32 m_id = 0;
+		// pointer position in window dips or the translation of the view
+		float m_x = 0;
+		float m_y = 0;
+		// raw pressure of the pointer or the scale of the view
+		float m_value = 0;
+	};
+
+	// Collects the events in memory. A ten minute session with a 240 Hz pen is about 3.5 MB
+	class Recorder {
+		std::vector<byte> m_data;
+		bool m_recording = false;
+		UINT64 m_lastTimestamp = 0;
+		// the last recorded view so it's only written if it changes
+		float m_viewScale = 0;
+		Point2D<float> m_viewTranslation;
+
+		void addEvent(Event e, UINT64 timestamp);
+	public:
+		// the timestamps are in nanoseconds (Trace::now)
+		void start(float dpiScale, const std::vector<Rect2D<float>>& pages, UINT64 timestamp);
+		// returns the recording and clears the recorder
+		std::vector<byte> stop();
+		bool isRecording() const;
+
+		void addPointer(EVENT_TYPE type, UINT32 id, byte pointerType, byte buttons, Point2D<float> pos, UINT32 pressure, UINT64 timestamp);
+		void addKey(EVENT_TYPE type, UINT32 key, UINT64 timestamp);
+		// the view maps document space to window space: window = document * scale + translation
+		void setView(float scale, Point2D<float> translation, UINT64 timestamp);
+
+		size_t getEventCount() const;
+	};
+
+	struct Recording {
+		Header m_header;
+		std::vector<Rect2D<float>> m_pages;
+		std::vector<Event> m_events;
+	};
+
+	// returns false if the data isn't a valid recording
+	bool parse(const byte* data, size_t size, Recording& out);
+}
+
+#endif // !INPUT_RECORDING_H
@@ -0,0 +1,94 @@
+#include "LogFile.h"
+#include <iostream>
+
+LogFile::LogFile(const std::filesystem::path& path, Settings settings) : m_path(path), m_settings(settings) {}
+
+LogFile::~LogFile() {
+	close();
+}
+
+bool LogFile::open() {
+	if (m_file.is_open())
+		return true;
+	if (m_failed)
+		return false;
+
+	m_file.open(m_path, std::ios::binary | std::ios::app);
+	if (!m_file.is_open()) {
+		m_failed = true;
+		std::wcerr << L"Couldn't open the log file " << m_path.wstring() << L"\n";
+		return false;
+	}
+
+	std::error_code error;
+	auto size = std::filesystem::file_size(m_path, error);
+	m_fileSize = error ? 0 : (UINT64)size;
+	return true;
+}
+
+void LogFile::rotate() {
+	m_file.close();
+	// the oldest file is overwritten
+	for (size_t i = m_settings.m_maxFiles - 1; i > 0; i--) {
+		std::error_code error;
+		if (std::filesystem::exists(getPath(i - 1), error))
+			std::filesystem::rename(getPath(i - 1), getPath(i), error);
+	}
+	// with only one file the old messages are dropped
+	if (m_settings.m_maxFiles <= 1) {
+		std::error_code error;
+		std::filesystem::remove(m_path, error);
+	}
+	open();
+}
+
+void LogFile::write(const std::string& line, UINT64 time, bool urgent) {
+	m_buffer.append(line);
+	if (urgent || m_buffer.size() >= m_settings.m_bufferSize)
+		flush(time);
+}
+
+void LogFile::update(UINT64 time) {
+	if (time - m_lastFlush >= m_settings.m_flushInterval)
+		flush(time);
+}
+
+void LogFile::flush(UINT64 time) {
+	m_lastFlush = time;
+	if (m_buffer.empty() || !open()) {
+		m_buffer.clear();
+		return;
+	}
+
+	if (m_fileSize != 0 && m_fileSize + m_buffer.size() > m_settings.m_maxFileSize) {
+		rotate();
+		if (!m_file.is_open()) {
+			m_buffer.clear();
+			return;
+		}
+	}
+
+	m_file.write(m_buffer.data(), m_buffer.size());
+	m_file.flush();
+	if (m_file.good())
+		m_fileSize += m_buffer.size();
+	m_buffer.clear();
+}
+
+void LogFile::close() {
+	flush(m_lastFlush);
+	if (m_file.is_open())
+		m_file.close();
+}
+
+std::filesystem::path LogFile::getPath(size_t index) const {
+	if (index == 0)
+		return m_path;
+	auto path = m_path;
+	path += "." + std::to_string(index);
+	return path;
+}
+
+bool LogFile::failed() const {
+	return m_failed;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include "Util.h"
+
+#ifndef LOG_FILE_H
+#define LOG_FILE_H
+
+// The file of the FILE_OUT logger target. The lines are collected and written in big blocks so there is no syscall for
+// every message. Only the writer thread of the logger uses it. It doesn't know anything about windows so the rotation
+// can be checked headless.
+class LogFile {
+public:
+	struct Settings {
+		// the lines are written if this much is collected
+		size_t m_bufferSize = 64 * 1024;
+		// the lines are written at least this often (in ms)
+		UINT64 m_flushInterval = 1000;
+		// if the file gets bigger it is renamed to <file>.1 and a new one is started. <file>.1 becomes <file>.2 and so
+		// on until there are m_maxFiles files
+		size_t m_maxFileSize = 4 * 1024 * 1024;
+		size_t m_maxFiles = 3;
+	};
+
+private:
+	std::filesystem::path m_path;
+	Settings m_settings;
+	std::ofstream m_file;
+	UINT64 m_fileSize = 0;
+	std::string m_buffer;
+	UINT64 m_lastFlush = 0;
+	// don't try again and again if the file can't be created
+	bool m_failed = false;
+
+	bool open();
+	void rotate();
+
+public:
+	LogFile(const std::filesystem::path& path, Settings settings);
+	~LogFile();
+
+	// the line has to end with a new line. If it is urgent (e.g. an error) it is written immediately so it isn't lost
+	// if the program crashes
+	void write(const std::string& line, UINT64 time, bool urgent);
+	// writes the collected lines if the flush interval is over
+	void update(UINT64 time);
+	void flush(UINT64 time);
+	void close();
+
+	// <file>.<index> or the file itself for the index 0
+	std::filesystem::path getPath(size_t index) const;
+	bool failed() const;
+};
+
+#endif // !LOG_FILE_H
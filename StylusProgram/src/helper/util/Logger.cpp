@@ -1,16 +1,301 @@
 #include "Logger.h"
+#include "LogFile.h"
 #include <Windows.h>
 #include <iostream>
-#include <locale>
-#include <codecvt>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
 
 std::queue<std::wstring> Logger::formatedMessage;
 RenderHandler::Direct2DContext* Logger::inWindowDebugOutput;
 bool Logger::enableInWindowDebugOutput;
 bool Logger::forcePrint;
 Logger::PRINT_TARGET Logger::printtarget;
+std::wstring Logger::logFilePath;
+std::atomic<LOGGER_TYPE> Logger::minLevel = LOGGER_TYPE::INFO;
 
-void Logger::init(PRINT_TARGET target) {
+static_assert((Logger::RING_SIZE & (Logger::RING_SIZE - 1)) == 0, "The size of the ring has to be a power of two");
+
+// bounded multi producer queue (https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue)
+// The sequence of a slot tells if it is free for a producer or ready for the writer thread
+struct RingSlot {
+	std::atomic<size_t> m_sequence;
+	Logger::Record m_record;
+};
+
+struct Ring {
+	RingSlot m_slots[Logger::RING_SIZE];
+	// keep the positions on different cache lines so producers and the writer don't fight over them
+	alignas(64) std::atomic<size_t> m_enqueuePosition = 0;
+	alignas(64) size_t m_dequeuePosition = 0;
+	std::atomic<size_t> m_dropped = 0;
+
+	Ring() {
+		for (size_t i = 0; i < Logger::RING_SIZE; i++) {
+			m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+};
+
+static Ring ring;
+// only exists for the FILE_OUT target
+static std::unique_ptr<LogFile> logFile;
+static std::mutex formatedMessageMutex;
+static std::thread writer;
+static std::atomic<bool> writerRunning = false;
+
+Logger::Record* Logger::beginRecord() {
+	size_t pos = ring.m_enqueuePosition.load(std::memory_order_relaxed);
+	while (true) {
+		auto& slot = ring.m_slots[pos & (RING_SIZE - 1)];
+		size_t seq = slot.m_sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (ring.m_enqueuePosition.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				slot.m_record.m_position = pos;
+				return &slot.m_record;
+			}
+		}
+		else if (diff < 0) {
+			// the writer thread didn't free the slot yet
+			ring.m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		else {
+			pos = ring.m_enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void Logger::commitRecord(Record* r) {
+	auto& slot = ring.m_slots[r->m_position & (RING_SIZE - 1)];
+	slot.m_sequence.store(r->m_position + 1, std::memory_order_release);
+}
+
+void Logger::Record::write(ARG_TYPE type, const void* data, size_t size) {
+	// the argument doesn't fit anymore
+	if (m_size + 1 + size > RECORD_PAYLOAD_SIZE) {
+		m_truncated = true;
+		return;
+	}
+	m_payload[m_size] = type;
+	memcpy(m_payload + m_size + 1, data, size);
+	m_size += (UINT16)(1 + size);
+}
+
+void Logger::Record::writeString(ARG_TYPE type, const void* data, size_t length, size_t charsize) {
+	size_t header = 1 + sizeof(UINT16);
+	if (m_size + header > RECORD_PAYLOAD_SIZE) {
+		m_truncated = true;
+		return;
+	}
+	// cut the string if it is too long
+	UINT16 len = (UINT16)min(length, (RECORD_PAYLOAD_SIZE - m_size - header) / charsize);
+	UINT16 flags = 0;
+	if (len < length) {
+		flags = STRING_TRUNCATED;
+		// don't cut a utf-8 character in half
+		auto chars = (const byte*)data;
+		while (charsize == 1 && len > 0 && (chars[len] & 0xc0) == 0x80)
+			len--;
+	}
+	UINT16 stored = len | flags;
+	m_payload[m_size] = type;
+	memcpy(m_payload + m_size + 1, &stored, sizeof(UINT16));
+	memcpy(m_payload + m_size + header, data, len * charsize);
+	m_size += (UINT16)(header + len * charsize);
+}
+
+static std::wstring widen(const char* s, size_t length) {
+	if (length == 0)
+		return std::wstring();
+	int size = MultiByteToWideChar(CP_UTF8, 0, s, (int)length, nullptr, 0);
+	std::wstring out(size, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, s, (int)length, out.data(), size);
+	return out;
+}
+
+// shows where text was cut because it didn't fit into the record
+static const wchar_t* TRUNCATION_MARK = L"\u2026";
+
+// appends the argument at pos to out and returns the position of the next argument
+static size_t formatArgument(const byte* payload, size_t pos, std::wstring& out) {
+	auto type = (Logger::Record::ARG_TYPE)payload[pos++];
+	switch (type) {
+	case Logger::Record::ARG_INT:
+	{
+		INT64 v;
+		memcpy(&v, payload + pos, sizeof(v));
+		out += std::to_wstring(v);
+		return pos + sizeof(v);
+	}
+	case Logger::Record::ARG_UINT:
+	{
+		UINT64 v;
+		memcpy(&v, payload + pos, sizeof(v));
+		out += std::to_wstring(v);
+		return pos + sizeof(v);
+	}
+	case Logger::Record::ARG_DOUBLE:
+	{
+		double v;
+		memcpy(&v, payload + pos, sizeof(v));
+		out += std::to_wstring(v);
+		return pos + sizeof(v);
+	}
+	case Logger::Record::ARG_BOOL:
+	{
+		bool v;
+		memcpy(&v, payload + pos, sizeof(v));
+		out += v ? L"true" : L"false";
+		return pos + sizeof(v);
+	}
+	case Logger::Record::ARG_CHAR:
+	{
+		out += (wchar_t)(unsigned char)payload[pos];
+		return pos + sizeof(char);
+	}
+	case Logger::Record::ARG_WCHAR:
+	{
+		wchar_t v;
+		memcpy(&v, payload + pos, sizeof(v));
+		out += v;
+		return pos + sizeof(v);
+	}
+	case Logger::Record::ARG_STRING:
+	{
+		UINT16 stored;
+		memcpy(&stored, payload + pos, sizeof(stored));
+		UINT16 len = stored & ~Logger::Record::STRING_TRUNCATED;
+		out += widen((const char*)payload + pos + sizeof(stored), len);
+		if (stored & Logger::Record::STRING_TRUNCATED)
+			out += TRUNCATION_MARK;
+		return pos + sizeof(stored) + len;
+	}
+	case Logger::Record::ARG_WSTRING:
+	{
+		UINT16 stored;
+		memcpy(&stored, payload + pos, sizeof(stored));
+		UINT16 len = stored & ~Logger::Record::STRING_TRUNCATED;
+		size_t start = out.size();
+		out.resize(start + len);
+		memcpy(out.data() + start, payload + pos + sizeof(stored), len * sizeof(wchar_t));
+		if (stored & Logger::Record::STRING_TRUNCATED)
+			out += TRUNCATION_MARK;
+		return pos + sizeof(stored) + len * sizeof(wchar_t);
+	}
+	}
+	return pos;
+}
+
+std::wstring Logger::formatRecord(Record* r) {
+	std::wstring msg;
+	msg.reserve(64);
+	msg += L"[" + loggerTypeToString(r->m_type) + L"]: ";
+
+	size_t pos = 0;
+	if (r->m_format == nullptr) {
+		while (pos < r->m_size) {
+			pos = formatArgument(r->m_payload, pos, msg);
+		}
+	}
+	else {
+		for (auto c = r->m_format; *c != L'\0'; c++) {
+			if (c[0] == L'{' && c[1] == L'}' && pos < r->m_size) {
+				pos = formatArgument(r->m_payload, pos, msg);
+				c++;
+				continue;
+			}
+			msg += *c;
+		}
+	}
+	// the arguments that didn't fit are missing
+	if (r->m_truncated)
+		msg += TRUNCATION_MARK;
+	return msg;
+}
+
+bool Logger::popRecord(std::wstring& out, LOGGER_TYPE& type, UINT64& time) {
+	auto& slot = ring.m_slots[ring.m_dequeuePosition & (RING_SIZE - 1)];
+	size_t seq = slot.m_sequence.load(std::memory_order_acquire);
+	if (seq != ring.m_dequeuePosition + 1)
+		return false;
+
+	out = formatRecord(&slot.m_record);
+	type = slot.m_record.m_type;
+	time = slot.m_record.m_time;
+	// the slot can be used again in the next round
+	slot.m_sequence.store(ring.m_dequeuePosition + RING_SIZE, std::memory_order_release);
+	ring.m_dequeuePosition++;
+	return true;
+}
+
+static std::string toUtf8(const std::wstring& s) {
+	if (s.empty())
+		return std::string();
+	int size = WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0, nullptr, nullptr);
+	std::string out(size, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), out.data(), size, nullptr, nullptr);
+	return out;
+}
+
+// the timestamp is only written into the file
+static std::string formatFileLine(const std::wstring& msg, UINT64 time) {
+	auto seconds = (time_t)(time / 1000);
+	tm local;
+	localtime_s(&local, &seconds);
+	char stamp[32];
+	snprintf(stamp, sizeof(stamp), "%04d-%02d-%02d %02d:%02d:%02d.%03d ", local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+		local.tm_hour, local.tm_min, local.tm_sec, (int)(time % 1000));
+	return stamp + toUtf8(msg) + "\n";
+}
+
+void Logger::writerThread() {
+	size_t reportedDrops = 0;
+	std::wstring msg;
+	LOGGER_TYPE type;
+	UINT64 time;
+	while (true) {
+		// read the flag first so everything that was logged before the shutdown is still printed
+		bool running = writerRunning.load();
+
+		bool printed = false;
+		while (popRecord(msg, type, time)) {
+			if (logFile) {
+				// don't lose errors if the program crashes
+				logFile->write(formatFileLine(msg, time), time, type == LOGGER_TYPE::ERROR);
+				continue;
+			}
+			if (forcePrint && printtarget == STD_OUT) {
+				std::wcout << msg << L"\n";
+				printed = true;
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(formatedMessageMutex);
+			formatedMessage.push(std::move(msg));
+		}
+		if (printed)
+			std::wcout.flush();
+		if (logFile)
+			logFile->update(TimeSince1970());
+
+		size_t dropped = getDroppedMessages();
+		if (dropped != reportedDrops) {
+			log(LOGGER_TYPE::WARNING, L"Dropped {} log messages because the ring was full", dropped - reportedDrops);
+			reportedDrops = dropped;
+		}
+
+		if (!running) {
+			if (logFile)
+				logFile->close();
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+}
+
+void Logger::init(PRINT_TARGET target, const std::wstring& logfile) {
 	inWindowDebugOutput = nullptr;
 	enableInWindowDebugOutput = false;
 #ifdef _DEBUG
@@ -19,69 +304,86 @@ void Logger::init(PRINT_TARGET target) {
 	forcePrint = false;
 #endif // _DEBUG
 	printtarget = target;
+	logFilePath = logfile;
+
+	if (!writerRunning.exchange(true)) {
+		if (target == FILE_OUT) {
+			LogFile::Settings settings;
+			settings.m_bufferSize = LOG_FILE_BUFFER_SIZE;
+			settings.m_flushInterval = LOG_FILE_FLUSH_INTERVAL;
+			settings.m_maxFileSize = MAX_LOG_FILE_SIZE;
+			settings.m_maxFiles = MAX_LOG_FILES;
+			logFile = std::make_unique<LogFile>(logFilePath, settings);
+		}
+		writer = std::thread(writerThread);
+	}
 }
 
-void Logger::add(const std::wstring& s, LOGGER_TYPE t) {
-	std::wstring msg;
-	msg.reserve(s.size() + 10);
-	msg += L"[" + loggerTypeToString(t) + L"]: ";
-	msg.append(s);
+void Logger::shutdown() {
+	if (!writerRunning.exchange(false))
+		return;
+	writer.join();
+	logFile.reset();
+}
 
-	formatedMessage.push(msg);
+void Logger::setLevel(LOGGER_TYPE t) {
+	minLevel.store(t, std::memory_order_relaxed);
+}
 
-	if (forcePrint) {
-		print();
-	}
+size_t Logger::getDroppedMessages() {
+	return ring.m_dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::add(const std::wstring& s, LOGGER_TYPE t) {
+	log(t, nullptr, s);
 }
 
 void Logger::add(const int& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s), t);
+	log(t, nullptr, s);
 }
 
 void Logger::add(const double& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s), t);
+	log(t, nullptr, s);
 }
 
 void Logger::add(const unsigned int& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s));
+	log(t, nullptr, s);
 }
 
 void Logger::add(const unsigned long& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s));
+	log(t, nullptr, s);
 }
 
 void Logger::add(const long& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s));
+	log(t, nullptr, s);
 }
 
 void Logger::add(const float& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s));
+	log(t, nullptr, s);
 }
 
 void Logger::add(const bool& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s));
+	log(t, nullptr, s);
 }
 
 void Logger::add(const char& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s));
+	log(t, nullptr, s);
 }
 
 void Logger::add(const wchar_t& s, LOGGER_TYPE t) {
-	add(std::to_wstring(s));
+	log(t, nullptr, s);
 }
 
 void Logger::add(const char* s, LOGGER_TYPE t) {
-	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-	std::wstring wide = converter.from_bytes(s);
-	add(wide);
+	log(t, nullptr, s);
 }
 
 void Logger::add(const wchar_t* s, LOGGER_TYPE t) {
-	add(std::wstring(s));
+	log(t, nullptr, s);
 }
 
 void Logger::add(const std::string& s, LOGGER_TYPE t) {
-	add(s.c_str());
+	log(t, nullptr, s);
 }
 
 void Logger::err(const std::wstring& s) {
@@ -90,6 +392,7 @@ void Logger::err(const std::wstring& s) {
 
 
 void Logger::print(std::wostream& out) {
+	std::lock_guard<std::mutex> lock(formatedMessageMutex);
 	while (!formatedMessage.empty()) {
 		out << formatedMessage.front() << L"\n";
 		formatedMessage.pop();
@@ -117,7 +420,7 @@ void Logger::print(PRINT_TARGET target) {
 	case PRINT_TARGET::DIRECT2D_CONTEXT:
 	{
 		if (inWindowDebugOutput != nullptr)
-			print();
+			print(inWindowDebugOutput);
 		break;
 	}
 	case PRINT_TARGET::STD_OUT:
@@ -129,10 +432,20 @@ void Logger::print(PRINT_TARGET target) {
 }
 
 void Logger::print(RenderHandler::Direct2DContext* context) {
-	while (!formatedMessage.empty()) {
-		context->addDebugText(formatedMessage.front());
-		formatedMessage.pop();
+	std::wstring batch;
+	{
+		std::lock_guard<std::mutex> lock(formatedMessageMutex);
+		if (formatedMessage.empty())
+			return;
+		// the newest message is on top
+		while (!formatedMessage.empty()) {
+			batch.insert(0, formatedMessage.front() + L"\n");
+			formatedMessage.pop();
+		}
 	}
+	// one repaint for all messages instead of one for every line
+	batch.pop_back();
+	context->addDebugText(batch);
 }
 
 void Logger::setDirect2DContext(RenderHandler::Direct2DContext* context) {
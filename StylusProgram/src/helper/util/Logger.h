@@ -2,6 +2,9 @@
 
 #include <string>
 #include <queue>
+#include <type_traits>
+#include <cstring>
+#include <atomic>
 #include "render/RenderHandler.h"
 
 #ifndef LOGGER_H
@@ -19,7 +22,33 @@ namespace RenderHandler {
 	class Direct2DContext;
 }
 
-// this class is widley inefficent in every way imaginable so only use in debug mode...plz 
+// Messages below this level are removed by the compiler when they are logged with the LOG_ macros.
+// Can be set in the project settings
+#ifndef LOGGER_COMPILE_LEVEL
+#ifdef _DEBUG
+#define LOGGER_COMPILE_LEVEL 0
+#else
+#define LOGGER_COMPILE_LEVEL 1
+#endif // _DEBUG
+#endif // !LOGGER_COMPILE_LEVEL
+
+// The arguments are only evaluated if the level is enabled at compile time and at runtime
+// e.g. LOG_INFO(L"Rendered pdf to bitmap in {}ms", TimeSince1970() - time);
+#define LOGGER_LOG(level, ...) \
+	do { \
+		if constexpr ((level) >= LOGGER_COMPILE_LEVEL) { \
+			if (Logger::isEnabled(level)) \
+				Logger::log(level, __VA_ARGS__); \
+		} \
+	} while (0)
+
+#define LOG_INFO(...) LOGGER_LOG(LOGGER_TYPE::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOGGER_LOG(LOGGER_TYPE::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOGGER_LOG(LOGGER_TYPE::ERROR, __VA_ARGS__)
+
+// Logging only writes a binary record into a lock free ring buffer. A background thread formats the records and
+// prints them so logging can be used on the render and input paths. If the ring is full the message is dropped
+// and counted instead of waiting
 class Logger {
 public:
 	enum PRINT_TARGET {
@@ -27,6 +56,100 @@ public:
 		DIRECT2D_CONTEXT,
 		FILE_OUT
 	};
+
+	// the amount of records that fit into the ring. Has to be a power of two
+	static constexpr size_t RING_SIZE = 4096;
+	static constexpr size_t RECORD_PAYLOAD_SIZE = 224;
+
+	// a message that wasn't formatted yet. The arguments are stored one after another as [ARG_TYPE][value]
+	struct Record {
+		enum ARG_TYPE : byte {
+			ARG_INT,
+			ARG_UINT,
+			ARG_DOUBLE,
+			ARG_BOOL,
+			ARG_CHAR,
+			ARG_WCHAR,
+			// [UINT16 length][chars]. The highest bit of the length is set if the string was cut
+			ARG_STRING,
+			ARG_WSTRING
+		};
+		static constexpr UINT16 STRING_TRUNCATED = 0x8000;
+
+		// position in the ring. Only used by the ring itself
+		size_t m_position;
+		LOGGER_TYPE m_type;
+		// ms since 1970
+		UINT64 m_time;
+		// string literal where every {} is replaced by the next argument. If it is nullptr the arguments are just concatenated
+		const wchar_t* m_format;
+		UINT16 m_size;
+		// an argument didn't fit into the payload anymore
+		bool m_truncated;
+		byte m_payload[RECORD_PAYLOAD_SIZE];
+
+		void write(ARG_TYPE type, const void* data, size_t size);
+		void writeString(ARG_TYPE type, const void* data, size_t length, size_t charsize);
+
+		template <typename T>
+		void add(const T& arg) {
+			if constexpr (std::is_same_v<T, bool>) {
+				write(ARG_BOOL, &arg, sizeof(bool));
+			}
+			else if constexpr (std::is_same_v<T, char>) {
+				write(ARG_CHAR, &arg, sizeof(char));
+			}
+			else if constexpr (std::is_same_v<T, wchar_t>) {
+				write(ARG_WCHAR, &arg, sizeof(wchar_t));
+			}
+			else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+				INT64 v = arg;
+				write(ARG_INT, &v, sizeof(v));
+			}
+			else if constexpr (std::is_integral_v<T>) {
+				UINT64 v = arg;
+				write(ARG_UINT, &v, sizeof(v));
+			}
+			else if constexpr (std::is_floating_point_v<T>) {
+				double v = arg;
+				write(ARG_DOUBLE, &v, sizeof(v));
+			}
+			else if constexpr (std::is_same_v<T, std::string>) {
+				writeString(ARG_STRING, arg.data(), arg.size(), sizeof(char));
+			}
+			else if constexpr (std::is_same_v<T, std::wstring>) {
+				writeString(ARG_WSTRING, arg.data(), arg.size(), sizeof(wchar_t));
+			}
+			else if constexpr (std::is_convertible_v<T, const char*>) {
+				const char* str = arg;
+				writeString(ARG_STRING, str, strlen(str), sizeof(char));
+			}
+			else if constexpr (std::is_convertible_v<T, const wchar_t*>) {
+				const wchar_t* str = arg;
+				writeString(ARG_WSTRING, str, wcslen(str), sizeof(wchar_t));
+			}
+			else {
+				static_assert(!sizeof(T), "This type can't be logged");
+			}
+		}
+	};
+
+private:
+	// reserves a record in the ring. Returns nullptr if the ring is full
+	static Record* beginRecord();
+	// the record can be printed after it was commited
+	static void commitRecord(Record* r);
+	// formats the record and frees it
+	static std::wstring formatRecord(Record* r);
+	// takes the next commited record out of the ring and formats it. Only called by the writer thread
+	static bool popRecord(std::wstring& out, LOGGER_TYPE& type, UINT64& time);
+	static void writerThread();
+
+public:
+	// messages below this level are thrown away at runtime
+	static std::atomic<LOGGER_TYPE> minLevel;
+
+	// the formatted messages that wait for print(). Access is guarded because the writer thread fills it
 	static std::queue<std::wstring> formatedMessage;
 
 	static RenderHandler::Direct2DContext* inWindowDebugOutput;
@@ -35,6 +158,15 @@ public:
 	static bool forcePrint;
 	static PRINT_TARGET printtarget;
 
+	// the FILE_OUT target collects the messages and writes them in blocks of this size
+	static constexpr size_t LOG_FILE_BUFFER_SIZE = 64 * 1024;
+	// the messages are written at least this often (in ms). Errors are written immediately
+	static constexpr UINT64 LOG_FILE_FLUSH_INTERVAL = 1000;
+	// if the file gets bigger it is renamed to <file>.1 and a new one is started. <file>.1 becomes <file>.2 and so on
+	static constexpr size_t MAX_LOG_FILE_SIZE = 4 * 1024 * 1024;
+	static constexpr size_t MAX_LOG_FILES = 3;
+	static std::wstring logFilePath;
+
 	static std::wstring loggerTypeToString(LOGGER_TYPE t) {
 		switch (t) {
 		case INFO:
@@ -53,7 +185,37 @@ public:
 	~Logger() = delete;
 	Logger& operator=(const Logger&) = delete;
 
-	static void init(PRINT_TARGET target);
+	// starts the writer thread. The file is only used by the FILE_OUT target
+	static void init(PRINT_TARGET target, const std::wstring& logfile = L"StylusProgram.log");
+	// prints all remaining messages and stops the writer thread
+	static void shutdown();
+
+	// Logs the message without allocating. Every {} in the format is replaced by the next argument
+	// Supported arguments are numbers, bools, characters and strings. Strings are copied and may be truncated, which
+	// is marked with a "…" in the message
+	template <typename... Args>
+	static void log(LOGGER_TYPE t, const wchar_t* format, const Args&... args) {
+		if (!isEnabled(t))
+			return;
+		auto r = beginRecord();
+		if (r == nullptr)
+			return;
+		r->m_type = t;
+		r->m_time = TimeSince1970();
+		r->m_format = format;
+		r->m_size = 0;
+		r->m_truncated = false;
+		(r->add(args), ...);
+		commitRecord(r);
+	}
+
+	static bool isEnabled(LOGGER_TYPE t) {
+		return t >= minLevel.load(std::memory_order_relaxed);
+	}
+	static void setLevel(LOGGER_TYPE t);
+
+	// the amount of messages that were dropped because the ring was full
+	static size_t getDroppedMessages();
 
 	static void add(const std::wstring& s, LOGGER_TYPE t = LOGGER_TYPE::INFO);
 	static void add(const int& s, LOGGER_TYPE t = LOGGER_TYPE::INFO);
@@ -0,0 +1,118 @@
+#include "MemoryBudget.h"
+#include "Trace.h"
+#include "Logger.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<MemoryBudget::Cache>> caches;
+static std::atomic<size_t> limit = MemoryBudget::DEFAULT_LIMIT;
+
+void MemoryBudget::Cache::setSize(size_t size) {
+	m_size.store((INT64)size, std::memory_order_relaxed);
+	m_gauge->set((INT64)size);
+}
+
+void MemoryBudget::Cache::addSize(INT64 size) {
+	auto now = m_size.fetch_add(size, std::memory_order_relaxed) + size;
+	m_gauge->set(now);
+}
+
+size_t MemoryBudget::Cache::getSize() const {
+	// a cache that frees memory it didn't report could go below 0
+	return (size_t)max(m_size.load(std::memory_order_relaxed), (INT64)0);
+}
+
+void MemoryBudget::Cache::touch() {
+	m_lastUse.store(Trace::now(), std::memory_order_relaxed);
+}
+
+const std::string& MemoryBudget::Cache::getName() const {
+	return m_name;
+}
+
+MemoryBudget::Cache* MemoryBudget::add(const std::string& name, float cost, std::function<size_t(size_t)> evict) {
+	auto cache = std::make_unique<Cache>();
+	cache->m_name = name;
+	cache->m_cost = cost;
+	cache->m_evict = evict;
+	cache->m_gauge = &Metrics::gauge("memory." + name + "_bytes");
+	cache->touch();
+
+	std::lock_guard<std::mutex> lock(registryLock);
+	caches.push_back(std::move(cache));
+	return caches.back().get();
+}
+
+void MemoryBudget::remove(Cache* cache) {
+	if (cache == nullptr)
+		return;
+	cache->m_gauge->set(0);
+	std::lock_guard<std::mutex> lock(registryLock);
+	for (auto it = caches.begin(); it != caches.end(); it++) {
+		if (it->get() != cache)
+			continue;
+		caches.erase(it);
+		return;
+	}
+}
+
+void MemoryBudget::setLimit(size_t bytes) {
+	limit.store(bytes, std::memory_order_relaxed);
+}
+
+size_t MemoryBudget::getLimit() {
+	return limit.load(std::memory_order_relaxed);
+}
+
+size_t MemoryBudget::getTotal() {
+	std::lock_guard<std::mutex> lock(registryLock);
+	size_t total = 0;
+	for (auto& cache : caches)
+		total += cache->getSize();
+	return total;
+}
+
+size_t MemoryBudget::enforce() {
+	static auto& totalgauge = Metrics::gauge("memory.total_bytes");
+	static auto& evictions = Metrics::counter("memory.evictions");
+	static auto& evicted = Metrics::counter("memory.evicted_bytes");
+	auto total = getTotal();
+	totalgauge.set((INT64)total);
+	if (total <= getLimit())
+		return 0;
+
+	TRACE_SCOPE("MemoryBudget::enforce", "memory");
+	// The caches that are cheap to fill again and weren't used for a while come first. A cache that wasn't used
+	// for a second is worth half as much as one that is in use
+	std::vector<std::pair<float, Cache*>> order;
+	{
+		std::lock_guard<std::mutex> lock(registryLock);
+		auto now = Trace::now();
+		for (auto& cache : caches) {
+			if (!cache->m_evict || cache->getSize() == 0)
+				continue;
+			auto age = (now - min(cache->m_lastUse.load(std::memory_order_relaxed), now)) / 1'000'000'000.0f;
+			order.push_back({ cache->m_cost / (1 + age), cache.get() });
+		}
+	}
+	std::sort(order.begin(), order.end(), [](auto& a, auto& b) { return a.first < b.first; });
+
+	// the evict functions take the locks of their caches so they are called without the registry lock
+	auto target = (size_t)(getLimit() * EVICTION_TARGET);
+	size_t freed = 0;
+	for (auto& [priority, cache] : order) {
+		if (total - freed <= target)
+			break;
+		auto bytes = cache->m_evict(total - freed - target);
+		freed += min(bytes, total - freed);
+		evictions.add();
+	}
+	evicted.add(freed);
+	totalgauge.set((INT64)getTotal());
+	if (total - freed > getLimit())
+		LOG_WARNING(L"The caches need {}MB which is more than the memory budget of {}MB", (total - freed) >> 20, getLimit() >> 20);
+	return freed;
+}
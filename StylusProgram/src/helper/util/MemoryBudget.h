@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <functional>
+#include "Util.h"
+#include "Metrics.h"
+
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+// The memory (in MB) all caches together may use if the machine has enough memory.
+// Can be set in the project settings
+#ifndef MEMORY_BUDGET_MB
+#define MEMORY_BUDGET_MB 1024
+#endif // !MEMORY_BUDGET_MB
+
+// Keeps the memory of all caches below one limit. Every cache registers itself with the cost of creating its content
+// again and reports its size. Once the caches together are over the limit enforce asks the caches to give memory
+// back. The caches with the lowest cost that weren't used for the longest time go first and every cache throws
+// away the content it needs last. Caches without an evict function only count towards the limit, e.g. the strokes
+// that can't be created again
+class MemoryBudget {
+public:
+	class Cache {
+		std::string m_name;
+		// how expensive one byte is to create again compared to the other caches
+		float m_cost = 1;
+		std::atomic<INT64> m_size = 0;
+		// Trace::now of the last use
+		std::atomic<UINT64> m_lastUse = 0;
+		// frees about the bytes and returns how many bytes were freed. The memory that is in use is kept
+		std::function<size_t(size_t)> m_evict;
+		Metrics::Gauge* m_gauge = nullptr;
+
+		friend MemoryBudget;
+	public:
+		// can be called from every thread
+		void setSize(size_t size);
+		void addSize(INT64 size);
+		size_t getSize() const;
+		// the content was used. Caches that were used recently are evicted later
+		void touch();
+		const std::string& getName() const;
+	};
+
+	// every eviction frees memory until this part of the limit is used so it doesn't run again with the next frame
+	static constexpr float EVICTION_TARGET = 0.9f;
+	static constexpr size_t DEFAULT_LIMIT = (size_t)MEMORY_BUDGET_MB * 1024 * 1024;
+
+	MemoryBudget() = delete;
+
+	// The cache lives until it is removed. evict can be empty and is only called from enforce
+	static Cache* add(const std::string& name, float cost, std::function<size_t(size_t)> evict = nullptr);
+	static void remove(Cache* cache);
+
+	static void setLimit(size_t bytes);
+	static size_t getLimit();
+	// the memory of all caches
+	static size_t getTotal();
+	// Evicts from the caches until they fit into the limit again. Returns the freed bytes. Has to be called from
+	// the thread that owns the caches
+	static size_t enforce();
+};
+
+#endif // !MEMORY_BUDGET_H
@@ -0,0 +1,166 @@
+#include "Metrics.h"
+#include "FileHandler.h"
+#include <map>
+#include <memory>
+#include <mutex>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static std::mutex registryLock;
+// std::map so the summary is sorted by name
+static std::map<std::string, std::unique_ptr<Metrics::Counter>> counters;
+static std::map<std::string, std::unique_ptr<Metrics::Gauge>> gauges;
+static std::map<std::string, std::unique_ptr<Metrics::Histogram>> histograms;
+
+template <typename T>
+static T& getOrCreate(std::map<std::string, std::unique_ptr<T>>& registry, const std::string& name) {
+	std::lock_guard<std::mutex> lock(registryLock);
+	auto& metric = registry[name];
+	if (metric == nullptr)
+		metric = std::make_unique<T>();
+	return *metric;
+}
+
+// index of the highest set bit. Value must not be 0
+static size_t highestBit(UINT64 value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+size_t Metrics::Histogram::bucketIndex(UINT64 value) {
+	if (value < SUB_BUCKETS)
+		return (size_t)value;
+	size_t exponent = highestBit(value);
+	// the top bits of the value select the bucket inside the power of two
+	size_t sub = (size_t)(value >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+	return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+UINT64 Metrics::Histogram::bucketValue(size_t index) {
+	if (index < SUB_BUCKETS)
+		return index;
+	size_t shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+	UINT64 sub = (index - SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+	return ((sub + 1) << shift) - 1;
+}
+
+void Metrics::Histogram::record(UINT64 value) {
+	m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+
+	UINT64 currentmax = m_max.load(std::memory_order_relaxed);
+	while (value > currentmax && !m_max.compare_exchange_weak(currentmax, value, std::memory_order_relaxed));
+}
+
+UINT64 Metrics::Histogram::percentile(double p) const {
+	UINT64 total = count();
+	if (total == 0)
+		return 0;
+
+	UINT64 target = (UINT64)std::ceil(p * total);
+	target = max(target, (UINT64)1);
+	UINT64 seen = 0;
+	for (size_t i = 0; i < BUCKETS; i++) {
+		seen += m_buckets[i].load(std::memory_order_relaxed);
+		if (seen >= target)
+			return min(bucketValue(i), getMax());
+	}
+	return getMax();
+}
+
+UINT64 Metrics::Histogram::count() const {
+	return m_count.load(std::memory_order_relaxed);
+}
+
+UINT64 Metrics::Histogram::getMax() const {
+	return m_max.load(std::memory_order_relaxed);
+}
+
+double Metrics::Histogram::mean() const {
+	auto n = count();
+	return n == 0 ? 0 : (double)m_sum.load(std::memory_order_relaxed) / n;
+}
+
+void Metrics::Histogram::reset() {
+	for (auto& b : m_buckets) {
+		b.store(0, std::memory_order_relaxed);
+	}
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+Metrics::Counter& Metrics::counter(const std::string& name) {
+	return getOrCreate(counters, name);
+}
+
+Metrics::Gauge& Metrics::gauge(const std::string& name) {
+	return getOrCreate(gauges, name);
+}
+
+Metrics::Histogram& Metrics::histogram(const std::string& name) {
+	return getOrCreate(histograms, name);
+}
+
+static std::wstring widen(const std::string& s) {
+	// the names are plain ascii
+	return std::wstring(s.begin(), s.end());
+}
+
+std::wstring Metrics::getSummary() {
+	std::lock_guard<std::mutex> lock(registryLock);
+	std::wstring summary;
+	for (auto& [name, c] : counters) {
+		summary += widen(name) + L": " + std::to_wstring(c->get()) + L"\n";
+	}
+	for (auto& [name, g] : gauges) {
+		summary += widen(name) + L": " + std::to_wstring(g->get()) + L"\n";
+	}
+	for (auto& [name, h] : histograms) {
+		summary += widen(name) + L": n=" + std::to_wstring(h->count())
+			+ L" p50=" + std::to_wstring(h->percentile(0.5))
+			+ L" p99=" + std::to_wstring(h->percentile(0.99))
+			+ L" p999=" + std::to_wstring(h->percentile(0.999))
+			+ L" max=" + std::to_wstring(h->getMax()) + L"\n";
+	}
+	return summary;
+}
+
+void Metrics::dumpToFile(const std::wstring& path) {
+	std::string json = "{\n\"time\": " + std::to_string(TimeSince1970()) + ",\n\"counters\": {";
+	{
+		std::lock_guard<std::mutex> lock(registryLock);
+		const char* separator = "\n";
+		for (auto& [name, c] : counters) {
+			json += separator;
+			json += "\t\"" + name + "\": " + std::to_string(c->get());
+			separator = ",\n";
+		}
+		json += "\n},\n\"gauges\": {";
+		separator = "\n";
+		for (auto& [name, g] : gauges) {
+			json += separator;
+			json += "\t\"" + name + "\": " + std::to_string(g->get());
+			separator = ",\n";
+		}
+		json += "\n},\n\"histograms\": {";
+		separator = "\n";
+		for (auto& [name, h] : histograms) {
+			json += separator;
+			json += "\t\"" + name + "\": {\"count\": " + std::to_string(h->count()) + ", \"mean\": " + std::to_string(h->mean())
+				+ ", \"p50\": " + std::to_string(h->percentile(0.5)) + ", \"p99\": " + std::to_string(h->percentile(0.99))
+				+ ", \"p999\": " + std::to_string(h->percentile(0.999)) + ", \"max\": " + std::to_string(h->getMax()) + "}";
+			separator = ",\n";
+		}
+		json += "\n}\n}\n";
+	}
+	FileHandler::saveFile(path, (byte*)json.data(), json.size());
+}
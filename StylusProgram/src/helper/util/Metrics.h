@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include "Util.h"
+
+#ifndef METRICS_H
+#define METRICS_H
+
+// Registry of named counters, gauges and latency histograms. Looking up a metric takes a lock so call sites should
+// keep the reference, e.g. static auto& hits = Metrics::counter("pdfbuilder.preview.hits");
+// Updating a metric only uses atomics and can be done from every thread
+class Metrics {
+public:
+	class Counter {
+		std::atomic<UINT64> m_value = 0;
+	public:
+		void add(UINT64 n = 1) {
+			m_value.fetch_add(n, std::memory_order_relaxed);
+		}
+		UINT64 get() const {
+			return m_value.load(std::memory_order_relaxed);
+		}
+	};
+
+	class Gauge {
+		std::atomic<INT64> m_value = 0;
+	public:
+		void set(INT64 v) {
+			m_value.store(v, std::memory_order_relaxed);
+		}
+		void add(INT64 v) {
+			m_value.fetch_add(v, std::memory_order_relaxed);
+		}
+		INT64 get() const {
+			return m_value.load(std::memory_order_relaxed);
+		}
+	};
+
+	// Log linear histogram like HdrHistogram. Every power of two is split into 32 buckets so the
+	// percentiles have an error of at most ~3%. Values below 32 are exact
+	class Histogram {
+	public:
+		static constexpr size_t SUB_BUCKET_BITS = 5;
+		static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		static constexpr size_t BUCKETS = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+	private:
+		std::atomic<UINT64> m_buckets[BUCKETS] = {};
+		std::atomic<UINT64> m_count = 0;
+		std::atomic<UINT64> m_sum = 0;
+		std::atomic<UINT64> m_max = 0;
+
+		static size_t bucketIndex(UINT64 value);
+		// the biggest value that falls into the bucket
+		static UINT64 bucketValue(size_t index);
+	public:
+		void record(UINT64 value);
+
+		// p between 0 and 1. Returns 0 if nothing was recorded
+		UINT64 percentile(double p) const;
+		UINT64 count() const;
+		UINT64 getMax() const;
+		double mean() const;
+		void reset();
+	};
+
+	Metrics() = delete;
+
+	// the metrics are created on first use and live until the program ends
+	static Counter& counter(const std::string& name);
+	static Gauge& gauge(const std::string& name);
+	static Histogram& histogram(const std::string& name);
+
+	// one line per metric. Histograms show the count, p50, p99, p999 and the max
+	static std::wstring getSummary();
+	// writes all metrics as json
+	static void dumpToFile(const std::wstring& path);
+};
+
+#endif // !METRICS_H
@@ -0,0 +1,94 @@
+#include "PixelCodec.h"
+#include <cstring>
+
+static void writeToken(std::vector<byte>& data, UINT32 count, bool run) {
+	UINT32 value = (count - 1) << 1 | (run ? 1 : 0);
+	while (value >= 0x80) {
+		data.push_back((byte)(value | 0x80));
+		value >>= 7;
+	}
+	data.push_back((byte)value);
+}
+
+static bool readToken(const byte*& data, const byte* end, UINT32& count, bool& run) {
+	UINT32 value = 0;
+	for (UINT32 shift = 0; shift < 32; shift += 7) {
+		if (data == end)
+			return false;
+		byte b = *data++;
+		value |= (UINT32)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0) {
+			count = (value >> 1) + 1;
+			run = (value & 1) != 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+static UINT32 getRunLength(const UINT32* row, UINT32 x, UINT32 width) {
+	UINT32 length = 1;
+	while (x + length < width && row[x + length] == row[x])
+		length++;
+	return length;
+}
+
+std::vector<byte> PixelCodec::encode(const byte* pixels, UINT32 width, UINT32 height, UINT32 stride) {
+	std::vector<byte> data;
+	std::vector<UINT32> row(width);
+	for (UINT32 y = 0; y < height; y++) {
+		// copied so the pixels can be compared as words no matter how the rows are aligned
+		memcpy(row.data(), pixels + (size_t)y * stride, (size_t)width * sizeof(UINT32));
+
+		UINT32 x = 0;
+		while (x < width) {
+			auto length = getRunLength(row.data(), x, width);
+			if (length >= MIN_RUN) {
+				writeToken(data, length, true);
+				data.insert(data.end(), (const byte*)&row[x], (const byte*)&row[x] + sizeof(UINT32));
+				x += length;
+				continue;
+			}
+
+			// the literals end where the next run starts
+			UINT32 start = x;
+			while (x < width) {
+				length = getRunLength(row.data(), x, width);
+				if (length >= MIN_RUN)
+					break;
+				x += length;
+			}
+			writeToken(data, x - start, false);
+			data.insert(data.end(), (const byte*)&row[start], (const byte*)&row[x - 1] + sizeof(UINT32));
+		}
+	}
+	return data;
+}
+
+bool PixelCodec::decode(const byte* data, size_t size, byte* pixels, UINT32 width, UINT32 height, UINT32 stride) {
+	const byte* end = data + size;
+	for (UINT32 y = 0; y < height; y++) {
+		byte* row = pixels + (size_t)y * stride;
+		UINT32 x = 0;
+		while (x < width) {
+			UINT32 count;
+			bool run;
+			if (!readToken(data, end, count, run) || count > width - x)
+				return false;
+
+			size_t bytes = run ? sizeof(UINT32) : (size_t)count * sizeof(UINT32);
+			if ((size_t)(end - data) < bytes)
+				return false;
+			if (run) {
+				for (UINT32 i = 0; i < count; i++)
+					memcpy(row + (size_t)(x + i) * sizeof(UINT32), data, sizeof(UINT32));
+			}
+			else {
+				memcpy(row + (size_t)x * sizeof(UINT32), data, bytes);
+			}
+			data += bytes;
+			x += count;
+		}
+	}
+	return data == end;
+}
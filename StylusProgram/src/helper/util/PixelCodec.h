@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include "Util.h"
+
+#ifndef PIXEL_CODEC_H
+#define PIXEL_CODEC_H
+
+// Lossless coding of rendered pages with 4 byte pixels. Documents are mostly the plain paper with anti aliased text in
+// between so every row is split into runs of the same pixel, which are stored once with their length, and the
+// literal pixels between them. Every pixel is only touched once which makes it a lot faster than deflate. Photos
+// barely get smaller.
+// Every row: [token][pixel data]... A token is a varint of (count - 1) << 1 | run. A run is followed by the one pixel
+// that is repeated count times, a literal by count pixels.
+namespace PixelCodec {
+	// runs shorter than this are stored as literals because the token costs more than it saves
+	constexpr UINT32 MIN_RUN = 3;
+
+	std::vector<byte> encode(const byte* pixels, UINT32 width, UINT32 height, UINT32 stride);
+	// writes the pixels into the buffer which has to have the size of height * stride. Returns false if the data
+	// doesn't belong to an image with that size
+	bool decode(const byte* data, size_t size, byte* pixels, UINT32 width, UINT32 height, UINT32 stride);
+}
+
+#endif // !PIXEL_CODEC_H
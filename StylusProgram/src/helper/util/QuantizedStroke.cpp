@@ -0,0 +1,289 @@
+#include "QuantizedStroke.h"
+#include "StrokeGeometry.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define QUANTIZED_STROKE_SSE2
+#endif
+
+// the amount of points that are decoded at once if the stroke is delta encoded
+constexpr size_t DECODE_CHUNK_SIZE = 256;
+
+static uint16_t quantize(float value, float origin, float step) {
+	float q = std::floor((value - origin) / step + 0.5f);
+	return (uint16_t)min(max(q, 0.0f), 65535.0f);
+}
+
+// checks if the point q is closer than sqrt(r2) to any of the lines between the n points. Everything is in quantized space
+static bool hitTestSegments(const uint16_t* x, const uint16_t* y, size_t n, float qx, float qy, float r2) {
+	if (n == 1) {
+		float dx = x[0] - qx;
+		float dy = y[0] - qy;
+		return dx * dx + dy * dy < r2;
+	}
+
+	size_t i = 0;
+#ifdef QUANTIZED_STROKE_SSE2
+	// test 4 lines at once
+	const __m128i zeroi = _mm_setzero_si128();
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 epsilon = _mm_set1_ps(1e-12f);
+	const __m128 vqx = _mm_set1_ps(qx);
+	const __m128 vqy = _mm_set1_ps(qy);
+	const __m128 vr2 = _mm_set1_ps(r2);
+	for (; i + 4 < n; i += 4) {
+		__m128 x0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(x + i)), zeroi));
+		__m128 x1 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(x + i + 1)), zeroi));
+		__m128 y0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(y + i)), zeroi));
+		__m128 y1 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(y + i + 1)), zeroi));
+
+		__m128 dx = _mm_sub_ps(x1, x0);
+		__m128 dy = _mm_sub_ps(y1, y0);
+		__m128 px = _mm_sub_ps(vqx, x0);
+		__m128 py = _mm_sub_ps(vqy, y0);
+
+		// project the point onto the line and clamp it to the end points
+		__m128 length = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), epsilon);
+		__m128 t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(px, dx), _mm_mul_ps(py, dy)), length);
+		t = _mm_min_ps(_mm_max_ps(t, zero), one);
+
+		__m128 cx = _mm_sub_ps(px, _mm_mul_ps(t, dx));
+		__m128 cy = _mm_sub_ps(py, _mm_mul_ps(t, dy));
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(d2, vr2)) != 0)
+			return true;
+	}
+#endif
+
+	for (; i + 1 < n; i++) {
+		float dx = (float)x[i + 1] - x[i];
+		float dy = (float)y[i + 1] - y[i];
+		float px = qx - x[i];
+		float py = qy - y[i];
+
+		float length = max(dx * dx + dy * dy, 1e-12f);
+		float t = min(max((px * dx + py * dy) / length, 0.0f), 1.0f);
+
+		float cx = px - t * dx;
+		float cy = py - t * dy;
+		if (cx * cx + cy * cy < r2)
+			return true;
+	}
+
+	return false;
+}
+
+QuantizedStroke::QuantizedStroke(const std::vector<Point2D<float>>& points) {
+	m_size = points.size();
+	if (m_size == 0)
+		return;
+
+	m_boundingBox = ::getBoundingBox(&points);
+	m_origin = m_boundingBox.upperleft;
+
+	// the smallest step so the whole bounding box fits into 16 bit
+	float absolutestep = max(max(m_boundingBox.width, m_boundingBox.height) / 65535.0f, 1e-6f);
+
+	// check if the points are close enough together for the delta encoding
+	float maxdelta = 0;
+	for (size_t i = 1; i < m_size; i++) {
+		maxdelta = max(maxdelta, std::fabs(points[i].x - points[i - 1].x));
+		maxdelta = max(maxdelta, std::fabs(points[i].y - points[i - 1].y));
+	}
+	// 126 instead of 127 to leave room for the rounding
+	float deltastep = max(absolutestep, maxdelta / 126.0f);
+
+	m_deltaEncoded = m_size > 1 && deltastep <= MAX_DELTA_STEP;
+	m_step = m_deltaEncoded ? deltastep : absolutestep;
+
+	if (m_deltaEncoded) {
+		m_data.resize(2 * sizeof(uint16_t) + 2 * (m_size - 1));
+		auto x = (uint16_t*)m_data.data();
+		auto y = x + 1;
+		auto dx = (int8_t*)(m_data.data() + 2 * sizeof(uint16_t));
+		auto dy = dx + m_size - 1;
+
+		uint16_t lastx = quantize(points[0].x, m_origin.x, m_step);
+		uint16_t lasty = quantize(points[0].y, m_origin.y, m_step);
+		*x = lastx;
+		*y = lasty;
+		for (size_t i = 1; i < m_size; i++) {
+			uint16_t qx = quantize(points[i].x, m_origin.x, m_step);
+			uint16_t qy = quantize(points[i].y, m_origin.y, m_step);
+			dx[i - 1] = (int8_t)((int)qx - lastx);
+			dy[i - 1] = (int8_t)((int)qy - lasty);
+			lastx = qx;
+			lasty = qy;
+		}
+	}
+	else {
+		m_data.resize(2 * sizeof(uint16_t) * m_size);
+		auto x = (uint16_t*)m_data.data();
+		auto y = x + m_size;
+		for (size_t i = 0; i < m_size; i++) {
+			x[i] = quantize(points[i].x, m_origin.x, m_step);
+			y[i] = quantize(points[i].y, m_origin.y, m_step);
+		}
+	}
+}
+
+const uint16_t* QuantizedStroke::getX() const {
+	return (const uint16_t*)getData();
+}
+
+const uint16_t* QuantizedStroke::getY() const {
+	return m_deltaEncoded ? getX() + 1 : getX() + m_size;
+}
+
+const int8_t* QuantizedStroke::getDeltaX() const {
+	return (const int8_t*)(getData() + 2 * sizeof(uint16_t));
+}
+
+const int8_t* QuantizedStroke::getDeltaY() const {
+	return getDeltaX() + m_size - 1;
+}
+
+size_t QuantizedStroke::size() const {
+	return m_size;
+}
+
+bool QuantizedStroke::isDeltaEncoded() const {
+	return m_deltaEncoded;
+}
+
+Rect2D<float> QuantizedStroke::getBoundingBox() const {
+	return m_boundingBox;
+}
+
+void QuantizedStroke::decode(std::vector<Point2D<float>>& out) const {
+	out.resize(m_size);
+	if (m_size == 0)
+		return;
+
+	auto x = getX();
+	auto y = getY();
+	if (!m_deltaEncoded) {
+		for (size_t i = 0; i < m_size; i++) {
+			out[i] = { m_origin.x + x[i] * m_step, m_origin.y + y[i] * m_step };
+		}
+		return;
+	}
+
+	auto dx = getDeltaX();
+	auto dy = getDeltaY();
+	int qx = *x;
+	int qy = *y;
+	out[0] = { m_origin.x + qx * m_step, m_origin.y + qy * m_step };
+	for (size_t i = 1; i < m_size; i++) {
+		qx += dx[i - 1];
+		qy += dy[i - 1];
+		out[i] = { m_origin.x + qx * m_step, m_origin.y + qy * m_step };
+	}
+}
+
+std::vector<Point2D<float>> QuantizedStroke::decode() const {
+	std::vector<Point2D<float>> out;
+	decode(out);
+	return out;
+}
+
+bool QuantizedStroke::hitTest(Point2D<float> p, float radius) const {
+	if (m_size == 0)
+		return false;
+
+	// cheap test with the bounding box first
+	Rect2D<float> box(m_boundingBox.upperleft - Point2D<float>(radius, radius), m_boundingBox.width + 2 * radius, m_boundingBox.height + 2 * radius);
+	if (!box.intersects(p))
+		return false;
+
+	// transform the point into the quantized space
+	float qx = (p.x - m_origin.x) / m_step;
+	float qy = (p.y - m_origin.y) / m_step;
+	float r = radius / m_step;
+
+	if (!m_deltaEncoded)
+		return hitTestSegments(getX(), getY(), m_size, qx, qy, r * r);
+
+	// decode the deltas in chunks. The last point of a chunk is the first point of the next one
+	uint16_t x[DECODE_CHUNK_SIZE + 1];
+	uint16_t y[DECODE_CHUNK_SIZE + 1];
+	x[0] = *getX();
+	y[0] = *getY();
+	auto dx = getDeltaX();
+	auto dy = getDeltaY();
+
+	size_t i = 1;
+	while (i < m_size) {
+		size_t count = min(DECODE_CHUNK_SIZE, m_size - i);
+		for (size_t k = 0; k < count; k++) {
+			x[k + 1] = (uint16_t)(x[k] + dx[i - 1 + k]);
+			y[k + 1] = (uint16_t)(y[k] + dy[i - 1 + k]);
+		}
+		if (hitTestSegments(x, y, count + 1, qx, qy, r * r))
+			return true;
+
+		x[0] = x[count];
+		y[0] = y[count];
+		i += count;
+	}
+
+	return false;
+}
+
+size_t QuantizedStroke::getMemorySize() const {
+	return sizeof(QuantizedStroke) + m_data.capacity();
+}
+
+QuantizedStroke::Header QuantizedStroke::getHeader() const {
+	Header h;
+	h.m_originX = m_origin.x;
+	h.m_originY = m_origin.y;
+	h.m_step = m_step;
+	h.m_boundingBox[0] = m_boundingBox.upperleft.x;
+	h.m_boundingBox[1] = m_boundingBox.upperleft.y;
+	h.m_boundingBox[2] = m_boundingBox.width;
+	h.m_boundingBox[3] = m_boundingBox.height;
+	h.m_size = (uint32_t)m_size;
+	h.m_deltaEncoded = m_deltaEncoded ? 1 : 0;
+	return h;
+}
+
+const byte* QuantizedStroke::getData() const {
+	return m_view != nullptr ? m_view : m_data.data();
+}
+
+size_t QuantizedStroke::getDataSize() const {
+	return getDataSize(getHeader());
+}
+
+size_t QuantizedStroke::getDataSize(const Header& h) {
+	if (h.m_size == 0)
+		return 0;
+	if (h.m_deltaEncoded)
+		return 2 * sizeof(uint16_t) + 2 * ((size_t)h.m_size - 1);
+	return 2 * sizeof(uint16_t) * (size_t)h.m_size;
+}
+
+QuantizedStroke QuantizedStroke::fromView(const Header& h, const byte* data) {
+	QuantizedStroke s;
+	s.m_origin = Point2D<float>(h.m_originX, h.m_originY);
+	s.m_step = h.m_step;
+	s.m_boundingBox = Rect2D<float>(Point2D<float>(h.m_boundingBox[0], h.m_boundingBox[1]), h.m_boundingBox[2], h.m_boundingBox[3]);
+	s.m_size = h.m_size;
+	s.m_deltaEncoded = h.m_deltaEncoded != 0;
+	s.m_view = data;
+	return s;
+}
+
+bool QuantizedStroke::isView() const {
+	return m_view != nullptr;
+}
+
+void QuantizedStroke::detach() {
+	if (m_view == nullptr)
+		return;
+	m_data.assign(m_view, m_view + getDataSize());
+	m_view = nullptr;
+}
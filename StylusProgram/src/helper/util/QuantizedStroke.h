@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "Util.h"
+
+#ifndef QUANTIZED_STROKE_H
+#define QUANTIZED_STROKE_H
+
+// Compact storage for the points of a stroke. The points are quantized to 16 bit fixed point numbers relative to
+// the bounding box of the stroke. If the distance between the points is small enough only the first point is saved
+// and every other point is stored as an 8 bit delta to the previous one.
+// Absolute encoding needs 4 bytes per point, delta encoding 2 bytes. A Point2D<float> needs 8 bytes
+class QuantizedStroke {
+public:
+	// everything except the point data. It is used to store the stroke in a file
+	struct Header {
+		float m_originX = 0;
+		float m_originY = 0;
+		float m_step = 1;
+		// x, y, width, height
+		float m_boundingBox[4] = {};
+		uint32_t m_size = 0;
+		uint32_t m_deltaEncoded = 0;
+	};
+
+private:
+	// the biggest allowed quantization step in the delta encoding (in page units)
+	static constexpr float MAX_DELTA_STEP = 1.0f / 64.0f;
+
+	Point2D<float> m_origin;
+	// the size of one quantization step in page units
+	float m_step = 1;
+	Rect2D<float> m_boundingBox;
+	size_t m_size = 0;
+	bool m_deltaEncoded = false;
+
+	// absolute encoding: [uint16 x * size][uint16 y * size]
+	// delta encoding:    [uint16 x][uint16 y][int8 dx * (size - 1)][int8 dy * (size - 1)]
+	std::vector<byte> m_data;
+	// if set the point data is owned by someone else (e.g. a mapped file) and m_data is empty
+	const byte* m_view = nullptr;
+
+	const uint16_t* getX() const;
+	const uint16_t* getY() const;
+	const int8_t* getDeltaX() const;
+	const int8_t* getDeltaY() const;
+public:
+	QuantizedStroke() = default;
+	QuantizedStroke(const std::vector<Point2D<float>>& points);
+
+	size_t size() const;
+	bool isDeltaEncoded() const;
+	Rect2D<float> getBoundingBox() const;
+
+	// decodes all points
+	void decode(std::vector<Point2D<float>>& out) const;
+	std::vector<Point2D<float>> decode() const;
+
+	// returns true if p is closer than radius to the line going through all points
+	bool hitTest(Point2D<float> p, float radius) const;
+
+	// the amount of memory used by this stroke in bytes. Viewed data isn't counted
+	size_t getMemorySize() const;
+
+	Header getHeader() const;
+	// the encoded points
+	const byte* getData() const;
+	size_t getDataSize() const;
+	// the size of the encoded points described by the header
+	static size_t getDataSize(const Header& h);
+
+	// creates a stroke that uses the data without copying it. The data has to outlive the stroke
+	static QuantizedStroke fromView(const Header& h, const byte* data);
+	bool isView() const;
+	// copies the viewed data so the stroke owns it
+	void detach();
+};
+
+#endif // !QUANTIZED_STROKE_H
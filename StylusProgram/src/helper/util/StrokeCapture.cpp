@@ -0,0 +1,149 @@
+#include "StrokeCapture.h"
+#include "StrokeGeometry.h"
+
+void StrokeCapture::setPages(size_t count, PageCallback getPage) {
+	m_pageCount = count;
+	m_getPage = getPage;
+}
+
+void StrokeCapture::setCallbacks(LineCallback line, StrokeCallback finished) {
+	m_line = line;
+	m_finished = finished;
+}
+
+void StrokeCapture::setFilterSettings(const StrokeFilter::Settings& s) {
+	m_settings = s;
+}
+
+void StrokeCapture::setFilterScale(float scale) {
+	m_filterScale = scale;
+}
+
+void StrokeCapture::beginStroke(DynamicStroke& s, Point2D<float> p, byte pressure, UINT64 timestamp, UINT32 id) {
+	s.m_stroke.m_page = findPage(p);
+	if (s.m_stroke.m_page != -1)
+		addFilteredPoint(s, p, pressure, timestamp, id);
+}
+
+void StrokeCapture::resetStroke(DynamicStroke& s) {
+	m_droppedSamples += s.m_filter.getDroppedSamples();
+	m_totalSamples += s.m_filter.getTotalSamples();
+
+	s.m_stroke = Stroke();
+	// the thresholds of the filter are in screen pixels so they have to be converted into document space
+	s.m_filter.setSettings(m_settings);
+	s.m_filter.reset(m_filterScale);
+}
+
+void StrokeCapture::addFilteredPoint(DynamicStroke& s, Point2D<float> p, byte pressure, UINT64 timestamp, UINT32 id) {
+	auto& points = s.m_stroke.m_points;
+	auto& pressures = s.m_stroke.m_pressure;
+	auto offset = getPage(s.m_stroke.m_page).upperleft;
+	p -= offset;
+
+	// the filter needs the timestamp in seconds
+	switch (s.m_filter.filter(p, timestamp / 1e9)) {
+	case StrokeFilter::DROPPED:
+		return;
+	case StrokeFilter::ADDED:
+		if (points.size() != 0 && m_line)
+			m_line(id, points.back() + offset, p + offset, pressure, timestamp, false);
+		points.push_back(p);
+		pressures.push_back(pressure);
+		return;
+	case StrokeFilter::MERGED:
+		// the point lies on the same line as the last one so just move the last one
+		if (m_line)
+			m_line(id, points.back() + offset, p + offset, pressure, timestamp, true);
+		points.back() = p;
+		pressures.back() = pressure;
+		return;
+	}
+}
+
+void StrokeCapture::finishStroke(DynamicStroke& s, UINT32 id) {
+	s.m_stroke.m_droppedSamples = s.m_filter.getDroppedSamples();
+	s.m_stroke.m_totalSamples = s.m_filter.getTotalSamples();
+	if (s.m_stroke.m_points.size() == 0 || !m_finished)
+		return;
+	// the dynamic vector grew with every point
+	s.m_stroke.m_pressure.shrink_to_fit();
+	m_finished(id, std::move(s.m_stroke));
+}
+
+void StrokeCapture::startStroke(Point2D<float> p, UINT32 id, UINT32 pressure, UINT64 timestamp) {
+	auto& s = m_dynamicStroke[id];
+	resetStroke(s);
+	beginStroke(s, p, compressPressure(pressure), timestamp, id);
+}
+
+void StrokeCapture::addStroke(Point2D<float> p, UINT32 id, UINT32 pressure, UINT64 timestamp) {
+	auto it = m_dynamicStroke.find(id);
+	if (it == m_dynamicStroke.end())
+		return;
+	auto& s = it->second;
+
+	// the stroke didn't reach a page yet
+	if (s.m_stroke.m_points.size() == 0) {
+		beginStroke(s, p, compressPressure(pressure), timestamp, id);
+		return;
+	}
+
+	if (getPage(s.m_stroke.m_page).intersects(p)) {
+		addFilteredPoint(s, p, compressPressure(pressure), timestamp, id);
+		return;
+	}
+
+	// the point left the page so the stroke ends there. A new one starts once the pointer is on a page again
+	finishStroke(s, id);
+	resetStroke(s);
+}
+
+void StrokeCapture::endStroke(Point2D<float> p, UINT32 id, UINT64 timestamp) {
+	auto it = m_dynamicStroke.find(id);
+	if (it == m_dynamicStroke.end())
+		return;
+	auto& s = it->second;
+	auto& points = s.m_stroke.m_points;
+	auto& pressures = s.m_stroke.m_pressure;
+
+	if (points.size() != 0) {
+		auto page = getPage(s.m_stroke.m_page);
+		auto localp = p - page.upperleft;
+		if (page.intersects(p) && points.back().distance(localp) > 0) {
+			// the pressure of the pen is usually zero when it is lifted so keep the last one
+			if (m_line)
+				m_line(id, points.back() + page.upperleft, p, pressures.back(), timestamp, false);
+			points.push_back(localp);
+			pressures.push_back(pressures.back());
+		}
+		finishStroke(s, id);
+	}
+
+	resetStroke(s);
+	m_dynamicStroke.erase(it);
+}
+
+bool StrokeCapture::isStrokeInProgress() const {
+	return m_dynamicStroke.size() != 0;
+}
+
+long StrokeCapture::findPage(Point2D<float> p) const {
+	for (size_t i = 0; i < m_pageCount; i++) {
+		if (getPage(i).intersects(p))
+			return (long)i;
+	}
+	return -1;
+}
+
+Rect2D<float> StrokeCapture::getPage(size_t page) const {
+	return m_getPage(page);
+}
+
+size_t StrokeCapture::getDroppedSamples() const {
+	return m_droppedSamples;
+}
+
+size_t StrokeCapture::getTotalSamples() const {
+	return m_totalSamples;
+}
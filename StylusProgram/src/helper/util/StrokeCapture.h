@@ -0,0 +1,105 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <vector>
+#include "Util.h"
+#include "StrokeFilter.h"
+
+#ifndef STROKE_CAPTURE_H
+#define STROKE_CAPTURE_H
+
+// The platform independent part of the stroke input. It finds the page under the pointer, runs the samples through
+// the stroke filter and decides where a stroke starts and ends. The AnnotationHandler draws and stores what comes out
+// of it and the headless tools use the same class so they measure what the program does.
+// The points that go in are in document space, the strokes that come out are relative to their page
+class StrokeCapture {
+public:
+	struct Stroke {
+		std::vector<Point2D<float>> m_points;
+		// the pressure of every point
+		std::vector<byte> m_pressure;
+		long m_page = -1;
+		size_t m_droppedSamples = 0;
+		size_t m_totalSamples = 0;
+	};
+
+	// the position and size of the page in document space
+	using PageCallback = std::function<Rect2D<float>(size_t page)>;
+	// A new line was added to the stroke or its last line was moved (merged) to the new point. The points are in
+	// document space and the timestamp is the one of the new point
+	using LineCallback = std::function<void(UINT32 id, Point2D<float> from, Point2D<float> to, byte pressure, UINT64 timestamp, bool merged)>;
+	// the stroke is finished. It has at least one point
+	using StrokeCallback = std::function<void(UINT32 id, Stroke&& stroke)>;
+
+private:
+	struct DynamicStroke {
+		Stroke m_stroke;
+		StrokeFilter m_filter;
+	};
+
+	size_t m_pageCount = 0;
+	PageCallback m_getPage;
+	LineCallback m_line;
+	StrokeCallback m_finished;
+
+	std::map<UINT32, DynamicStroke> m_dynamicStroke;
+	StrokeFilter::Settings m_settings;
+	// converts screen pixels into document space
+	float m_filterScale = 1;
+	size_t m_droppedSamples = 0;
+	size_t m_totalSamples = 0;
+
+	// starts a new stroke on the page of the point
+	void beginStroke(DynamicStroke& s, Point2D<float> p, byte pressure, UINT64 timestamp, UINT32 id);
+	void resetStroke(DynamicStroke& s);
+	// runs the point through the stroke filter and adds it to the stroke. The page of the stroke has to be set
+	void addFilteredPoint(DynamicStroke& s, Point2D<float> p, byte pressure, UINT64 timestamp, UINT32 id);
+	void finishStroke(DynamicStroke& s, UINT32 id);
+
+public:
+	StrokeCapture() = default;
+
+	void setPages(size_t count, PageCallback getPage);
+	// the callbacks are called from startStroke, addStroke and endStroke
+	void setCallbacks(LineCallback line, StrokeCallback finished);
+	void setFilterSettings(const StrokeFilter::Settings& s);
+	// The size of one screen pixel in document space. Used for the strokes that are started after the call
+	void setFilterScale(float scale);
+
+	// the pressure is the raw pressure of the pointer (0 - 1024) and the timestamp is in nanoseconds
+	void startStroke(Point2D<float> p, UINT32 id, UINT32 pressure, UINT64 timestamp);
+	void addStroke(Point2D<float> p, UINT32 id, UINT32 pressure, UINT64 timestamp);
+	// The last point doesn't go through the filter so the stroke ends exactly where the pen was lifted. Every stroke
+	// with at least one point is kept, a single point is drawn as a dot
+	void endStroke(Point2D<float> p, UINT32 id, UINT64 timestamp);
+
+	bool isStrokeInProgress() const;
+	// the page the point is on or -1
+	long findPage(Point2D<float> p) const;
+	Rect2D<float> getPage(size_t page) const;
+
+	size_t getDroppedSamples() const;
+	size_t getTotalSamples() const;
+
+	// Removes every stroke of the container the eraser touches. The point is relative to the page and the eraser
+	// touches a stroke if it is closer than the eraser width plus the stroke width to its line. erased is called before
+	// the stroke is removed. Works with every container of strokes that have m_points and m_strokeWidth
+	template<typename Strokes, typename Erased>
+	static size_t erase(Strokes& strokes, Point2D<float> p, float eraserWidth, Erased erased) {
+		size_t count = 0;
+		auto it = strokes.begin();
+		while (it != strokes.end()) {
+			if (it->m_points.hitTest(p, eraserWidth + it->m_strokeWidth)) {
+				erased(*it);
+				it = strokes.erase(it);
+				count++;
+				continue;
+			}
+			++it;
+		}
+		return count;
+	}
+};
+
+#endif // !STROKE_CAPTURE_H
@@ -0,0 +1,121 @@
+#include "StrokeFilter.h"
+
+constexpr float PI = 3.14159265358979f;
+
+float StrokeFilter::LowPassFilter::filter(float value, float alpha) {
+	if (!m_initialized) {
+		m_initialized = true;
+		m_lastValue = value;
+		return value;
+	}
+	m_lastValue = alpha * value + (1 - alpha) * m_lastValue;
+	return m_lastValue;
+}
+
+StrokeFilter::StrokeFilter(const Settings& s) {
+	m_settings = s;
+}
+
+float StrokeFilter::alpha(float cutoff, float dt) {
+	float tau = 1.0f / (2 * PI * cutoff);
+	return 1.0f / (1.0f + tau / dt);
+}
+
+Point2D<float> StrokeFilter::smooth(Point2D<float> p, double timestamp) {
+	// the first sample can't be filtered
+	if (m_lastTimestamp < 0 || timestamp <= m_lastTimestamp) {
+		// still feed the filters so they have a starting value
+		if (m_lastTimestamp < 0) {
+			m_x.filter(p.x, 1);
+			m_y.filter(p.y, 1);
+			m_dx.filter(0, 1);
+			m_dy.filter(0, 1);
+			m_lastTimestamp = timestamp;
+		}
+		return p;
+	}
+
+	float dt = (float)(timestamp - m_lastTimestamp);
+	m_lastTimestamp = timestamp;
+
+	// estimate the speed of the pen
+	float dx = m_dx.filter((p.x - m_x.m_lastValue) / dt, alpha(m_settings.m_derivateCutoff, dt));
+	float dy = m_dy.filter((p.y - m_y.m_lastValue) / dt, alpha(m_settings.m_derivateCutoff, dt));
+
+	// the faster the pen moves the less it should be smoothed. The speed is converted into screen space
+	float cutoffx = m_settings.m_minCutoff + m_settings.m_beta * std::fabs(dx) / m_scale;
+	float cutoffy = m_settings.m_minCutoff + m_settings.m_beta * std::fabs(dy) / m_scale;
+
+	return { m_x.filter(p.x, alpha(cutoffx, dt)), m_y.filter(p.y, alpha(cutoffy, dt)) };
+}
+
+void StrokeFilter::reset(float scale) {
+	m_scale = scale;
+
+	m_x = LowPassFilter();
+	m_y = LowPassFilter();
+	m_dx = LowPassFilter();
+	m_dy = LowPassFilter();
+	m_lastTimestamp = -1;
+
+	m_storedPoints = 0;
+	m_droppedSamples = 0;
+	m_totalSamples = 0;
+}
+
+StrokeFilter::RESULT StrokeFilter::filter(Point2D<float>& p, double timestamp) {
+	m_totalSamples++;
+
+	if (m_settings.m_smoothing)
+		p = smooth(p, timestamp);
+
+	// the first point is always needed
+	if (m_storedPoints == 0) {
+		m_last = p;
+		m_storedPoints++;
+		return ADDED;
+	}
+
+	// sub pixel movement
+	if (m_last.distance(p) < m_settings.m_minDistance * m_scale) {
+		m_droppedSamples++;
+		return DROPPED;
+	}
+
+	// check if the last point is (nearly) on the line between the second last point and the new point
+	if (m_storedPoints >= 2) {
+		auto d1 = m_last - m_secondLast;
+		auto d2 = p - m_last;
+		float angle = std::fabs(std::atan2(d1.x * d2.y - d1.y * d2.x, d1.x * d2.x + d1.y * d2.y));
+
+		// don't let a merged segment grow forever or slow curves will be flattened
+		bool shortsegment = m_secondLast.distance(p) < m_settings.m_minDistance * m_scale * 32;
+
+		if (angle < m_settings.m_minAngle && shortsegment && pointToLineDistance(m_secondLast, p, m_last) < m_settings.m_maxDeviation * m_scale) {
+			m_last = p;
+			m_droppedSamples++;
+			return MERGED;
+		}
+	}
+
+	m_secondLast = m_last;
+	m_last = p;
+	m_storedPoints++;
+	return ADDED;
+}
+
+size_t StrokeFilter::getDroppedSamples() const {
+	return m_droppedSamples;
+}
+
+size_t StrokeFilter::getTotalSamples() const {
+	return m_totalSamples;
+}
+
+const StrokeFilter::Settings& StrokeFilter::getSettings() const {
+	return m_settings;
+}
+
+void StrokeFilter::setSettings(const Settings& s) {
+	m_settings = s;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Util.h"
+
+#ifndef STROKE_FILTER_H
+#define STROKE_FILTER_H
+
+// Streaming filter that sits in front of the stroke storage. It drops pointer samples that don't add any
+// visible information (sub pixel jitter and points on a straight line) and can optionally smooth the input
+// with a One Euro filter (https://gery.casiez.net/1euro/)
+class StrokeFilter {
+public:
+	struct Settings {
+		// samples closer than this to the last stored point are dropped. In screen pixels
+		float m_minDistance = 0.75f;
+		// if the direction changes less than this (in radians) the last point is merged with the new one
+		float m_minAngle = 0.035f;
+		// a merged point may never be further away than this from the resulting line. In screen pixels
+		float m_maxDeviation = 0.25f;
+
+		// One Euro filter
+		bool m_smoothing = false;
+		float m_minCutoff = 1.0f;
+		float m_beta = 0.007f;
+		float m_derivateCutoff = 1.0f;
+	};
+
+	enum RESULT {
+		// the point should be thrown away
+		DROPPED,
+		// the point should be appended to the stroke
+		ADDED,
+		// the point should replace the last point of the stroke
+		MERGED
+	};
+
+private:
+	struct LowPassFilter {
+		bool m_initialized = false;
+		float m_lastValue = 0;
+
+		float filter(float value, float alpha);
+	};
+
+	Settings m_settings;
+	// factor to convert screen pixels into the coordinate space of the samples
+	float m_scale = 1;
+
+	LowPassFilter m_x, m_y, m_dx, m_dy;
+	double m_lastTimestamp = -1;
+
+	// the last two points that were stored
+	Point2D<float> m_last;
+	Point2D<float> m_secondLast;
+	size_t m_storedPoints = 0;
+
+	size_t m_droppedSamples = 0;
+	size_t m_totalSamples = 0;
+
+	static float alpha(float cutoff, float dt);
+	Point2D<float> smooth(Point2D<float> p, double timestamp);
+public:
+	StrokeFilter() = default;
+	StrokeFilter(const Settings& s);
+
+	// resets the filter so a new stroke can be started. The scale converts screen pixels into sample space
+	void reset(float scale = 1);
+
+	// Filters the sample. The timestamp is in seconds and only needed for smoothing.
+	// The point may be altered if smoothing is enabled
+	RESULT filter(Point2D<float>& p, double timestamp);
+
+	size_t getDroppedSamples() const;
+	size_t getTotalSamples() const;
+
+	const Settings& getSettings() const;
+	void setSettings(const Settings& s);
+};
+
+#endif // !STROKE_FILTER_H
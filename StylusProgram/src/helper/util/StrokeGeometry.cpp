@@ -0,0 +1,189 @@
+#include "StrokeGeometry.h"
+
+constexpr float PI = 3.14159265358979f;
+
+// width factor at zero and at full pressure
+constexpr float MIN_PRESSURE_WIDTH = 0.3f;
+constexpr float MAX_PRESSURE_WIDTH = 1.7f;
+
+byte compressPressure(UINT32 pressure) {
+	// no pressure information
+	if (pressure == 0)
+		return PRESSURE_DEFAULT;
+	return (byte)min((pressure * PRESSURE_MAX + 512) / 1024, (UINT32)PRESSURE_MAX);
+}
+
+float pressureToWidth(float width, byte pressure) {
+	float p = (float)pressure / PRESSURE_MAX;
+	return width * (MIN_PRESSURE_WIDTH + (MAX_PRESSURE_WIDTH - MIN_PRESSURE_WIDTH) * p);
+}
+
+void calcBoundingBox(Rect2D<float>& a, Point2D<float> p) {
+	if (a.upperleft.x > p.x) {
+		a.width += std::abs(p.x - a.upperleft.x);
+		a.upperleft.x = p.x;
+	}
+	if (a.upperleft.y > p.y) {
+		a.height += std::abs(p.y - a.upperleft.y);
+		a.upperleft.y = p.y;
+	}
+	a.width = max(a.width, std::abs(p.x - a.upperleft.x));
+	a.height = max(a.height, std::abs(p.y - a.upperleft.y));
+}
+
+Rect2D<float> getBoundingBox(const std::vector<Point2D<float>>* points) {
+	Rect2D<float> r(points->at(0), 0, 0);
+	for (size_t i = 0; i < points->size(); i++) {
+		calcBoundingBox(r, points->at(i));
+	}
+	return r;
+}
+
+void solveTridiagonal(std::vector<float>& a,
+					  std::vector<float>& b,
+					  std::vector<float>& c,
+					  std::vector<Point2D<float>>& d,
+					  std::vector<Point2D<float>>& x) {
+	for (size_t i = 1; i < d.size(); i++) {
+		auto w = a[i - 1] / b[i - 1];
+		b[i] = b[i] - w * c[i - 1];
+		d[i] = d[i] - w * d[i - 1];
+	}
+
+	x[d.size() - 1] = d[d.size() - 1] / b[d.size() - 1];
+	for (int i = d.size() - 2; i >= 0; i--) {
+		x[i] = (d[i] - c[i] * x[i + 1]) / b[i];
+	}
+}
+
+void calcBezierPoints(const std::vector<Point2D<float>>* points, std::vector<Point2D<float>>& a, std::vector<Point2D<float>>& b) {
+	//create the vectos
+	auto n = points->size() - 1;
+	std::vector<Point2D<float>> p(n);
+
+	p[0] = points->at(0) + 2 * points->at(1);
+	for (size_t i = 1; i < n - 1; i++) {
+		p[i] = 2 * (2 * points->at(i) + points->at(i + 1));
+	}
+	p[n - 1] = 8 * points->at(n - 1) + points->at(n);
+
+	// matrix
+	std::vector<float> m_a(n - 1, 1);
+	std::vector<float> m_b(n, 4);
+	std::vector<float> m_c(n - 1, 1);
+	m_a[n - 2] = 2;
+	m_b[0] = 2;
+	m_b[n - 1] = 7;
+
+	solveTridiagonal(m_a, m_b, m_c, p, a);
+
+	b[n - 1] = (a[n - 1] + points->at(n)) / 2.0;
+	for (size_t i = 0; i < n - 1; i++) {
+		b[i] = 2 * points->at(i + 1) - a[i + 1];
+	}
+}
+
+static Point2D<float> evalBezier(Point2D<float> p0, Point2D<float> p1, Point2D<float> p2, Point2D<float> p3, float t) {
+	float u = 1 - t;
+	return (u * u * u) * p0 + (3 * u * u * t) * p1 + (3 * u * t * t) * p2 + (t * t * t) * p3;
+}
+
+static Point2D<float> normalize(Point2D<float> p) {
+	float l = p.distance();
+	if (l == 0)
+		return { 0, 0 };
+	return { p.x / l, p.y / l };
+}
+
+std::vector<Point2D<float>> tessellateStroke(const std::vector<Point2D<float>>* points, const std::vector<byte>* pressure, float width) {
+	auto getPressure = [&](size_t i) {
+		if (pressure == nullptr || i >= pressure->size())
+			return PRESSURE_DEFAULT;
+		return pressure->at(i);
+	};
+
+	std::vector<Point2D<float>> outline;
+	if (points == nullptr || points->size() == 0)
+		return outline;
+
+	// sample the curve. Every sample has a position and a half width
+	std::vector<Point2D<float>> samples;
+	std::vector<float> halfwidth;
+	samples.reserve(points->size() * 2);
+	halfwidth.reserve(points->size() * 2);
+
+	if (points->size() < 3) {
+		for (size_t i = 0; i < points->size(); i++) {
+			samples.push_back(points->at(i));
+			halfwidth.push_back(pressureToWidth(width, getPressure(i)) / 2);
+		}
+	}
+	else {
+		std::vector<Point2D<float>> a(points->size() - 1);
+		std::vector<Point2D<float>> b(points->size() - 1);
+		calcBezierPoints(points, a, b);
+
+		for (size_t i = 0; i < points->size() - 1; i++) {
+			auto& p0 = points->at(i);
+			auto& p3 = points->at(i + 1);
+			float w0 = pressureToWidth(width, getPressure(i)) / 2;
+			float w1 = pressureToWidth(width, getPressure(i + 1)) / 2;
+
+			// the points are already close together so only longer segments need to be subdivided
+			size_t steps = (size_t)std::ceil(p0.distance(p3) / max(width, 1.0f));
+			steps = min(max(steps, (size_t)1), (size_t)16);
+			for (size_t s = 0; s < steps; s++) {
+				float t = (float)s / steps;
+				samples.push_back(evalBezier(p0, a[i], b[i], p3, t));
+				halfwidth.push_back(w0 + (w1 - w0) * t);
+			}
+		}
+		samples.push_back(points->back());
+		halfwidth.push_back(pressureToWidth(width, getPressure(points->size() - 1)) / 2);
+	}
+
+	// calculate the direction of the stroke at every sample
+	auto n = samples.size();
+	std::vector<Point2D<float>> tangent(n);
+	Point2D<float> lastTangent = { 1, 0 };
+	for (size_t i = 0; i < n; i++) {
+		auto t = normalize(samples[min(i + 1, n - 1)] - samples[i > 0 ? i - 1 : 0]);
+		// samples on top of each other keep the last direction
+		if (t.x == 0 && t.y == 0)
+			t = lastTangent;
+		tangent[i] = t;
+		lastTangent = t;
+	}
+
+	const size_t capsteps = 8;
+	outline.reserve(n * 2 + capsteps * 2);
+
+	// left side
+	for (size_t i = 0; i < n; i++) {
+		Point2D<float> normal(-tangent[i].y, tangent[i].x);
+		outline.push_back(samples[i] + halfwidth[i] * normal);
+	}
+	// round cap at the end
+	{
+		Point2D<float> normal(-tangent[n - 1].y, tangent[n - 1].x);
+		for (size_t j = 1; j < capsteps; j++) {
+			float angle = PI * j / capsteps;
+			outline.push_back(samples[n - 1] + (std::cos(angle) * halfwidth[n - 1]) * normal + (std::sin(angle) * halfwidth[n - 1]) * tangent[n - 1]);
+		}
+	}
+	// right side
+	for (size_t i = n; i-- > 0;) {
+		Point2D<float> normal(-tangent[i].y, tangent[i].x);
+		outline.push_back(samples[i] - halfwidth[i] * normal);
+	}
+	// round cap at the start
+	{
+		Point2D<float> normal(-tangent[0].y, tangent[0].x);
+		for (size_t j = 1; j < capsteps; j++) {
+			float angle = PI * j / capsteps;
+			outline.push_back(samples[0] - (std::cos(angle) * halfwidth[0]) * normal - (std::sin(angle) * halfwidth[0]) * tangent[0]);
+		}
+	}
+
+	return outline;
+}
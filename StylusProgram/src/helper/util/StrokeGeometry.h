@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include "Util.h"
+
+#ifndef STROKE_GEOMETRY_H
+#define STROKE_GEOMETRY_H
+
+// the pressure of every point is stored in one byte
+constexpr byte PRESSURE_MAX = 255;
+// the pressure that is used if the pointer doesn't report any pressure (e.g. a mouse). It results in the normal stroke width
+constexpr byte PRESSURE_DEFAULT = 128;
+
+// converts the pressure reported by the pointer (0 - 1024) into the compact representation
+byte compressPressure(UINT32 pressure);
+// returns the width of the stroke at the given pressure. The default pressure will return the width
+float pressureToWidth(float width, byte pressure);
+
+void calcBoundingBox(Rect2D<float>& a, Point2D<float> p);
+Rect2D<float> getBoundingBox(const std::vector<Point2D<float>>* points);
+
+// https://www.quantstart.com/articles/Tridiagonal-Matrix-Algorithm-Thomas-Algorithm-in-C/
+void solveTridiagonal(std::vector<float>& a,
+					  std::vector<float>& b,
+					  std::vector<float>& c,
+					  std::vector<Point2D<float>>& d,
+					  std::vector<Point2D<float>>& x);
+
+// calculates the control points a and b of the bezier curves going through all the points. Needs at least 3 points
+//https://towardsdatascience.com/b%C3%A9zier-interpolation-8033e9a262c2
+void calcBezierPoints(const std::vector<Point2D<float>>* points, std::vector<Point2D<float>>& a, std::vector<Point2D<float>>& b);
+
+// Will tessellate the stroke into the closed outline of a variable width line with round caps. The outline follows the
+// bezier curves through the points and the width of every point is defined by the pressure.
+// The outline may overlap itself so it has to be filled with the non zero winding rule
+std::vector<Point2D<float>> tessellateStroke(const std::vector<Point2D<float>>* points, const std::vector<byte>* pressure, float width);
+
+#endif // !STROKE_GEOMETRY_H
@@ -0,0 +1,143 @@
+#include "Trace.h"
+#include "FileHandler.h"
+#include "Logger.h"
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+std::atomic<bool> Trace::m_enabled = true;
+
+// the events of one thread. The lock is only contended while the events are exported
+struct TraceBuffer {
+	std::mutex m_lock;
+	std::vector<Trace::Event> m_events;
+	// the amount of events that were ever added. The oldest ones are overwritten
+	size_t m_count = 0;
+	UINT32 m_threadId = 0;
+	std::string m_threadName;
+};
+
+static std::mutex buffersLock;
+// the buffers stay alive after their thread ended so the events can still be exported
+static std::vector<std::shared_ptr<TraceBuffer>> buffers;
+
+static TraceBuffer* getThreadBuffer() {
+	thread_local TraceBuffer* buffer = nullptr;
+	if (buffer != nullptr)
+		return buffer;
+
+	auto b = std::make_shared<TraceBuffer>();
+	b->m_events.resize(Trace::EVENTS_PER_THREAD);
+
+	std::lock_guard<std::mutex> lock(buffersLock);
+	b->m_threadId = (UINT32)buffers.size() + 1;
+	b->m_threadName = "Thread " + std::to_string(b->m_threadId);
+	buffers.push_back(b);
+	buffer = b.get();
+	return buffer;
+}
+
+Trace::Scope::Scope(const char* name, const char* category) {
+	m_name = name;
+	m_category = category;
+	if (isEnabled())
+		m_start = now();
+}
+
+Trace::Scope::~Scope() {
+	// nothing is timed if tracing was disabled when the scope started or has been disabled since
+	if (m_start == 0 || !isEnabled())
+		return;
+	auto end = now();
+	add(m_name, m_category, m_start, end - m_start);
+}
+
+UINT64 Trace::now() {
+	static auto start = std::chrono::steady_clock::now();
+	// never return 0 so it can be used as "not started"
+	return (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() + 1;
+}
+
+void Trace::setEnabled(bool b) {
+	m_enabled.store(b, std::memory_order_relaxed);
+}
+
+void Trace::add(const char* name, const char* category, UINT64 start, UINT64 duration) {
+	if (!isEnabled())
+		return;
+
+	auto buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer->m_lock);
+	buffer->m_events[buffer->m_count % EVENTS_PER_THREAD] = { name, category, start, duration };
+	buffer->m_count++;
+}
+
+void Trace::setThreadName(const std::string& name) {
+	auto buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer->m_lock);
+	buffer->m_threadName = name;
+}
+
+// the names are string literals from the source code so only quotes and backslashes have to be escaped
+static void appendJsonString(std::string& out, const char* s) {
+	out += '"';
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\')
+			out += '\\';
+		out += *s;
+	}
+	out += '"';
+}
+
+void Trace::exportChromeTrace(const std::wstring& path) {
+	std::string json;
+	json.reserve(1024 * 1024);
+	json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	size_t amount = 0;
+	char number[64];
+	std::vector<std::shared_ptr<TraceBuffer>> threads;
+	{
+		std::lock_guard<std::mutex> lock(buffersLock);
+		threads = buffers;
+	}
+
+	for (auto& buffer : threads) {
+		std::lock_guard<std::mutex> lock(buffer->m_lock);
+
+		// name the thread in the timeline
+		json += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + std::to_string(buffer->m_threadId) + ",\"args\":{\"name\":";
+		appendJsonString(json, buffer->m_threadName.c_str());
+		json += "}},\n";
+
+		size_t first = buffer->m_count > EVENTS_PER_THREAD ? buffer->m_count - EVENTS_PER_THREAD : 0;
+		for (size_t i = first; i < buffer->m_count; i++) {
+			auto& e = buffer->m_events[i % EVENTS_PER_THREAD];
+			json += "{\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(buffer->m_threadId) + ",\"name\":";
+			appendJsonString(json, e.m_name);
+			json += ",\"cat\":";
+			appendJsonString(json, e.m_category);
+			// the timestamps are in microseconds
+			snprintf(number, sizeof(number), ",\"ts\":%.3f,\"dur\":%.3f},\n", e.m_start / 1000.0, e.m_duration / 1000.0);
+			json += number;
+			amount++;
+		}
+	}
+
+	// remove the last comma
+	if (json.size() >= 2 && json[json.size() - 2] == ',')
+		json.erase(json.size() - 2, 1);
+	json += "]}\n";
+
+	FileHandler::saveFile(path, (byte*)json.data(), json.size());
+	LOG_INFO(L"Exported {} trace events to {}", amount, path);
+}
+
+void Trace::clear() {
+	std::lock_guard<std::mutex> lock(buffersLock);
+	for (auto& buffer : buffers) {
+		std::lock_guard<std::mutex> bufferlock(buffer->m_lock);
+		buffer->m_count = 0;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include "Util.h"
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// measures the time until the end of the scope. The name and the category have to be string literals
+#define TRACE_SCOPE(name, category) Trace::Scope TRACE_CONCAT(_traceScope, __LINE__)(name, category)
+
+// Records spans of time so a timeline can be exported in the Chrome trace event format
+// (https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU) and viewed in
+// chrome://tracing or https://ui.perfetto.dev. Every thread writes into its own ring so recording is cheap
+// and only the last events of every thread are kept
+class Trace {
+public:
+	// the amount of events every thread keeps
+	static constexpr size_t EVENTS_PER_THREAD = 1 << 16;
+
+	struct Event {
+		const char* m_name;
+		const char* m_category;
+		// in ns since the start of the program
+		UINT64 m_start;
+		UINT64 m_duration;
+	};
+
+	class Scope {
+		const char* m_name;
+		const char* m_category;
+		UINT64 m_start = 0;
+	public:
+		Scope(const char* name, const char* category);
+		~Scope();
+
+		Scope(const Scope& s) = delete;
+		Scope& operator=(const Scope& s) = delete;
+	};
+
+private:
+	static std::atomic<bool> m_enabled;
+
+public:
+	Trace() = delete;
+
+	// high resolution monotonic time in ns
+	static UINT64 now();
+
+	static bool isEnabled() {
+		return m_enabled.load(std::memory_order_relaxed);
+	}
+	static void setEnabled(bool b);
+
+	// adds an event that already ended
+	static void add(const char* name, const char* category, UINT64 start, UINT64 duration);
+	// the name of the calling thread in the timeline
+	static void setThreadName(const std::string& name);
+
+	// writes the events of all threads into a json file
+	static void exportChromeTrace(const std::wstring& path);
+	// removes all recorded events
+	static void clear();
+};
+
+#endif // !TRACE_H
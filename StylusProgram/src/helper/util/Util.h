@@ -4,8 +4,20 @@
 #include <vector>
 #include <chrono>
 
+#ifdef _WIN32
 #include <d2d1.h>
 #include "mupdf/fitz.h"
+#else
+// without windows only the platform independent parts are available (e.g. for the headless tools)
+#include <cstdint>
+#include <algorithm>
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef int64_t INT64;
+typedef uint64_t UINT64;
+using std::min;
+using std::max;
+#endif
 #include <cmath>
 
 typedef unsigned char byte;
@@ -22,9 +34,11 @@ struct Point2D {
 	Point2D& operator=(Point2D&& p) = default;
 
 	Point2D(T x, T y) : y(y), x(x) {}
+#ifdef _WIN32
 	Point2D(POINT p) : y(p.y), x(p.x) {}
 	Point2D(D2D1_POINT_2F p) : y(p.y), x(p.x) {}
 	Point2D(fz_point p) : y(p.y), x(p.x) {}
+#endif
 
 	template <typename G>
 	operator Point2D<G>() const {
@@ -40,9 +54,11 @@ struct Point2D {
 		return s;
 	}
 
+#ifdef _WIN32
 	operator fz_point() const {
 		return fz_make_point((float)x, (float)y);
 	}
+#endif
 
 	template<typename G>
 	Point2D<T>& operator*=(const Point2D<G>& other) {
@@ -79,6 +95,7 @@ struct Point2D {
 		return *this;
 	}
 
+#ifdef _WIN32
 	operator D2D1_POINT_2F() const {
 		return D2D1::Point2F(x, y);
 	}
@@ -86,6 +103,7 @@ struct Point2D {
 	operator D2D1_SIZE_F() const {
 		return D2D1::SizeF(x, y);
 	}
+#endif
 
 	Point2D<T> operator-() const {
 		return Point2D<T>(-x, -y);
@@ -236,6 +254,7 @@ struct Rect2D {
 		height = std::fabs(p1.y - p2.y);
 	}
 
+#ifdef _WIN32
 	Rect2D(RECT r) {
 		upperleft.x = r.left;
 		upperleft.y = r.top;
@@ -249,6 +268,7 @@ struct Rect2D {
 		width = r.x1 - r.x0;
 		height = r.y1 - r.y0;
 	}
+#endif
 
 	template <typename G>
 	Rect2D(Rect2D<G> r) {
@@ -262,6 +282,7 @@ struct Rect2D {
 		return width * height;
 	}
 
+#ifdef _WIN32
 	operator RECT() const {
 		RECT r;
 		r.left = upperleft.x;
@@ -287,6 +308,7 @@ struct Rect2D {
 	operator fz_rect() const {
 		return fz_make_rect((float)upperleft.x, (float)upperleft.y, (float)(upperleft.x + width), (float)(upperleft.y + height));
 	}
+#endif
 	
 	bool intersects(const Rect2D<T>& other) const {
 		return (upperleft.x < other.upperleft.x + other.width &&
@@ -309,6 +331,17 @@ struct Rect2D {
 		return result;
 	}
 
+	// the smallest rect that contains both rects
+	Rect2D<T> merge(const Rect2D<T>& other) const {
+		Rect2D<T> result;
+		result.upperleft.x = min(upperleft.x, other.upperleft.x);
+		result.upperleft.y = min(upperleft.y, other.upperleft.y);
+		result.width = max(upperleft.x + width, other.upperleft.x + other.width) - result.upperleft.x;
+		result.height = max(upperleft.y + height, other.upperleft.y + other.height) - result.upperleft.y;
+		return result;
+	}
+
+#ifdef _WIN32
 	RECT toNormalizedRect() const {
 		RECT r;
 		r.left = 0;
@@ -317,6 +350,7 @@ struct Rect2D {
 		r.bottom = height;
 		return r;
 	}
+#endif
 
 	operator std::wstring() const {
 		std::wstring s;
@@ -341,6 +375,12 @@ inline UINT64 TimeSince1970() {
 	return ms.time_since_epoch().count();
 }
 
+// monotonic time in seconds. Only useful to calculate time differences
+inline double TimeSinceStart() {
+	static auto start = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 template <class T>
 void SafeRelease(T** ppT) {
 	if (*ppT) {
@@ -1,5 +1,6 @@
 #include "WindowHandler.h"
 #include "util/Logger.h"
+#include "util/Trace.h"
 #include <WinUser.h>
 #include <Windowsx.h>
 #include <atlbase.h>
@@ -186,8 +187,26 @@ static std::vector<WindowHandler::VK> processUnknownKeys(bool pressed) {
 	return returnValue;
 }
 
+// how long ago the pointer captured the sample in nanoseconds
+static UINT64 getPointerAge(const tagPOINTER_INFO& pointerinfo) {
+	// the performance count is the most precise but not every device reports it
+	if (pointerinfo.PerformanceCount != 0) {
+		LARGE_INTEGER now, frequency;
+		QueryPerformanceCounter(&now);
+		QueryPerformanceFrequency(&frequency);
+		if ((UINT64)now.QuadPart < pointerinfo.PerformanceCount)
+			return 0;
+		return ((UINT64)now.QuadPart - pointerinfo.PerformanceCount) * 1000000000 / frequency.QuadPart;
+	}
+	// the message time only has a resolution of a few milliseconds
+	if (pointerinfo.dwTime != 0)
+		return (UINT64)(GetTickCount() - pointerinfo.dwTime) * 1000000;
+	return 0;
+}
+
 WindowHandler::POINTER_INFO WindowHandler::Window::parsePointerInfo(Window* w, WPARAM wParam, LPARAM lParam) {
 	WindowHandler::POINTER_INFO info;
+	info.timestamp = Trace::now();
 
 	info.id = GET_POINTERID_WPARAM(wParam);
 	POINTER_INPUT_TYPE pointerType = PT_POINTER;
@@ -235,6 +254,9 @@ WindowHandler::POINTER_INFO WindowHandler::Window::parsePointerInfo(Window* w, W
 	//info.pos = Point2D<float>(pointerinfo.ptPixelLocation);
 	info.pos = w->PxToDp(info.pos);
 
+	// the sample can be a lot older than the message if the input queue was busy
+	info.timestamp -= min(getPointerAge(pointerinfo), info.timestamp - 1);
+
 	return info;
 }
 
@@ -355,6 +377,8 @@ WindowHandler::Window::Window() {}
 
 WindowHandler::Window::~Window() {
 	delete m_renderContext;
+	if (m_frameTimer != nullptr)
+		CloseHandle(m_frameTimer);
 }
 
 bool WindowHandler::Window::init(std::wstring windowName, HINSTANCE instance) {
@@ -395,8 +419,12 @@ bool WindowHandler::Window::init(std::wstring windowName, HINSTANCE instance) {
 	}
 
 
-	Logger::add(L"DPI: " + std::to_wstring(GetDpiForSystem()));
+	LOG_INFO(L"DPI: {}", GetDpiForSystem());
 	m_dpi = GetDpiForWindow(m_hwnd);
+
+	m_frameTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (m_frameTimer == nullptr)
+		LOG_WARNING(L"Couldn't create a high resolution timer. The frames are timed with the system timer");
 	
 	// Create a new Render Context
 	m_renderContext = new RenderHandler::Direct2DContext(this);
@@ -449,6 +477,43 @@ void WindowHandler::Window::getMsg(bool blocking) {
 	}
 }
 
+void WindowHandler::Window::waitForMsg(UINT64 timeout) {
+	if (timeout == 0) {
+		getMsg(false);
+		return;
+	}
+
+	if (timeout != ~(UINT64)0 && m_frameTimer != nullptr) {
+		// a negative due time is relative and in 100ns
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)((timeout + 99) / 100);
+		if (SetWaitableTimerEx(m_frameTimer, &due, 0, nullptr, nullptr, nullptr, 0)) {
+			MsgWaitForMultipleObjectsEx(1, &m_frameTimer, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+			CancelWaitableTimer(m_frameTimer);
+			getMsg(false);
+			return;
+		}
+	}
+
+	// round up so the wait doesn't end right before the frame is due
+	DWORD ms = timeout == ~(UINT64)0 ? INFINITE : (DWORD)min((timeout + 999'999) / 1'000'000, (UINT64)INFINITE - 1);
+	MsgWaitForMultipleObjectsEx(0, nullptr, ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+	getMsg(false);
+}
+
+UINT64 WindowHandler::Window::getRefreshInterval() const {
+	MONITORINFOEX info = {};
+	info.cbSize = sizeof(info);
+	DEVMODE mode = {};
+	mode.dmSize = sizeof(mode);
+	if (!GetMonitorInfo(MonitorFromWindow(m_hwnd, MONITOR_DEFAULTTONEAREST), &info) || !EnumDisplaySettings(info.szDevice, ENUM_CURRENT_SETTINGS, &mode) || mode.dmDisplayFrequency <= 1) {
+		// 0 and 1 mean the default refresh rate of the hardware
+		LOG_WARNING(L"Couldn't get the refresh rate of the monitor");
+		return FrameScheduler::DEFAULT_REFRESH_INTERVAL;
+	}
+	return 1'000'000'000 / mode.dmDisplayFrequency;
+}
+
 bool WindowHandler::Window::getCloseRequest() {
 	return closeRequest;
 }
@@ -26,6 +26,8 @@ namespace WindowHandler {
 		POINTER_TYPE type = POINTER_TYPE::UNKNOWN;
 		Point2D<float> pos = { 0, 0 };
 		UINT32 pressure = 0;
+		// when the pointer captured the sample (Trace::now timebase). Falls back to the time the message was handled
+		UINT64 timestamp = 0;
 		bool button1pressed = false; /* Left mouse button or barrel button */
 		bool button2pressed = false; /* Right mouse button eareser button */
 		bool button3pressed = false; /* Middle mouse button */
@@ -190,6 +192,9 @@ namespace WindowHandler {
 		HWND m_hwnd;
 		RenderHandler::Direct2DContext* m_renderContext;
 		float m_dpi = 96;
+		// ends the wait for the next frame. It has a high resolution so the wait isn't rounded up to the next tick
+		// of the system timer (15.6ms by default). Null if the system doesn't support it
+		HANDLE m_frameTimer = nullptr;
 
 		void (*PointerDownCallback)(POINTER_INFO) = nullptr;
 		void (*PointerMoveCallback)(POINTER_INFO) = nullptr;
@@ -220,6 +225,9 @@ namespace WindowHandler {
 		void setState(WindowHandler::WINDOW_STATE state);
 
 		void getMsg(bool blocking = true);
+		// waits until a message arrives or the timeout (in ns) passed and then processes all messages. The timeout is
+		// kept to a fraction of a millisecond if the high resolution timer is available
+		void waitForMsg(UINT64 timeout);
 		void forceDraw();
 
 		bool getCloseRequest();
@@ -242,6 +250,8 @@ namespace WindowHandler {
 
 
 		Rect2D<unsigned int> getClientSize() const;
+		// the time between two refreshes of the monitor the window is on in ns
+		UINT64 getRefreshInterval() const;
 
 		template <typename T>
 		Point2D<T> PxToDp(Point2D<T> p) const {
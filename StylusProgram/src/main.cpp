@@ -18,10 +18,17 @@ unsigned long long lastScrollTime = 0;
 
 bool isCtrlPressed = false;
 bool isAltPressed = false;
+// show the metrics above the debug text and write them into a file every 10 seconds
+bool showMetrics = false;
+// Ctrl+R records the input so the session can be replayed with tools/replay
+InputRecording::Recorder recorder;
 
 void LoadPdf() {
-	delete pdfbuilder;
+	// the annotation handler borrows the builder. Both stay null if no file is opened
 	delete annothandler;
+	annothandler = nullptr;
+	delete pdfbuilder;
+	pdfbuilder = nullptr;
 	builder = nullptr;
 	pdf.~PDF();
 
@@ -31,7 +38,7 @@ void LoadPdf() {
 	if (!filepath.empty()) {
 		pdf = pdfhandler->loadPDF(filepath);
 		pdfbuilder = new RenderHandler::PDFBuilder(context, &pdf);
-		annothandler = new PDFHandler::AnnotationHandler(&pdf, pdfbuilder);
+		annothandler = new PDFHandler::AnnotationHandler(&pdf, pdfbuilder, PDFHandler::Sidecar::getPath(filepath));
 		builder = annothandler->getStrokeBuilder();
 	}
 
@@ -39,6 +46,8 @@ void LoadPdf() {
 }
 
 void SavePdf() {
+	TRACE_SCOPE("SavePdf", "save");
+	static auto& savetime = Metrics::histogram("save.total_us");
 	if (annothandler == nullptr)
 		return;
 
@@ -49,12 +58,61 @@ void SavePdf() {
 	p.replace_extension(".pdf");
 	filepath = std::wstring(p.c_str());
 
+	auto start = Trace::now();
 	annothandler->bakeAnnotations();
-	pdf.save(filepath);
+	auto hash = pdf.save(filepath);
+	// the sidecar makes loading big files faster. The pdf stays usable without it
+	annothandler->saveSidecar(PDFHandler::Sidecar::getPath(filepath), hash);
+	savetime.record((Trace::now() - start) / 1000);
 	
 }
 
+// the pen to ink latency is reported for every pointer type
+Metrics::Histogram* getInkLatency(WindowHandler::POINTER_TYPE type) {
+	static auto& stylus = Metrics::histogram("ink.pen_to_ink_us.stylus");
+	static auto& mouse = Metrics::histogram("ink.pen_to_ink_us.mouse");
+	static auto& touch = Metrics::histogram("ink.pen_to_ink_us.touch");
+	switch (type) {
+	case WindowHandler::STYLUS: return &stylus;
+	case WindowHandler::MOUSE:	return &mouse;
+	case WindowHandler::TOUCH:	return &touch;
+	}
+	return nullptr;
+}
+
+void RecordPointer(InputRecording::EVENT_TYPE type, const WindowHandler::POINTER_INFO& state) {
+	if (!recorder.isRecording())
+		return;
+	// the replay needs the view to transform the point into document space
+	auto origin = context->transformPoint({ 0, 0 });
+	recorder.setView(context->transformPoint({ 1, 0 }).x - origin.x, origin, state.timestamp);
+
+	byte buttons = (byte)(state.button1pressed | state.button2pressed << 1 | state.button3pressed << 2 | state.button4pressed << 3 | state.button5pressed << 4);
+	recorder.addPointer(type, state.id, (byte)state.type, buttons, state.pos, state.pressure, state.timestamp);
+}
+
+void ToggleRecording() {
+	if (recorder.isRecording()) {
+		auto events = recorder.getEventCount();
+		auto data = recorder.stop();
+		FileHandler::saveFile(L"StylusProgram.rec", data.data(), data.size());
+		LOG_INFO(L"Saved {} input events to StylusProgram.rec", events);
+		return;
+	}
+
+	// the replay doesn't load the pdf so it needs the layout of the pages
+	std::vector<Rect2D<float>> pages;
+	if (pdfbuilder != nullptr) {
+		for (size_t i = 0; i < pdf.getNumberOfPages(); i++)
+			pages.push_back(pdfbuilder->getSizeAndPositionOfPage(i));
+	}
+	recorder.start(context->DptoPx(1), pages, Trace::now());
+	LOG_INFO(L"Started recording the input");
+}
+
 void PenDown(WindowHandler::POINTER_INFO state) {
+	TRACE_SCOPE("PenDown", "input");
+	RecordPointer(InputRecording::POINTER_DOWN, state);
 	if (annothandler == nullptr)
 		return;
 
@@ -62,7 +120,7 @@ void PenDown(WindowHandler::POINTER_INFO state) {
 		touchHandler->startTouchGesture(state);
 	if (state.type == WindowHandler::MOUSE) {
 		if (state.button1pressed)
-			annothandler->startStroke(context->transformPointInv(state.pos), state.id);
+			annothandler->startStroke(context->transformPointInv(state.pos), state.id, state.pressure, state.timestamp, getInkLatency(state.type));
 		else if (state.button2pressed)
 			annothandler->eraser(context->transformPointInv(state.pos));
 	}
@@ -70,22 +128,30 @@ void PenDown(WindowHandler::POINTER_INFO state) {
 		if (state.button2pressed)
 			annothandler->eraser(context->transformPointInv(state.pos));
 		else
-			annothandler->startStroke(context->transformPointInv(state.pos), state.id);
+			annothandler->startStroke(context->transformPointInv(state.pos), state.id, state.pressure, state.timestamp, getInkLatency(state.type));
 	}
 }
 
 void PointerMove(WindowHandler::POINTER_INFO state) {
+	TRACE_SCOPE("PointerMove", "input");
+	RecordPointer(InputRecording::POINTER_MOVE, state);
 	if (annothandler == nullptr)
 		return;
 
 	if (state.type == WindowHandler::TOUCH) {
 		touchHandler->updateTouchGesture(state);
-		context->render();
+		// nothing is rendered on this thread during the gesture so the background renders are kept
+		if (pdfbuilder != nullptr) {
+			pdfbuilder->calculateOutOfBoundsPDF();
+			pdfbuilder->markInteraction(false);
+			pdfbuilder->createPreviewBitmaps();
+		}
+		context->invalidate();
 	}
 
 	if (state.type == WindowHandler::MOUSE) {
 		if (state.button1pressed)
-			annothandler->addStroke(context->transformPointInv(state.pos), state.id);
+			annothandler->addStroke(context->transformPointInv(state.pos), state.id, state.pressure, state.timestamp);
 		else if (state.button2pressed)
 			annothandler->eraser(context->transformPointInv(state.pos));
 	}
@@ -93,16 +159,18 @@ void PointerMove(WindowHandler::POINTER_INFO state) {
 		if (state.button2pressed)
 			annothandler->eraser(context->transformPointInv(state.pos));
 		else
-			annothandler->addStroke(context->transformPointInv(state.pos), state.id);
+			annothandler->addStroke(context->transformPointInv(state.pos), state.id, state.pressure, state.timestamp);
 	}
 }
 
 void PointerUp(WindowHandler::POINTER_INFO state) {
+	TRACE_SCOPE("PointerUp", "input");
+	RecordPointer(InputRecording::POINTER_UP, state);
 	if (annothandler == nullptr)
 		return;
 
 	if (state.type == WindowHandler::MOUSE || state.type == WindowHandler::STYLUS) {
-		annothandler->endStroke(context->transformPointInv(state.pos), state.id);
+		annothandler->endStroke(context->transformPointInv(state.pos), state.id, state.pressure, state.timestamp);
 	}
 	if (state.type == WindowHandler::TOUCH) {
 		touchHandler->stopTouchGestureOfFinger(state);
@@ -110,11 +178,12 @@ void PointerUp(WindowHandler::POINTER_INFO state) {
 		if (pdfbuilder == nullptr)
 			return;
 		
-		context->render();
+		context->invalidate();
 	}
 }
 
 void PointerScroll(SHORT delta, bool hwehl, Point2D<int> p) {
+	TRACE_SCOPE("PointerScroll", "input");
 	if (annothandler == nullptr)
 		return;
 
@@ -137,17 +206,23 @@ void PointerScroll(SHORT delta, bool hwehl, Point2D<int> p) {
 	}
 
 	if (pdfbuilder != nullptr) {
+		// the visible pages have to be known to decide which background renders are outdated
 		pdfbuilder->calculateOutOfBoundsPDF();
+		pdfbuilder->markInteraction();
 		pdfbuilder->createPreviewBitmaps();
 	}
 
-	context->render();
+	context->invalidate();
 }
 
 
 void WindowRepaint(ID2D1HwndRenderTarget* const h) {
+	TRACE_SCOPE("WindowRepaint", "render");
+	static auto& frametime = Metrics::histogram("render.frame_us");
+	static auto& regiontime = Metrics::histogram("render.region_us");
 	if (pdfbuilder == nullptr)
 		return;
+	auto start = Trace::now();
 
 	context->clearCanvas();
 
@@ -155,16 +230,27 @@ void WindowRepaint(ID2D1HwndRenderTarget* const h) {
 	pdfbuilder->renderpreview(); 
 
 	if (!touchHandler->isGestureInProgress()) {
-		auto time = TimeSince1970();
-		pdfbuilder->renderBitmap(); 
-		Logger::add("Rendered pdf to bitmap in " + std::to_string(TimeSince1970() - time));
+		// the cached bitmaps are still valid if only a part of the window changed
+		if (!context->isPartialRender()) {
+			auto time = TimeSince1970();
+			pdfbuilder->renderBitmap(); 
+			LOG_INFO(L"Rendered pdf to bitmap in {}ms", TimeSince1970() - time);
+		}
 		pdfbuilder->render();
 	}
+	else {
+		// the cached bitmaps are scaled to the view while the worker renders the new zoom level
+		pdfbuilder->renderBitmapInBackground();
+		pdfbuilder->render(false);
+	}
 
 	builder->renderAllStrokes(); 
+
+	(context->isPartialRender() ? regiontime : frametime).record((Trace::now() - start) / 1000);
 }
 
 void KeyDown(WindowHandler::VK key) {
+	recorder.addKey(InputRecording::KEY_DOWN, key, Trace::now());
 	switch (key) {
 	case WindowHandler::VK::LEFT_CONTROL:
 		isCtrlPressed = true;
@@ -176,6 +262,7 @@ void KeyDown(WindowHandler::VK key) {
 }
 
 void KeyUp(WindowHandler::VK key) {
+	recorder.addKey(InputRecording::KEY_UP, key, Trace::now());
 	switch (key) {
 	case WindowHandler::VK::LEFT_CONTROL:
 		isCtrlPressed = false;
@@ -188,18 +275,44 @@ void KeyUp(WindowHandler::VK key) {
 		if (isAltPressed) {
 			_mainWindow->sendCloseRequest();
 		}
+		break;
 	}
 	case WindowHandler::VK::O:
 	{
 		if (isCtrlPressed) {
 			LoadPdf();
 		}
+		break;
 	}
 	case WindowHandler::VK::S:
 	{
 		if (isCtrlPressed) {
 			SavePdf();
 		}
+		break;
+	}
+	case WindowHandler::VK::T:
+	{
+		// open the file in chrome://tracing or ui.perfetto.dev
+		if (isCtrlPressed) {
+			Trace::exportChromeTrace(L"StylusProgram.trace.json");
+		}
+		break;
+	}
+	case WindowHandler::VK::M:
+	{
+		if (isCtrlPressed) {
+			showMetrics = !showMetrics;
+			context->setDebugSummary(showMetrics ? Metrics::getSummary() : L"");
+		}
+		break;
+	}
+	case WindowHandler::VK::R:
+	{
+		if (isCtrlPressed) {
+			ToggleRecording();
+		}
+		break;
 	}
 	}
 }
@@ -209,9 +322,12 @@ bool init(HINSTANCE& hInstance) {
 	AllocConsole();
 	FILE* pCout;
 	freopen_s(&pCout, "CONOUT$", "w", stdout);
-#endif
-
 	Logger::init(Logger::PRINT_TARGET::STD_OUT);
+#else
+	// there is no console in release builds
+	Logger::init(Logger::PRINT_TARGET::FILE_OUT);
+#endif
+	Trace::setThreadName("Main");
 
 
 	_mainWindow = new WindowHandler::Window();
@@ -229,6 +345,14 @@ bool init(HINSTANCE& hInstance) {
 
 	context->addRepaintCallbackFunction(WindowRepaint);
 
+	// the caches can use a quarter of the memory so machines with little memory don't start swapping
+	MEMORYSTATUSEX memory = {};
+	memory.dwLength = sizeof(memory);
+	if (GlobalMemoryStatusEx(&memory))
+		MemoryBudget::setLimit(min(MemoryBudget::DEFAULT_LIMIT, (size_t)(memory.ullTotalPhys / 4)));
+	LOG_INFO(L"The caches can use {}MB", MemoryBudget::getLimit() >> 20);
+
+	// the store size depends on the memory budget
 	pdfhandler = new PDFHandler::MUPDF();
 
 	touchHandler = new WindowHandler::TouchHandler(context);
@@ -247,30 +371,85 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 		return -1;
 	s = TimeSince1970() - s;
 
-	Logger::add(L"Everything initialized in " + std::to_wstring(s) + L"ms");
+	LOG_INFO(L"Everything initialized in {}ms", s);
 
 	LoadPdf();
 
 	// main loop
+	static auto& frames = Metrics::counter("render.frames");
+	static auto& invalidations = Metrics::counter("render.invalidations");
+	static auto& framedelay = Metrics::histogram("render.frame_delay_us");
+	auto& scheduler = context->getFrameScheduler();
+	scheduler.setRefreshInterval(_mainWindow->getRefreshInterval());
 	context->render();
-	s = TimeSince1970();
+
+	constexpr UINT64 MS = 1'000'000;
+	auto lastMetricsUpdate = Trace::now();
+	auto lastMetricsDump = lastMetricsUpdate;
+	auto lastInvalidations = scheduler.getInvalidationCount();
 	while (!_mainWindow->getCloseRequest()) {
-		_mainWindow->getMsg();
-		if (builder != nullptr && TimeSince1970() - s > 30) {
-			//Logger::add(L"test");
-			s = TimeSince1970();
+		// sleep until there is input, a frame is due or the metrics have to be updated
+		auto now = Trace::now();
+		auto timeout = scheduler.getTimeout();
+		if (showMetrics) {
+			timeout = min(timeout, lastMetricsUpdate + 1000 * MS - min(now, lastMetricsUpdate + 1000 * MS));
+			timeout = min(timeout, lastMetricsDump + 10000 * MS - min(now, lastMetricsDump + 10000 * MS));
+		}
+		// the in window output is written by other threads too and has to be printed from this thread
+		bool printLog = Logger::forcePrint && Logger::printtarget == Logger::PRINT_TARGET::DIRECT2D_CONTEXT;
+		if (printLog)
+			timeout = min(timeout, 30 * MS);
+		if (pdfbuilder != nullptr)
+			timeout = min(timeout, pdfbuilder->getUpdateTimeout());
+		_mainWindow->waitForMsg(timeout);
+
+		// The builder only has work if a worker finished, a refinement is due or a frame is drawn. Refined pages
+		// invalidate their area so it runs before the frame starts
+		if (pdfbuilder != nullptr && (scheduler.getTimeout() == 0 || pdfbuilder->getUpdateTimeout() == 0)) {
+			pdfbuilder->update();
+			// the caches give back the memory of what isn't visible
+			MemoryBudget::enforce();
+		}
+
+		auto frame = scheduler.beginFrame();
+		if (frame != FrameScheduler::NOTHING) {
+			frames.add();
+			framedelay.record(scheduler.getFrameDelay() / 1000);
+			invalidations.add(scheduler.getInvalidationCount() - lastInvalidations);
+			lastInvalidations = scheduler.getInvalidationCount();
+		}
+		if (frame & FrameScheduler::FULL)
+			context->render();
+		else if (frame & FrameScheduler::REGION)
+			context->render(scheduler.getDirtyRects());
+		// the lines of the strokes in progress are drawn above everything else
+		if ((frame & FrameScheduler::INK) && builder != nullptr)
 			builder->renderDynamicLines();
+
+		if (printLog)
+			Logger::print();
+		now = Trace::now();
+		if (showMetrics && now - lastMetricsUpdate > 1000 * MS) {
+			lastMetricsUpdate = now;
+			context->setDebugSummary(Metrics::getSummary());
+		}
+		// the file is only written while the metrics are shown (Ctrl+M)
+		if (showMetrics && now - lastMetricsDump > 10000 * MS) {
+			lastMetricsDump = now;
+			Metrics::dumpToFile(L"StylusProgram.metrics.json");
 		}
 	}
 
 	// clean up
 	delete _mainWindow;
 	delete touchHandler;
-	delete pdfbuilder;
 	delete annothandler;
+	delete pdfbuilder;
 	pdf.~PDF();
 	pdf = PDFHandler::PDF();
 	delete pdfhandler;
 
+	Logger::shutdown();
+
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,285 @@
+// Microbenchmarks for the geometry kernels: the helpers in Util.h, the curve fitting and tessellation in
+// StrokeGeometry, the visvalingam simplification and the eraser inner loop. The input are strokes of the
+// handwriting generator so the sizes match real documents.
+//
+// usage: bench [--filter text] [--json file] [--baseline file] [--threshold percent]
+//        --json writes the results, --baseline compares against results written before and returns 1 if a
+//        benchmark got slower than the threshold (default 10%)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "HandwritingGenerator.h"
+#include "util/QuantizedStroke.h"
+#include "util/StrokeGeometry.h"
+#include "visvalingam_simplify/visvalingam_algorithm.h"
+
+using Clock = std::chrono::steady_clock;
+
+// keeps the compiler from removing the benchmarked code
+template <typename T>
+static void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+struct Result {
+	std::string m_name;
+	size_t m_size = 0;
+	double m_nsPerOp = 0;
+	// how many elements (points, rects, strokes) are processed per second
+	double m_itemsPerSecond = 0;
+};
+
+static std::vector<Result> results;
+static const char* filter = nullptr;
+
+// Calls the function until at least 20 ms passed and takes the fastest of 5 repetitions.
+// One call of the function is one operation that processes size items
+static void bench(const std::string& name, size_t size, const std::function<void()>& f) {
+	if (filter != nullptr && name.find(filter) == std::string::npos)
+		return;
+
+	// find out how many calls fit into the time
+	size_t iterations = 1;
+	while (true) {
+		auto start = Clock::now();
+		for (size_t i = 0; i < iterations; i++)
+			f();
+		if (Clock::now() - start > std::chrono::milliseconds(20))
+			break;
+		iterations *= 2;
+	}
+
+	double best = 1e300;
+	for (int r = 0; r < 5; r++) {
+		auto start = Clock::now();
+		for (size_t i = 0; i < iterations; i++)
+			f();
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+		best = min(best, ns);
+	}
+
+	Result result = { name, size, best, size * 1e9 / best };
+	std::printf("%-32s %8zu %14.1f ns/op %14.0f items/s\n", name.c_str(), size, result.m_nsPerOp, result.m_itemsPerSecond);
+	results.push_back(result);
+}
+
+// a curve with n points made of generated handwriting
+static std::vector<Point2D<float>> handwriting(size_t n, UINT32 seed = 1) {
+	auto pages = HandwritingGenerator::createPages(1);
+	HandwritingGenerator generator(pages, seed);
+	std::vector<Point2D<float>> points;
+	std::vector<HandwritingGenerator::Sample> samples;
+	while (points.size() < n && generator.nextStroke(samples)) {
+		for (auto& s : samples) {
+			if (points.size() < n)
+				points.push_back(s.m_pos);
+		}
+	}
+	return points;
+}
+
+static void benchUtil() {
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> coord(0, 1000);
+	std::uniform_real_distribution<float> extent(1, 200);
+	constexpr size_t N = 4096;
+
+	std::vector<Point2D<float>> points(N);
+	std::vector<Rect2D<float>> rects(N);
+	for (size_t i = 0; i < N; i++) {
+		points[i] = { coord(random), coord(random) };
+		rects[i] = Rect2D<float>({ coord(random), coord(random) }, extent(random), extent(random));
+	}
+
+	bench("pointToLineDistance", N, [&]() {
+		double sum = 0;
+		for (size_t i = 0; i + 2 < N; i++)
+			sum += pointToLineDistance(points[i], points[i + 1], points[i + 2]);
+		doNotOptimize(sum);
+	});
+	bench("Rect2D::intersects(rect)", N, [&]() {
+		size_t hits = 0;
+		for (size_t i = 0; i + 1 < N; i++)
+			hits += rects[i].intersects(rects[i + 1]);
+		doNotOptimize(hits);
+	});
+	bench("Rect2D::intersects(point)", N, [&]() {
+		size_t hits = 0;
+		for (size_t i = 0; i < N; i++)
+			hits += rects[i].intersects(points[i]);
+		doNotOptimize(hits);
+	});
+	bench("Rect2D::intersection", N, [&]() {
+		float area = 0;
+		for (size_t i = 0; i + 1 < N; i++)
+			area += rects[i].intersection(rects[i + 1]).width;
+		doNotOptimize(area);
+	});
+}
+
+static void benchCurves() {
+	// a short word, an average stroke and a long scribble
+	for (size_t n : { 16, 128, 1024 }) {
+		auto points = handwriting(n);
+
+		bench("getBoundingBox", n, [&]() {
+			doNotOptimize(getBoundingBox(&points));
+		});
+
+		// the solver works in place so the input is copied back every time
+		std::vector<float> a(n - 2, 1), b(n - 1, 4), c(n - 2, 1);
+		std::vector<Point2D<float>> d(points.begin(), points.end() - 1), x(n - 1);
+		auto ta = a, tb = b, tc = c;
+		auto td = d;
+		bench("solveTridiagonal", n, [&]() {
+			std::copy(b.begin(), b.end(), tb.begin());
+			std::copy(d.begin(), d.end(), td.begin());
+			solveTridiagonal(ta, tb, tc, td, x);
+			doNotOptimize(x[0]);
+		});
+
+		std::vector<Point2D<float>> ca(n - 1), cb(n - 1);
+		bench("calcBezierPoints", n, [&]() {
+			calcBezierPoints(&points, ca, cb);
+			doNotOptimize(ca[0]);
+		});
+
+		std::vector<byte> pressure(n, PRESSURE_DEFAULT);
+		bench("tessellateStroke", n, [&]() {
+			doNotOptimize(tessellateStroke(&points, &pressure, 1).size());
+		});
+
+		Linestring line(points.begin(), points.end());
+		Linestring simplified;
+		bench("Visvalingam_Algorithm", n, [&]() {
+			Visvalingam_Algorithm v(line);
+			v.simplify(0.5, &simplified);
+			doNotOptimize(simplified.size());
+		});
+
+		QuantizedStroke stroke(points);
+		std::vector<Point2D<float>> decoded;
+		bench("QuantizedStroke::decode", n, [&]() {
+			stroke.decode(decoded);
+			doNotOptimize(decoded[0]);
+		});
+	}
+}
+
+static void benchEraser() {
+	// one page full of handwriting. The eraser checks every stroke of the page
+	auto pages = HandwritingGenerator::createPages(1);
+	HandwritingGenerator generator(pages, 1);
+	std::vector<QuantizedStroke> strokes;
+	std::vector<HandwritingGenerator::Sample> samples;
+	std::vector<Point2D<float>> points;
+	while (generator.nextStroke(samples)) {
+		points.clear();
+		for (auto& s : samples)
+			points.push_back(s.m_pos);
+		strokes.emplace_back(points);
+	}
+
+	std::mt19937 random(1);
+	std::vector<Point2D<float>> positions(256);
+	for (auto& p : positions)
+		p = { std::uniform_real_distribution<float>(10, 605)(random), std::uniform_real_distribution<float>(10, 852)(random) };
+
+	size_t next = 0;
+	bench("eraser page hitTest", strokes.size(), [&]() {
+		auto p = positions[next++ % positions.size()];
+		size_t hits = 0;
+		for (auto& s : strokes)
+			hits += s.hitTest(p, 10 + 1);
+		doNotOptimize(hits);
+	});
+}
+
+static void writeJson(const char* path) {
+	FILE* f = std::fopen(path, "w");
+	if (f == nullptr) {
+		std::fprintf(stderr, "couldn't write %s\n", path);
+		return;
+	}
+	// one benchmark per line so the baseline can be read without a json parser
+	std::fprintf(f, "[\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		auto& r = results[i];
+		std::fprintf(f, "{\"name\": \"%s\", \"size\": %zu, \"ns_per_op\": %.3f, \"items_per_second\": %.1f}%s\n",
+			r.m_name.c_str(), r.m_size, r.m_nsPerOp, r.m_itemsPerSecond, i + 1 < results.size() ? "," : "");
+	}
+	std::fprintf(f, "]\n");
+	std::fclose(f);
+}
+
+// returns the amount of regressions
+static size_t compareBaseline(const char* path, double threshold) {
+	FILE* f = std::fopen(path, "r");
+	if (f == nullptr) {
+		std::fprintf(stderr, "couldn't read %s\n", path);
+		return 0;
+	}
+	std::map<std::pair<std::string, size_t>, double> baseline;
+	char line[512];
+	while (std::fgets(line, sizeof(line), f) != nullptr) {
+		char name[256];
+		size_t size;
+		double ns;
+		if (std::sscanf(line, "{\"name\": \"%255[^\"]\", \"size\": %zu, \"ns_per_op\": %lf", name, &size, &ns) == 3)
+			baseline[{ name, size }] = ns;
+	}
+	std::fclose(f);
+
+	size_t regressions = 0;
+	std::printf("\n%-32s %8s %12s %12s %8s\n", "baseline", "size", "old ns", "new ns", "change");
+	for (auto& r : results) {
+		auto it = baseline.find({ r.m_name, r.m_size });
+		if (it == baseline.end())
+			continue;
+		double change = (r.m_nsPerOp / it->second - 1) * 100;
+		bool regression = change > threshold;
+		regressions += regression;
+		std::printf("%-32s %8zu %12.1f %12.1f %+7.1f%%%s\n", r.m_name.c_str(), r.m_size, it->second, r.m_nsPerOp, change, regression ? "  REGRESSION" : "");
+	}
+	return regressions;
+}
+
+int main(int argc, char** argv) {
+	const char* json = nullptr;
+	const char* baseline = nullptr;
+	double threshold = 10;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (std::strcmp(argv[i], "--filter") == 0)
+			filter = argv[i + 1];
+		else if (std::strcmp(argv[i], "--json") == 0)
+			json = argv[i + 1];
+		else if (std::strcmp(argv[i], "--baseline") == 0)
+			baseline = argv[i + 1];
+		else if (std::strcmp(argv[i], "--threshold") == 0)
+			threshold = std::atof(argv[i + 1]);
+	}
+
+	benchUtil();
+	benchCurves();
+	benchEraser();
+
+	if (json != nullptr)
+		writeJson(json);
+	if (baseline != nullptr && compareBaseline(baseline, threshold) != 0)
+		return 1;
+	return 0;
+}
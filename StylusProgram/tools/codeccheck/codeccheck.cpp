@@ -0,0 +1,115 @@
+// Checks that PixelCodec gives back exactly the pixels it coded. The images are generated like the pages the program
+// renders: plain paper with anti aliased glyphs, noise like a photo, long runs that cross the token size and rows
+// with padding. Every coded image is also cut short and changed so a broken cache can't decode into wrong pixels
+// without an error.
+//
+// usage: codeccheck [seed]
+//        returns 1 if an image didn't survive the round trip
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "util/PixelCodec.h"
+
+static size_t failures = 0;
+
+static void fail(const char* what, UINT32 width, UINT32 height, const char* kind) {
+	if (failures++ < 10)
+		std::printf("error in a %ux%u %s image: %s\n", width, height, kind, what);
+}
+
+static UINT32 randomPixel(std::mt19937& random) {
+	return (UINT32)random() | 0xff000000;
+}
+
+// fills the rows of the image. The padding at the end of every row has garbage in it like a mupdf pixmap can have
+static std::vector<byte> createImage(std::mt19937& random, UINT32 width, UINT32 height, UINT32 stride, int kind) {
+	std::vector<byte> pixels((size_t)stride * height);
+	for (auto& b : pixels)
+		b = (byte)random();
+
+	const UINT32 paper = 0xffffffff;
+	for (UINT32 y = 0; y < height; y++) {
+		auto row = pixels.data() + (size_t)y * stride;
+		for (UINT32 x = 0; x < width; x++) {
+			UINT32 pixel = paper;
+			switch (kind) {
+			case 0:
+				// a few short glyph edges on the paper
+				if (random() % 16 == 0)
+					pixel = randomPixel(random);
+				break;
+			case 1:
+				pixel = randomPixel(random);
+				break;
+			case 2:
+				// runs of every length, also ones of exactly MIN_RUN and the ones that need longer tokens
+				pixel = (x / (1 + y % 300)) % 2 == 0 ? paper : 0xff000000;
+				break;
+			case 3:
+				// literals and runs alternate with the shortest possible lengths
+				pixel = (x % 5) < PixelCodec::MIN_RUN ? paper : randomPixel(random);
+				break;
+			}
+			memcpy(row + (size_t)x * 4, &pixel, 4);
+		}
+	}
+	return pixels;
+}
+
+static const char* KINDS[] = { "paper", "photo", "runs", "mixed" };
+
+static void check(std::mt19937& random, UINT32 width, UINT32 height, int kind) {
+	UINT32 stride = width * 4 + (random() % 2 == 0 ? 0 : 4 * (random() % 8 + 1));
+	auto pixels = createImage(random, width, height, stride, kind);
+	auto coded = PixelCodec::encode(pixels.data(), width, height, stride);
+
+	std::vector<byte> decoded((size_t)width * height * 4);
+	if (!PixelCodec::decode(coded.data(), coded.size(), decoded.data(), width, height, width * 4)) {
+		fail("the coded pixels couldn't be decoded", width, height, KINDS[kind]);
+		return;
+	}
+	for (UINT32 y = 0; y < height; y++) {
+		if (memcmp(decoded.data() + (size_t)y * width * 4, pixels.data() + (size_t)y * stride, (size_t)width * 4) != 0) {
+			fail("the decoded pixels are different", width, height, KINDS[kind]);
+			return;
+		}
+	}
+
+	// the size of the image is part of the check, the data of another size must not fit
+	if (width > 1 && PixelCodec::decode(coded.data(), coded.size(), decoded.data(), width - 1, height, width * 4))
+		fail("the pixels were decoded with a smaller width", width, height, KINDS[kind]);
+	if (coded.size() > 1 && PixelCodec::decode(coded.data(), coded.size() - 1, decoded.data(), width, height, width * 4))
+		fail("data that was cut short was decoded", width, height, KINDS[kind]);
+	coded.push_back(0);
+	if (PixelCodec::decode(coded.data(), coded.size(), decoded.data(), width, height, width * 4))
+		fail("data with a trailing byte was decoded", width, height, KINDS[kind]);
+}
+
+int main(int argc, char** argv) {
+	UINT32 seed = argc > 1 ? (UINT32)std::strtoul(argv[1], nullptr, 10) : 1;
+	std::mt19937 random(seed);
+
+	size_t images = 0;
+	const UINT32 sizes[][2] = { { 1, 1 }, { 2, 1 }, { 3, 3 }, { 1, 50 }, { 257, 3 }, { 612, 792 }, { 1224, 40 } };
+	for (auto& size : sizes) {
+		for (int kind = 0; kind < 4; kind++) {
+			check(random, size[0], size[1], kind);
+			images++;
+		}
+	}
+	for (size_t i = 0; i < 200; i++) {
+		check(random, random() % 400 + 1, random() % 40 + 1, (int)(random() % 4));
+		images++;
+	}
+
+	std::printf("%zu images coded and decoded\n", images);
+	if (failures != 0) {
+		std::printf("%zu errors\n", failures);
+		return 1;
+	}
+	return 0;
+}
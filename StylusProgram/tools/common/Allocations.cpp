@@ -0,0 +1,75 @@
+#include "Allocations.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static std::atomic<size_t> allocations = 0;
+static std::atomic<size_t> allocatedBytes = 0;
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	std::free(p);
+}
+
+size_t Allocations::count() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+size_t Allocations::bytes() {
+	return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+// reads a value in kB from /proc/self/status
+static size_t readStatus(const char* key) {
+#ifdef __linux__
+	FILE* f = std::fopen("/proc/self/status", "r");
+	if (f == nullptr)
+		return 0;
+	char line[256];
+	size_t value = 0;
+	auto length = std::strlen(key);
+	while (std::fgets(line, sizeof(line), f) != nullptr) {
+		if (std::strncmp(line, key, length) == 0) {
+			value = std::strtoull(line + length, nullptr, 10) * 1024;
+			break;
+		}
+	}
+	std::fclose(f);
+	return value;
+#else
+	return 0;
+#endif
+}
+
+size_t Allocations::residentMemory() {
+	return readStatus("VmRSS:");
+}
+
+size_t Allocations::peakResidentMemory() {
+	return readStatus("VmHWM:");
+}
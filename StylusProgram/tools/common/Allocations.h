@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+
+// Linking this replaces the global operator new so the tools can count every allocation
+namespace Allocations {
+	// the amount of allocations since the start of the program
+	size_t count();
+	// the amount of allocated bytes since the start of the program. Frees aren't subtracted
+	size_t bytes();
+	// the resident memory of the process in bytes. 0 if it isn't known
+	size_t residentMemory();
+	// the highest resident memory of the process in bytes. 0 if it isn't known
+	size_t peakResidentMemory();
+}
+
+#endif // !ALLOCATIONS_H
@@ -0,0 +1,132 @@
+#include "HandwritingGenerator.h"
+
+constexpr float PI = 3.14159265358979f;
+
+HandwritingGenerator::HandwritingGenerator(const std::vector<Rect2D<float>>& pages, UINT32 seed) : HandwritingGenerator(pages, seed, Settings()) {}
+
+HandwritingGenerator::HandwritingGenerator(const std::vector<Rect2D<float>>& pages, UINT32 seed, const Settings& s) : m_random(seed) {
+	m_settings = s;
+	m_pages = pages;
+	m_cursor = { m_settings.m_margin, m_settings.m_margin + m_settings.m_lineHeight };
+}
+
+float HandwritingGenerator::uniform(float min, float max) {
+	return std::uniform_real_distribution<float>(min, max)(m_random);
+}
+
+template <typename F>
+void HandwritingGenerator::sampleCurve(F curve, float length, float speed, std::vector<Sample>& out) {
+	// the pressure ramps up at the start, wanders a bit and drops at the end
+	float basepressure = uniform(300, 800);
+	float step = speed / (float)m_settings.m_sampleRate;
+	auto offset = m_pages[m_page].upperleft + m_cursor;
+
+	// walk along the curve in small parameter steps and emit a sample whenever the pen moved far enough
+	const float dt = 0.01f;
+	float t = 0;
+	float travelled = 0;
+	Point2D<float> last = curve(0);
+	out.push_back({ last + offset, (UINT32)(basepressure * 0.3f), m_time });
+	while (t < length) {
+		t = min(t + dt, length);
+		auto p = curve(t);
+		travelled += p.distance(last);
+		last = p;
+		if (travelled < step && t < length)
+			continue;
+		travelled = 0;
+		m_time += 1.0 / m_settings.m_sampleRate;
+
+		float progress = t / length;
+		float ramp = min(min(progress, 1 - progress) * 8, 1.0f);
+		float pressure = basepressure * (0.3f + 0.7f * ramp) * (1 + 0.15f * std::sin(t * 0.7f)) + uniform(-15, 15);
+		out.push_back({ p + offset, (UINT32)std::fmax(pressure, 1.0f), m_time });
+	}
+}
+
+bool HandwritingGenerator::advance(float width) {
+	auto& page = m_pages[m_page];
+	if (m_cursor.x + width <= page.width - m_settings.m_margin)
+		return true;
+
+	// next line
+	m_cursor.x = m_settings.m_margin;
+	m_cursor.y += m_settings.m_lineHeight;
+	if (m_cursor.y <= page.height - m_settings.m_margin)
+		return true;
+
+	// next page
+	m_cursor.y = m_settings.m_margin + m_settings.m_lineHeight;
+	m_page++;
+	return m_page < m_pages.size();
+}
+
+void HandwritingGenerator::word(std::vector<Sample>& out) {
+	// a word is a looped curve (prolate cycloid). Every loop is one letter
+	size_t letters = 1 + m_random() % 9;
+	float size = m_settings.m_letterSize * uniform(0.8f, 1.25f);
+	float step = size * uniform(0.6f, 0.9f);
+	float loop = size * uniform(0.3f, 0.45f);
+	float slant = uniform(0.1f, 0.35f);
+	float speed = uniform(m_settings.m_minSpeed, m_settings.m_maxSpeed);
+
+	// some letters reach above or below the line
+	std::vector<float> height(letters);
+	for (auto& h : height) {
+		auto r = m_random() % 10;
+		h = r < 2 ? 2.2f : r < 3 ? -1.5f : uniform(0.85f, 1.1f);
+	}
+
+	float width = step * letters + 2 * loop + size;
+	if (!advance(width))
+		return;
+
+	auto curve = [&](float t) {
+		size_t letter = min((size_t)(t / (2 * PI)), letters - 1);
+		float x = loop + step * t / (2 * PI) - loop * std::sin(t);
+		float y = -size * height[letter] * (1 - std::cos(t)) / 2;
+		return Point2D<float>(x - y * slant, y);
+	};
+	sampleCurve(curve, 2 * PI * letters, speed, out);
+	m_cursor.x += width + size * uniform(0.8f, 1.6f);
+}
+
+void HandwritingGenerator::dash(std::vector<Sample>& out) {
+	// t crosses, dashes and dots are short and slightly bent
+	float length = m_settings.m_letterSize * (m_random() % 4 == 0 ? 0.2f : uniform(1.0f, 3.0f));
+	float bend = uniform(-0.15f, 0.15f) * length;
+	float speed = uniform(m_settings.m_minSpeed, m_settings.m_maxSpeed);
+	float height = m_settings.m_letterSize * uniform(0.3f, 1.8f);
+
+	if (!advance(length))
+		return;
+
+	auto curve = [&](float t) {
+		return Point2D<float>(t, -height + bend * std::sin(PI * t / length));
+	};
+	sampleCurve(curve, length, speed, out);
+	m_cursor.x += length + m_settings.m_letterSize * uniform(0.5f, 1.0f);
+}
+
+bool HandwritingGenerator::nextStroke(std::vector<Sample>& out) {
+	out.clear();
+	if (m_page >= m_pages.size())
+		return false;
+
+	m_time += m_settings.m_pause;
+	if (m_random() % 8 == 0)
+		dash(out);
+	else
+		word(out);
+	return out.size() != 0;
+}
+
+std::vector<Rect2D<float>> HandwritingGenerator::createPages(size_t count, float width, float height, float padding) {
+	std::vector<Rect2D<float>> pages;
+	float y = padding;
+	for (size_t i = 0; i < count; i++) {
+		pages.push_back(Rect2D<float>({ padding, y }, width, height));
+		y += height + padding;
+	}
+	return pages;
+}
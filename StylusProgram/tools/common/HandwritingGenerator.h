@@ -0,0 +1,66 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include "util/Util.h"
+
+#ifndef HANDWRITING_GENERATOR_H
+#define HANDWRITING_GENERATOR_H
+
+// Generates pen strokes that look like cursive handwriting: words are looped curves with a varying slant, size and
+// speed, some strokes are short dashes (t crosses, i dots). The words fill the pages line by line.
+// The same seed always produces the same strokes
+class HandwritingGenerator {
+public:
+	struct Sample {
+		// document space
+		Point2D<float> m_pos;
+		// raw pointer pressure (0 - 1024)
+		UINT32 m_pressure = 0;
+		// seconds
+		double m_time = 0;
+	};
+
+	struct Settings {
+		float m_lineHeight = 24;
+		float m_margin = 40;
+		// height of a small letter
+		float m_letterSize = 7;
+		// pointer samples per second
+		double m_sampleRate = 240;
+		// pen speed in document units per second
+		float m_minSpeed = 60;
+		float m_maxSpeed = 260;
+		// the pause between two strokes in seconds
+		double m_pause = 0.15;
+	};
+
+private:
+	Settings m_settings;
+	std::mt19937 m_random;
+	std::vector<Rect2D<float>> m_pages;
+	size_t m_page = 0;
+	// where the next word starts. Relative to the page
+	Point2D<float> m_cursor;
+	double m_time = 0;
+
+	float uniform(float min, float max);
+	// samples the curve with the speed of the pen
+	template <typename F>
+	void sampleCurve(F curve, float length, float speed, std::vector<Sample>& out);
+	void word(std::vector<Sample>& out);
+	void dash(std::vector<Sample>& out);
+	// moves the cursor and returns false if every page is full
+	bool advance(float width);
+public:
+	HandwritingGenerator(const std::vector<Rect2D<float>>& pages, UINT32 seed = 1);
+	HandwritingGenerator(const std::vector<Rect2D<float>>& pages, UINT32 seed, const Settings& s);
+
+	// replaces out with the samples of the next stroke. Returns false if every page is full
+	bool nextStroke(std::vector<Sample>& out);
+
+	// A4 pages below each other with the same padding as the PDFBuilder
+	static std::vector<Rect2D<float>> createPages(size_t count, float width = 595, float height = 842, float padding = 10);
+};
+
+#endif // !HANDWRITING_GENERATOR_H
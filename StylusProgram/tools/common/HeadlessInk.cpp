@@ -0,0 +1,168 @@
+#include "HeadlessInk.h"
+#include <cstring>
+
+HeadlessInk::HeadlessInk(const std::vector<Rect2D<float>>& pages, float dpiScale) {
+	m_dpiScale = dpiScale;
+	m_pages = pages;
+	m_strokes.resize(m_pages.size());
+
+	m_capture.setPages(m_pages.size(), [this](size_t page) { return m_pages[page]; });
+	m_capture.setCallbacks(
+		[this](UINT32, Point2D<float>, Point2D<float>, byte, UINT64, bool merged) {
+			if (!merged)
+				m_lines++;
+		},
+		[this](UINT32, StrokeCapture::Stroke&& stroke) { strokeEnd(std::move(stroke)); });
+}
+
+void HeadlessInk::strokeEnd(StrokeCapture::Stroke&& s) {
+	auto outline = tessellateStroke(&s.m_points, &s.m_pressure, STROKE_WIDTH);
+	m_outlinePoints += outline.size();
+	m_strokes[s.m_page].push_back({ QuantizedStroke(s.m_points), std::move(s.m_pressure) });
+	m_finishedStrokes++;
+}
+
+void HeadlessInk::setView(float scale, Point2D<float> translation) {
+	m_viewScale = scale;
+	m_viewTranslation = translation;
+}
+
+Point2D<float> HeadlessInk::toDocument(Point2D<float> p) const {
+	p -= m_viewTranslation;
+	return { p.x / m_viewScale, p.y / m_viewScale };
+}
+
+void HeadlessInk::startStroke(Point2D<float> p, UINT32 id, UINT32 pressure, double timestamp) {
+	m_capture.setFilterScale(1.0f / (m_viewScale * m_dpiScale));
+	m_capture.startStroke(p, id, pressure, (UINT64)(timestamp * 1e9));
+}
+
+void HeadlessInk::addStroke(Point2D<float> p, UINT32 id, UINT32 pressure, double timestamp) {
+	m_capture.addStroke(p, id, pressure, (UINT64)(timestamp * 1e9));
+}
+
+void HeadlessInk::endStroke(Point2D<float> p, UINT32 id, double timestamp) {
+	m_capture.endStroke(p, id, (UINT64)(timestamp * 1e9));
+}
+
+size_t HeadlessInk::eraser(Point2D<float> p) {
+	auto page = m_capture.findPage(p);
+	if (page == -1)
+		return 0;
+	p -= m_pages[page].upperleft;
+	auto erased = StrokeCapture::erase(m_strokes[page], p, ERASER_WIDTH * m_dpiScale, [](InkStroke&) {});
+	m_erasedStrokes += erased;
+	return erased;
+}
+
+void HeadlessInk::replay(const InputRecording::Event& e, double timestamp) {
+	bool button1 = (e.m_buttons & 1) != 0;
+	bool button2 = (e.m_buttons & 2) != 0;
+	bool inking = (e.m_pointerType == MOUSE && button1) || (e.m_pointerType == STYLUS && !button2);
+	bool erasing = (e.m_pointerType == MOUSE || e.m_pointerType == STYLUS) && button2;
+	auto p = toDocument({ e.m_x, e.m_y });
+
+	switch (e.m_type) {
+	case InputRecording::VIEW:
+		setView(e.m_value, { e.m_x, e.m_y });
+		return;
+	case InputRecording::POINTER_DOWN:
+		if (inking)
+			startStroke(p, e.m_id, (UINT32)e.m_value, timestamp);
+		else if (erasing)
+			eraser(p);
+		return;
+	case InputRecording::POINTER_MOVE:
+		if (inking)
+			addStroke(p, e.m_id, (UINT32)e.m_value, timestamp);
+		else if (erasing)
+			eraser(p);
+		return;
+	case InputRecording::POINTER_UP:
+		if (e.m_pointerType == MOUSE || e.m_pointerType == STYLUS)
+			endStroke(p, e.m_id, timestamp);
+		return;
+	default:
+		// the keys don't change the ink
+		return;
+	}
+}
+
+const std::vector<Rect2D<float>>& HeadlessInk::getPages() const {
+	return m_pages;
+}
+
+const std::list<HeadlessInk::InkStroke>& HeadlessInk::getStrokes(size_t page) const {
+	return m_strokes[page];
+}
+
+size_t HeadlessInk::getStrokeCount() const {
+	size_t n = 0;
+	for (auto& page : m_strokes)
+		n += page.size();
+	return n;
+}
+
+size_t HeadlessInk::getMemorySize() const {
+	size_t size = 0;
+	for (auto& page : m_strokes) {
+		for (auto& s : page)
+			size += s.m_points.getMemorySize() + s.m_pressure.capacity();
+	}
+	return size;
+}
+
+size_t HeadlessInk::tessellatePage(size_t page) const {
+	size_t outline = 0;
+	std::vector<Point2D<float>> points;
+	for (auto& s : m_strokes[page]) {
+		s.m_points.decode(points);
+		outline += tessellateStroke(&points, &s.m_pressure, STROKE_WIDTH).size();
+	}
+	return outline;
+}
+
+std::vector<byte> HeadlessInk::serialize() const {
+	size_t size = 0;
+	for (auto& page : m_strokes) {
+		for (auto& s : page) {
+			size += sizeof(QuantizedStroke::Header);
+			size = (size + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+			size += s.m_points.getDataSize() + s.m_pressure.size();
+		}
+	}
+
+	std::vector<byte> buffer(size, 0);
+	size_t offset = 0;
+	for (auto& page : m_strokes) {
+		for (auto& s : page) {
+			auto header = s.m_points.getHeader();
+			std::memcpy(buffer.data() + offset, &header, sizeof(header));
+			offset += sizeof(header);
+			offset = (offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+			std::memcpy(buffer.data() + offset, s.m_points.getData(), s.m_points.getDataSize());
+			offset += s.m_points.getDataSize();
+			if (s.m_pressure.size() != 0)
+				std::memcpy(buffer.data() + offset, s.m_pressure.data(), s.m_pressure.size());
+			offset += s.m_pressure.size();
+		}
+	}
+	return buffer;
+}
+
+UINT64 HeadlessInk::hash() const {
+	UINT64 h = 14695981039346656037ull;
+	auto add = [&](const byte* data, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			h ^= data[i];
+			h *= 1099511628211ull;
+		}
+	};
+	for (auto& page : m_strokes) {
+		for (auto& s : page) {
+			add(s.m_points.getData(), s.m_points.getDataSize());
+			add(s.m_pressure.data(), s.m_pressure.size());
+		}
+	}
+	return h;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include "util/InputRecording.h"
+#include "util/QuantizedStroke.h"
+#include "util/StrokeCapture.h"
+#include "util/StrokeGeometry.h"
+
+#ifndef HEADLESS_INK_H
+#define HEADLESS_INK_H
+
+// same values as WindowHandler::POINTER_TYPE
+enum POINTER_TYPE : byte {
+	UNKNOWN,
+	MOUSE,
+	STYLUS,
+	TOUCH
+};
+
+// The AnnotationHandler without Direct2D and mupdf. The input goes through the same StrokeCapture (page lookup, stroke
+// filter and the end of the stroke) and eraser and the finished strokes are quantized and tessellated the same way.
+// The points are in document space
+class HeadlessInk {
+public:
+	// same defaults as the AnnotationHandler
+	static constexpr float STROKE_WIDTH = 1;
+	static constexpr float ERASER_WIDTH = 10;
+	// the sidecar aligns the point data of every stroke
+	static constexpr size_t DATA_ALIGNMENT = 8;
+
+	struct InkStroke {
+		QuantizedStroke m_points;
+		std::vector<byte> m_pressure;
+		float m_strokeWidth = STROKE_WIDTH;
+	};
+
+private:
+	float m_dpiScale = 1;
+	std::vector<Rect2D<float>> m_pages;
+	std::vector<std::list<InkStroke>> m_strokes;
+	StrokeCapture m_capture;
+
+	// document = (window - translation) / scale
+	float m_viewScale = 1;
+	Point2D<float> m_viewTranslation;
+
+	void strokeEnd(StrokeCapture::Stroke&& s);
+
+public:
+	size_t m_lines = 0;
+	size_t m_outlinePoints = 0;
+	size_t m_finishedStrokes = 0;
+	size_t m_erasedStrokes = 0;
+
+	HeadlessInk(const std::vector<Rect2D<float>>& pages, float dpiScale = 1);
+	// the capture points to this object
+	HeadlessInk(const HeadlessInk&) = delete;
+	HeadlessInk& operator=(const HeadlessInk&) = delete;
+
+	void setView(float scale, Point2D<float> translation);
+	Point2D<float> toDocument(Point2D<float> p) const;
+
+	// the timestamp is in seconds
+	void startStroke(Point2D<float> p, UINT32 id, UINT32 pressure, double timestamp);
+	void addStroke(Point2D<float> p, UINT32 id, UINT32 pressure, double timestamp);
+	void endStroke(Point2D<float> p, UINT32 id, double timestamp = 0);
+	// returns the amount of erased strokes
+	size_t eraser(Point2D<float> p);
+
+	// dispatches a recorded event the same way the callbacks in main.cpp do
+	void replay(const InputRecording::Event& e, double timestamp);
+
+	const std::vector<Rect2D<float>>& getPages() const;
+	const std::list<InkStroke>& getStrokes(size_t page) const;
+	size_t getStrokeCount() const;
+	// the same as the ink.stroke_memory_bytes gauge of the AnnotationHandler
+	size_t getMemorySize() const;
+
+	// decodes and tessellates every stroke of the page like the AnnotationHandler does when it creates the outline
+	// geometry. Returns the amount of outline points
+	size_t tessellatePage(size_t page) const;
+	// writes the strokes the way the sidecar stores them: the header, the aligned point data and the pressure
+	std::vector<byte> serialize() const;
+	// FNV-1a over the encoded points of every stroke
+	UINT64 hash() const;
+};
+
+#endif // !HEADLESS_INK_H
@@ -0,0 +1,81 @@
+// Checks the FrameScheduler of the program on a simulated clock. The scheduler has to keep two promises:
+// - there is never more than one frame per display refresh, no matter how often the program invalidates
+// - after the window was idle for at least one refresh, an invalidation is drawn immediately (new ink)
+// The invalidations are random so the patterns cover bursts, single events and long pauses.
+//
+// usage: framecheck [seed] [refresh rate in Hz]
+//        returns 1 if a promise was broken
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "util/FrameScheduler.h"
+
+static UINT64 simulatedTime = 1;
+
+static UINT64 simulatedClock() {
+	return simulatedTime;
+}
+
+static size_t failures = 0;
+
+static void fail(const char* what, UINT64 time) {
+	if (failures++ < 10)
+		std::printf("error at %.3f ms: %s\n", time / 1e6, what);
+}
+
+int main(int argc, char** argv) {
+	UINT32 seed = argc > 1 ? (UINT32)std::strtoul(argv[1], nullptr, 10) : 1;
+	double hz = argc > 2 ? std::atof(argv[2]) : 60;
+	hz = hz > 0 ? hz : 60;
+	const UINT64 refresh = (UINT64)(1e9 / hz);
+	constexpr UINT64 MS = 1'000'000;
+
+	FrameScheduler scheduler(simulatedClock);
+	scheduler.setRefreshInterval(refresh);
+	std::mt19937 random(seed);
+
+	UINT64 lastFrame = 0;
+	UINT64 immediate = 0;
+	for (size_t i = 0; i < 200000; i++) {
+		// mostly pen samples every millisecond, sometimes a pause of up to half a second
+		UINT64 wait = random() % 100 == 0 ? random() % (500 * MS) : random() % (2 * MS);
+		UINT64 until = simulatedTime + wait;
+
+		// draw every frame that is due until then, like the main loop sleeps until getTimeout
+		while (scheduler.getTimeout() <= until - simulatedTime) {
+			simulatedTime += scheduler.getTimeout();
+			if (scheduler.beginFrame() == FrameScheduler::NOTHING) {
+				fail("a frame was due but beginFrame didn't start it", simulatedTime);
+				break;
+			}
+			if (lastFrame != 0 && simulatedTime - lastFrame < refresh)
+				fail("two frames in one refresh interval", simulatedTime);
+			lastFrame = simulatedTime;
+		}
+		simulatedTime = until;
+
+		// nothing happened for a refresh so the next invalidation must not wait
+		bool idle = lastFrame == 0 || simulatedTime - lastFrame >= refresh;
+		bool pending = scheduler.getTimeout() != FrameScheduler::NO_TIMEOUT;
+		scheduler.invalidate(random() % 4 == 0 ? FrameScheduler::FULL : FrameScheduler::INK);
+		if (idle && !pending) {
+			immediate++;
+			if (scheduler.getTimeout() != 0)
+				fail("the first invalidation after idle isn't drawn immediately", simulatedTime);
+		}
+		// a frame is never started before its refresh interval is over
+		if (!idle && scheduler.beginFrame() != FrameScheduler::NOTHING)
+			fail("beginFrame started a frame before the refresh interval was over", simulatedTime);
+	}
+
+	std::printf("%llu frames in %.1f s at %.0f Hz, %llu invalidations, %llu drawn immediately after idle\n",
+		(unsigned long long)scheduler.getFrameCount(), simulatedTime / 1e9, hz, (unsigned long long)scheduler.getInvalidationCount(),
+		(unsigned long long)immediate);
+	if (failures != 0) {
+		std::printf("%zu errors\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,160 @@
+// Checks the log file of the FILE_OUT logger target on a simulated clock in a temporary directory:
+// - errors are in the file as soon as they are written, other lines only after the flush interval or a full buffer
+// - the file is rotated before it gets bigger than the limit, <file>.1 becomes <file>.2 and so on
+// - there are never more files than the limit, the oldest lines are dropped and no line is lost or written twice
+//
+// usage: logcheck
+//        returns 1 if a promise was broken
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "util/LogFile.h"
+
+namespace fs = std::filesystem;
+
+static size_t failures = 0;
+
+static void fail(const char* what) {
+	if (failures++ < 10)
+		std::printf("error: %s\n", what);
+}
+
+static std::string readFile(const fs::path& path) {
+	std::ifstream in(path, std::ios::binary);
+	std::stringstream content;
+	content << in.rdbuf();
+	return content.str();
+}
+
+static std::string createLine(size_t index) {
+	// every line has the same length so the rotation is easy to predict
+	char line[32];
+	std::snprintf(line, sizeof(line), "line %08zu\n", index);
+	return line;
+}
+
+static void checkFlush(const fs::path& directory) {
+	LogFile::Settings settings;
+	settings.m_bufferSize = 1024;
+	settings.m_flushInterval = 1000;
+	LogFile file(directory / "flush.log", settings);
+	auto path = file.getPath(0);
+
+	UINT64 time = 1;
+	file.write("info\n", time, false);
+	file.update(time + 10);
+	if (fs::exists(path) && !readFile(path).empty())
+		fail("a line was written before the flush interval was over");
+
+	file.write("error\n", time + 20, true);
+	if (readFile(path) != "info\nerror\n")
+		fail("an error wasn't written immediately");
+
+	file.write("later\n", time + 30, false);
+	file.update(time + 500);
+	if (readFile(path) != "info\nerror\n")
+		fail("a line was written before the flush interval after the error was over");
+	file.update(time + 20 + settings.m_flushInterval);
+	if (readFile(path) != "info\nerror\nlater\n")
+		fail("a line wasn't written after the flush interval");
+
+	// a full buffer is written without waiting
+	std::string expected = readFile(path);
+	for (size_t i = 0; expected.size() < 3 * settings.m_bufferSize; i++) {
+		auto line = createLine(i);
+		file.write(line, time + 30, false);
+		expected += line;
+	}
+	auto written = readFile(path);
+	if (written.size() + settings.m_bufferSize < expected.size())
+		fail("a full buffer wasn't written");
+	if (expected.compare(0, written.size(), written) != 0)
+		fail("the written lines are different");
+
+	file.close();
+	if (readFile(path) != expected)
+		fail("the lines weren't written when the file was closed");
+	if (file.failed())
+		fail("the file couldn't be opened");
+}
+
+static void checkRotation(const fs::path& directory) {
+	LogFile::Settings settings;
+	settings.m_bufferSize = 100;
+	settings.m_maxFileSize = 1000;
+	settings.m_maxFiles = 3;
+	LogFile file(directory / "rotation.log", settings);
+
+	// enough lines for the oldest ones to be dropped
+	size_t lines = 10 * settings.m_maxFileSize / createLine(0).size();
+	UINT64 time = 1;
+	for (size_t i = 0; i < lines; i++) {
+		// some errors in between so the blocks have different sizes
+		file.write(createLine(i), time++, i % 17 == 0);
+	}
+	file.close();
+
+	if (fs::exists(file.getPath(settings.m_maxFiles)))
+		fail("there are more files than allowed");
+
+	// the files from the oldest to the newest have to continue each other and end with the last line
+	std::string content;
+	for (size_t i = settings.m_maxFiles; i-- > 0;) {
+		auto path = file.getPath(i);
+		if (!fs::exists(path)) {
+			fail("a rotated file is missing");
+			continue;
+		}
+		if (fs::file_size(path) > settings.m_maxFileSize)
+			fail("a file is bigger than allowed");
+		content += readFile(path);
+	}
+
+	auto lineSize = createLine(0).size();
+	if (content.size() % lineSize != 0) {
+		fail("a line was cut");
+		return;
+	}
+	size_t first = lines - content.size() / lineSize;
+	if (first == 0)
+		fail("the oldest lines weren't dropped");
+	for (size_t i = first; i < lines; i++) {
+		if (content.compare((i - first) * lineSize, lineSize, createLine(i)) != 0) {
+			fail("a line is missing or in the wrong file");
+			break;
+		}
+	}
+
+	// a new file continues the newest one and rotates it away when it is full
+	LogFile next(directory / "rotation.log", settings);
+	auto newest = readFile(next.getPath(0));
+	if (newest.size() >= settings.m_maxFileSize)
+		return;
+	std::string block(settings.m_maxFileSize - newest.size() + 1, 'x');
+	block.back() = '\n';
+	next.write(block, time, true);
+	next.close();
+	if (readFile(next.getPath(1)) != newest || readFile(next.getPath(0)) != block)
+		fail("a full file wasn't rotated after it was opened again");
+}
+
+int main() {
+	auto directory = fs::temp_directory_path() / "logcheck";
+	std::error_code error;
+	fs::remove_all(directory, error);
+	fs::create_directories(directory);
+
+	checkFlush(directory);
+	checkRotation(directory);
+
+	fs::remove_all(directory, error);
+	if (failures != 0) {
+		std::printf("%zu errors\n", failures);
+		return 1;
+	}
+	std::printf("the log file was flushed and rotated\n");
+	return 0;
+}
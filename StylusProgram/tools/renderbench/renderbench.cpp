@@ -0,0 +1,422 @@
+// Headless pdf render benchmark. Renders every page of the documents with PDFHandler::renderPage, the same mupdf
+// pipeline PDF::createBitmapFromPage uses without the upload into a Direct2D bitmap, for a set of dpis and zoom
+// factors. It reports the pages per second, the distribution of the time per page and the peak memory of mupdf and
+// of the process. Every page is also coded with PixelCodec like the render worker does, which reports how small the
+// pages get in memory and how long restoring them takes. The results are printed as csv so corpora and builds can be
+// compared.
+//
+// With --ink it measures loading the strokes of a document instead. It writes generated handwriting as ink
+// annotations like AnnotationHandler::bakeAnnotations, saves the pdf and opens it again. The strokes are loaded once
+// by reading every vertex of the annotations like PdfStroke does and once from the sidecar, where the points and the
+// pressure stay in the mapped file.
+//
+// usage: renderbench [--dpi 96,144] [--zoom 0.5,1,2] [--repeat n] [--draft] file.pdf...
+//        renderbench --ink 100,1000 [--repeat n]
+//        --draft renders the pages with the draft quality that is used while the view moves
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Allocations.h"
+#include "HandwritingGenerator.h"
+#include "HeadlessInk.h"
+#include <mupdf/pdf.h>
+#include "pdf/PageRender.h"
+#include "util/PixelCodec.h"
+
+using Clock = std::chrono::steady_clock;
+
+// every mupdf allocation has a header with its size so the peak memory of mupdf can be tracked
+struct alignas(16) AllocationHeader {
+	size_t m_size;
+};
+
+static size_t mupdfMemory = 0;
+static size_t mupdfPeak = 0;
+
+static void* mupdfMalloc(void*, size_t size) {
+	auto header = (AllocationHeader*)std::malloc(sizeof(AllocationHeader) + size);
+	if (header == nullptr)
+		return nullptr;
+	header->m_size = size;
+	mupdfMemory += size;
+	mupdfPeak = max(mupdfPeak, mupdfMemory);
+	return header + 1;
+}
+
+static void mupdfFree(void*, void* p) {
+	if (p == nullptr)
+		return;
+	auto header = (AllocationHeader*)p - 1;
+	mupdfMemory -= header->m_size;
+	std::free(header);
+}
+
+static void* mupdfRealloc(void* user, void* p, size_t size) {
+	if (p == nullptr)
+		return mupdfMalloc(user, size);
+	auto header = (AllocationHeader*)p - 1;
+	auto old = header->m_size;
+	header = (AllocationHeader*)std::realloc(header, sizeof(AllocationHeader) + size);
+	if (header == nullptr)
+		return nullptr;
+	header->m_size = size;
+	mupdfMemory = mupdfMemory - old + size;
+	mupdfPeak = max(mupdfPeak, mupdfMemory);
+	return header + 1;
+}
+
+static std::vector<float> parseList(const char* s) {
+	std::vector<float> values;
+	while (*s != '\0') {
+		char* end;
+		values.push_back(std::strtof(s, &end));
+		if (end == s)
+			break;
+		s = *end == ',' ? end + 1 : end;
+	}
+	return values;
+}
+
+// the value at p (0 - 1) of the sorted values
+static double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty())
+		return 0;
+	return sorted[min((size_t)(p * sorted.size()), sorted.size() - 1)];
+}
+
+static void benchDocument(fz_context* ctx, const char* path, const std::vector<float>& dpis, const std::vector<float>& zooms, size_t repeat, bool draft) {
+	fz_document* doc = nullptr;
+	fz_var(doc);
+	fz_try(ctx) {
+		doc = fz_open_document(ctx, path);
+	}
+	fz_catch(ctx) {
+		std::fprintf(stderr, "couldn't open %s: %s\n", path, fz_caught_message(ctx));
+		return;
+	}
+
+	// the pages stay loaded like they do in the PDF struct
+	std::vector<fz_page*> pages;
+	std::vector<Rect2D<float>> sizes;
+	auto load = Clock::now();
+	int pagecount = fz_count_pages(ctx, doc);
+	for (int i = 0; i < pagecount; i++) {
+		fz_page* page = nullptr;
+		fz_var(page);
+		fz_try(ctx) {
+			page = fz_load_page(ctx, doc, i);
+		}
+		fz_catch(ctx) {
+			std::fprintf(stderr, "couldn't load page %d of %s: %s\n", i, path, fz_caught_message(ctx));
+			continue;
+		}
+		auto bounds = fz_bound_page(ctx, page);
+		pages.push_back(page);
+		sizes.push_back(Rect2D<float>({ 0, 0 }, bounds.x1, bounds.y1));
+	}
+	double loadms = std::chrono::duration<double, std::milli>(Clock::now() - load).count();
+
+	for (auto dpi : dpis) {
+		for (auto zoom : zooms) {
+			std::vector<double> times;
+			std::vector<double> decodetimes;
+			double pixels = 0;
+			double rawbytes = 0;
+			double encodedbytes = 0;
+			std::vector<byte> decoded;
+			size_t failed = 0;
+			// the peak of every row starts with the memory the loaded document already uses
+			mupdfPeak = mupdfMemory;
+			auto start = Clock::now();
+			for (size_t r = 0; r < repeat; r++) {
+				for (size_t i = 0; i < pages.size(); i++) {
+					auto& size = sizes[i];
+					// the PDFBuilder renders the whole page with the size it has on the screen
+					Rect2D<float> destination({ 0, 0 }, size.width * zoom, size.height * zoom);
+					auto begin = Clock::now();
+					fz_pixmap* pix = nullptr;
+					fz_var(pix);
+					fz_try(ctx) {
+						pix = PDFHandler::renderPage(ctx, pages[i], destination, size, dpi, draft);
+					}
+					fz_catch(ctx) {
+						failed++;
+						continue;
+					}
+					times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+					pixels += (double)fz_pixmap_width(ctx, pix) * fz_pixmap_height(ctx, pix);
+
+					// not part of the render time, the worker codes the pages after they are rendered
+					auto encoded = PixelCodec::encode(pix->samples, pix->w, pix->h, (UINT32)pix->stride);
+					rawbytes += (double)pix->w * pix->h * 4;
+					encodedbytes += encoded.size();
+					decoded.resize((size_t)pix->w * pix->h * 4);
+					auto decodebegin = Clock::now();
+					if (!PixelCodec::decode(encoded.data(), encoded.size(), decoded.data(), pix->w, pix->h, pix->w * 4))
+						std::fprintf(stderr, "couldn't decode page %zu of %s\n", i, path);
+					decodetimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - decodebegin).count());
+					fz_drop_pixmap(ctx, pix);
+				}
+			}
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			std::sort(times.begin(), times.end());
+			std::sort(decodetimes.begin(), decodetimes.end());
+
+			std::printf("%s,%zu,%.3f,%g,%g,%s,%zu,%.2f,%.3f,%.3f,%.3f,%.3f,%.1f,%.2f,%.3f,%.3f,%zu,%zu\n",
+				path, pages.size(), loadms, dpi, zoom, draft ? "draft" : "full", failed,
+				times.size() / max(seconds, 1e-9),
+				percentile(times, 0.5), percentile(times, 0.9), percentile(times, 0.99), times.empty() ? 0 : times.back(),
+				pixels / 1e6 / max(seconds, 1e-9),
+				rawbytes / max(encodedbytes, 1.0), percentile(decodetimes, 0.5), percentile(decodetimes, 0.99),
+				mupdfPeak >> 10, Allocations::peakResidentMemory() >> 10);
+			std::fflush(stdout);
+		}
+	}
+
+	for (auto page : pages)
+		fz_drop_page(ctx, page);
+	fz_drop_document(ctx, doc);
+}
+
+// the custom entry the AnnotationHandler stores the pressure of a stroke in
+static const char* PRESSURE_ANNOT_KEY = "StylusPressure";
+
+// writes the strokes as ink annotations like AnnotationHandler::bakeAnnotations and returns the saved pdf
+static fz_buffer* createInkDocument(fz_context* ctx, const HeadlessInk& ink) {
+	pdf_document* doc = nullptr;
+	pdf_page* page = nullptr;
+	pdf_annot* annot = nullptr;
+	fz_buffer* buffer = nullptr;
+	fz_output* out = nullptr;
+	fz_var(doc);
+	fz_var(page);
+	fz_var(annot);
+	fz_var(buffer);
+	fz_var(out);
+	fz_try(ctx) {
+		doc = pdf_create_document(ctx);
+		auto& pages = ink.getPages();
+		for (size_t i = 0; i < pages.size(); i++) {
+			auto pageobj = pdf_add_page(ctx, doc, fz_make_rect(0, 0, pages[i].width, pages[i].height), 0, nullptr, nullptr);
+			pdf_insert_page(ctx, doc, -1, pageobj);
+			pdf_drop_obj(ctx, pageobj);
+			page = pdf_load_page(ctx, doc, (int)i);
+			for (auto& s : ink.getStrokes(i)) {
+				annot = pdf_create_annot(ctx, page, PDF_ANNOT_INK);
+				auto points = s.m_points.decode();
+				pdf_add_annot_ink_list_stroke(ctx, annot);
+				for (auto& p : points)
+					pdf_add_annot_ink_list_stroke_vertex(ctx, annot, fz_make_point(p.x, p.y));
+				if (s.m_pressure.size() != 0)
+					pdf_dict_puts_drop(ctx, pdf_annot_obj(ctx, annot), PRESSURE_ANNOT_KEY, pdf_new_string(ctx, (const char*)s.m_pressure.data(), s.m_pressure.size()));
+				pdf_set_annot_border_width(ctx, annot, s.m_strokeWidth);
+				pdf_update_annot(ctx, annot);
+				pdf_drop_annot(ctx, annot);
+				annot = nullptr;
+			}
+			fz_drop_page(ctx, (fz_page*)page);
+			page = nullptr;
+		}
+
+		buffer = fz_new_buffer(ctx, 1024 * 1024);
+		out = fz_new_output_with_buffer(ctx, buffer);
+		auto options = pdf_default_write_options;
+		pdf_write_document(ctx, doc, out, &options);
+		fz_close_output(ctx, out);
+	}
+	fz_always(ctx) {
+		fz_drop_output(ctx, out);
+		pdf_drop_annot(ctx, annot);
+		fz_drop_page(ctx, (fz_page*)page);
+		pdf_drop_document(ctx, doc);
+	}
+	fz_catch(ctx) {
+		std::fprintf(stderr, "couldn't create the ink document: %s\n", fz_caught_message(ctx));
+		fz_drop_buffer(ctx, buffer);
+		return nullptr;
+	}
+	return buffer;
+}
+
+struct LoadedStroke {
+	QuantizedStroke m_points;
+	// the copied pressure of an annotation
+	std::vector<byte> m_pressure;
+	// the pressure in the sidecar
+	const byte* m_pressureView = nullptr;
+};
+
+// opens the saved pdf and loads the stroke of every ink annotation. Without a sidecar every vertex and the pressure
+// are read from the annotation, with one they are views into it if the point count still matches. Returns the
+// milliseconds from opening the document until every stroke is loaded
+static double loadInkDocument(fz_context* ctx, fz_buffer* pdf, const std::vector<byte>* sidecar, std::vector<LoadedStroke>& strokes) {
+	strokes.clear();
+	auto begin = Clock::now();
+	fz_stream* stream = nullptr;
+	pdf_document* doc = nullptr;
+	pdf_page* page = nullptr;
+	fz_var(stream);
+	fz_var(doc);
+	fz_var(page);
+	fz_try(ctx) {
+		stream = fz_open_buffer(ctx, pdf);
+		doc = pdf_open_document_with_stream(ctx, stream);
+		size_t offset = 0;
+		int pagecount = pdf_count_pages(ctx, doc);
+		for (int i = 0; i < pagecount; i++) {
+			page = pdf_load_page(ctx, doc, i);
+			for (auto annot = pdf_first_annot(ctx, page); annot != nullptr; annot = pdf_next_annot(ctx, annot)) {
+				if (pdf_annot_type(ctx, annot) != PDF_ANNOT_INK)
+					continue;
+				int count = pdf_annot_ink_list_stroke_count(ctx, annot, 0);
+				LoadedStroke stroke;
+
+				// the sidecar has the strokes in the same order as the annotations
+				if (sidecar != nullptr && offset + sizeof(QuantizedStroke::Header) <= sidecar->size()) {
+					QuantizedStroke::Header header;
+					std::memcpy(&header, sidecar->data() + offset, sizeof(header));
+					offset += sizeof(header);
+					offset = (offset + HeadlessInk::DATA_ALIGNMENT - 1) / HeadlessInk::DATA_ALIGNMENT * HeadlessInk::DATA_ALIGNMENT;
+					auto data = sidecar->data() + offset;
+					offset += QuantizedStroke::getDataSize(header);
+					auto pressure = sidecar->data() + offset;
+					offset += header.m_size;
+					if ((int)header.m_size == count) {
+						stroke.m_points = QuantizedStroke::fromView(header, data);
+						stroke.m_pressureView = pressure;
+						strokes.push_back(std::move(stroke));
+						continue;
+					}
+				}
+
+				std::vector<Point2D<float>> points;
+				points.reserve(count);
+				for (int k = 0; k < count; k++) {
+					auto p = pdf_annot_ink_list_stroke_vertex(ctx, annot, 0, k);
+					points.push_back(Point2D<float>(p.x, p.y));
+				}
+				stroke.m_points = QuantizedStroke(points);
+				auto pressure = pdf_dict_gets(ctx, pdf_annot_obj(ctx, annot), PRESSURE_ANNOT_KEY);
+				if (pdf_is_string(ctx, pressure)) {
+					size_t length = 0;
+					auto data = (const byte*)pdf_to_string(ctx, pressure, &length);
+					if (length == stroke.m_points.size())
+						stroke.m_pressure.assign(data, data + length);
+				}
+				strokes.push_back(std::move(stroke));
+			}
+			fz_drop_page(ctx, (fz_page*)page);
+			page = nullptr;
+		}
+	}
+	fz_always(ctx) {
+		fz_drop_page(ctx, (fz_page*)page);
+		pdf_drop_document(ctx, doc);
+		fz_drop_stream(ctx, stream);
+	}
+	fz_catch(ctx) {
+		std::fprintf(stderr, "couldn't load the ink document: %s\n", fz_caught_message(ctx));
+		return -1;
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+}
+
+static void benchInk(fz_context* ctx, size_t n, size_t repeat) {
+	auto pages = HandwritingGenerator::createPages(n / 150 + 1);
+	HandwritingGenerator generator(pages, 1);
+	HeadlessInk ink(pages);
+	std::vector<HandwritingGenerator::Sample> samples;
+	for (size_t i = 0; i < n && generator.nextStroke(samples); i++) {
+		ink.startStroke(samples.front().m_pos, 1, samples.front().m_pressure, samples.front().m_time);
+		for (size_t j = 1; j + 1 < samples.size(); j++)
+			ink.addStroke(samples[j].m_pos, 1, samples[j].m_pressure, samples[j].m_time);
+		ink.endStroke(samples.back().m_pos, 1, samples.back().m_time);
+	}
+
+	auto pdf = createInkDocument(ctx, ink);
+	if (pdf == nullptr)
+		return;
+	auto sidecar = ink.serialize();
+
+	std::vector<double> imports;
+	std::vector<double> sidecars;
+	std::vector<LoadedStroke> strokes;
+	size_t imported = 0;
+	size_t viewed = 0;
+	for (size_t r = 0; r < repeat; r++) {
+		imports.push_back(loadInkDocument(ctx, pdf, nullptr, strokes));
+		imported = strokes.size();
+		sidecars.push_back(loadInkDocument(ctx, pdf, &sidecar, strokes));
+		viewed = std::count_if(strokes.begin(), strokes.end(), [](auto& s) { return s.m_points.isView(); });
+	}
+	std::sort(imports.begin(), imports.end());
+	std::sort(sidecars.begin(), sidecars.end());
+
+	// a stroke that didn't come out of the sidecar means the layout doesn't match the annotations
+	if (viewed != imported)
+		std::fprintf(stderr, "only %zu of %zu strokes were loaded from the sidecar\n", viewed, imported);
+	double importms = percentile(imports, 0.5);
+	double sidecarms = percentile(sidecars, 0.5);
+	std::printf("%zu,%zu,%zu,%zu,%.3f,%.3f,%.2f\n", imported, pages.size(), fz_buffer_storage(ctx, pdf, nullptr) >> 10,
+		sidecar.size() >> 10, importms, sidecarms, importms / max(sidecarms, 1e-9));
+	std::fflush(stdout);
+	fz_drop_buffer(ctx, pdf);
+}
+
+int main(int argc, char** argv) {
+	std::vector<float> dpis = { 96, 144 };
+	std::vector<float> zooms = { 0.5f, 1, 2 };
+	size_t repeat = 1;
+	bool draft = false;
+	std::vector<float> inkstrokes;
+	std::vector<const char*> files;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--dpi") == 0 && i + 1 < argc)
+			dpis = parseList(argv[++i]);
+		else if (std::strcmp(argv[i], "--zoom") == 0 && i + 1 < argc)
+			zooms = parseList(argv[++i]);
+		else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = max((size_t)std::strtoul(argv[++i], nullptr, 10), (size_t)1);
+		else if (std::strcmp(argv[i], "--draft") == 0)
+			draft = true;
+		else if (std::strcmp(argv[i], "--ink") == 0 && i + 1 < argc)
+			inkstrokes = parseList(argv[++i]);
+		else
+			files.push_back(argv[i]);
+	}
+	if (files.empty() && inkstrokes.empty()) {
+		std::printf("usage: %s [--dpi 96,144] [--zoom 0.5,1,2] [--repeat n] [--draft] file.pdf...\n", argv[0]);
+		std::printf("       %s --ink 100,1000 [--repeat n]\n", argv[0]);
+		return 1;
+	}
+
+	fz_alloc_context allocator = { nullptr, mupdfMalloc, mupdfRealloc, mupdfFree };
+	// same store size as the MUPDF class
+	fz_context* ctx = fz_new_context(&allocator, nullptr, FZ_STORE_DEFAULT);
+	if (ctx == nullptr) {
+		std::fprintf(stderr, "couldn't create the mupdf context\n");
+		return 1;
+	}
+	fz_register_document_handlers(ctx);
+
+	if (!inkstrokes.empty()) {
+		std::printf("strokes,pages,pdf_kb,sidecar_kb,annotation_import_ms,sidecar_ms,speedup\n");
+		for (auto n : inkstrokes)
+			benchInk(ctx, (size_t)n, repeat);
+		fz_drop_context(ctx);
+		return 0;
+	}
+
+	std::printf("file,pages,load_ms,dpi,zoom,quality,failed,pages_per_s,p50_ms,p90_ms,p99_ms,max_ms,mpixels_per_s,encoded_ratio,decode_p50_ms,decode_p99_ms,mupdf_peak_kb,peak_rss_kb\n");
+	for (auto file : files)
+		benchDocument(ctx, file, dpis, zooms, repeat, draft);
+
+	fz_drop_context(ctx);
+	return 0;
+}
@@ -0,0 +1,149 @@
+// Headless replay of an input recording (Ctrl+R in the program). It runs the recorded pointer stream through the
+// StrokeCapture and the eraser of the AnnotationHandler, quantizes and tessellates the strokes like it does and
+// applies the recorded view transform. It runs as fast as possible and reports the throughput and the
+// allocations. The result hash only depends on the recording so two runs can be compared.
+// The FrameScheduler of the program is run on the recorded timestamps to show how many frames the session needs
+// and how long an invalidation waits for its frame. tools/framecheck checks the promises of the scheduler.
+//
+// usage: replay <recording> [repeat] [refresh rate in Hz]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#include "Allocations.h"
+#include "HeadlessInk.h"
+#include "util/FrameScheduler.h"
+
+// the recorded time replaces the clock of the frame scheduler
+static UINT64 simulatedTime = 1;
+
+static UINT64 simulatedClock() {
+	return simulatedTime;
+}
+
+// what the program invalidates for the event
+static void invalidate(FrameScheduler& scheduler, const InputRecording::Event& e) {
+	bool button1 = (e.m_buttons & 1) != 0;
+	bool button2 = (e.m_buttons & 2) != 0;
+	switch (e.m_type) {
+	case InputRecording::VIEW:
+		scheduler.invalidate(FrameScheduler::FULL);
+		return;
+	case InputRecording::POINTER_DOWN:
+	case InputRecording::POINTER_MOVE:
+		if (e.m_pointerType == TOUCH) {
+			if (e.m_type == InputRecording::POINTER_MOVE)
+				scheduler.invalidate(FrameScheduler::FULL);
+		}
+		// the eraser only redraws the strokes it hit. This assumes it hit a stroke of the size of the eraser
+		else if (button2)
+			scheduler.invalidate(Rect2D<float>({ e.m_x - 10, e.m_y - 10 }, 20, 20));
+		else if (e.m_pointerType == STYLUS || button1)
+			scheduler.invalidate(FrameScheduler::INK);
+		return;
+	case InputRecording::POINTER_UP:
+		if (e.m_pointerType == TOUCH)
+			scheduler.invalidate(FrameScheduler::FULL);
+		return;
+	default:
+		return;
+	}
+}
+
+static void simulateFrames(const InputRecording::Recording& recording, double hz) {
+	FrameScheduler scheduler(simulatedClock);
+	scheduler.setRefreshInterval((UINT64)(1e9 / hz));
+	simulatedTime = 1;
+	std::vector<UINT64> delays;
+	size_t fullFrames = 0;
+	size_t regionFrames = 0;
+
+	// draws every frame that is due until the time
+	auto runUntil = [&](UINT64 time) {
+		while (scheduler.getTimeout() <= time - simulatedTime) {
+			simulatedTime += scheduler.getTimeout();
+			auto frame = scheduler.beginFrame();
+			fullFrames += (frame & FrameScheduler::FULL) != 0;
+			regionFrames += (frame & FrameScheduler::REGION) != 0;
+			delays.push_back(scheduler.getFrameDelay());
+		}
+		simulatedTime = time;
+	};
+
+	for (auto& e : recording.m_events) {
+		runUntil(simulatedTime + (UINT64)e.m_delta * 1000);
+		invalidate(scheduler, e);
+	}
+	runUntil(simulatedTime + scheduler.getRefreshInterval());
+
+	std::sort(delays.begin(), delays.end());
+	auto percentile = [&](double p) {
+		return delays.empty() ? 0 : delays[min((size_t)(p * delays.size()), delays.size() - 1)] / 1e6;
+	};
+	std::printf("frames at %.0f Hz: %llu (%zu full, %zu partial), %llu invalidations (%.1f per frame)\n", hz,
+		(unsigned long long)scheduler.getFrameCount(), fullFrames, regionFrames, (unsigned long long)scheduler.getInvalidationCount(),
+		scheduler.getFrameCount() == 0 ? 0.0 : (double)scheduler.getInvalidationCount() / scheduler.getFrameCount());
+	std::printf("  invalidation to frame ms: p50 %.2f p99 %.2f max %.2f\n", percentile(0.5), percentile(0.99), delays.empty() ? 0 : delays.back() / 1e6);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::printf("usage: %s <recording> [repeat] [refresh rate in Hz]\n", argv[0]);
+		return 1;
+	}
+	size_t repeat = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+	repeat = max(repeat, (size_t)1);
+	double hz = argc > 3 ? std::atof(argv[3]) : 60;
+	hz = hz > 0 ? hz : 60;
+
+	std::ifstream file(argv[1], std::ios::binary);
+	std::vector<byte> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	InputRecording::Recording recording;
+	if (!InputRecording::parse(data.data(), data.size(), recording)) {
+		std::printf("%s is not a valid recording\n", argv[1]);
+		return 1;
+	}
+
+	UINT64 duration = 0;
+	for (auto& e : recording.m_events)
+		duration += e.m_delta;
+	std::printf("%zu events, %zu pages, %.1f s recorded\n", recording.m_events.size(), recording.m_pages.size(), duration / 1e6);
+
+	simulateFrames(recording, hz);
+
+	std::vector<UINT32> eventTime(recording.m_events.size());
+	for (size_t r = 0; r < repeat; r++) {
+		HeadlessInk ink(recording.m_pages, recording.m_header.m_dpiScale);
+		double timestamp = 0;
+
+		auto startAllocations = Allocations::count();
+		auto startBytes = Allocations::bytes();
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < recording.m_events.size(); i++) {
+			auto& e = recording.m_events[i];
+			timestamp += e.m_delta / 1e6;
+			auto t = std::chrono::steady_clock::now();
+			ink.replay(e, timestamp);
+			eventTime[i] = (UINT32)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto allocs = Allocations::count() - startAllocations;
+		auto bytes = Allocations::bytes() - startBytes;
+
+		std::sort(eventTime.begin(), eventTime.end());
+		auto percentile = [&](double p) {
+			return eventTime.empty() ? 0 : eventTime[min((size_t)(p * eventTime.size()), eventTime.size() - 1)];
+		};
+
+		std::printf("run %zu: %.2f ms, %.0f events/s, %.1fx real time\n", r + 1, seconds * 1e3, recording.m_events.size() / seconds, duration / 1e6 / seconds);
+		std::printf("  event ns: p50 %u p99 %u p999 %u max %u\n", percentile(0.5), percentile(0.99), percentile(0.999), eventTime.empty() ? 0 : eventTime.back());
+		std::printf("  allocations: %zu (%.2f per event, %zu bytes)\n", allocs, recording.m_events.empty() ? 0.0 : (double)allocs / recording.m_events.size(), bytes);
+		std::printf("  strokes: %zu finished, %zu erased, %zu left, %zu lines, %zu outline points\n", ink.m_finishedStrokes, ink.m_erasedStrokes, ink.getStrokeCount(), ink.m_lines, ink.m_outlinePoints);
+		std::printf("  hash: %016llx\n", (unsigned long long)ink.hash());
+	}
+	return 0;
+}
@@ -0,0 +1,163 @@
+// Scaling test with synthetic handwriting. For every document size the generated strokes are fed through
+// startStroke, addStroke and endStroke and the tool reports how the stroke memory, the eraser, the per page
+// tessellation (what the renderer has to build) and the serialization (what saving has to write) scale.
+// The results are printed as csv so they can be plotted. Fails if fewer strokes were kept than were drawn.
+//
+// usage: stress [strokes...] [--seed n] [--record file]
+//        --record writes the strokes of the first size as an input recording for tools/replay
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Allocations.h"
+#include "HandwritingGenerator.h"
+#include "HeadlessInk.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// the value at p (0 - 1) of the sorted values
+static double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty())
+		return 0;
+	return sorted[min((size_t)(p * sorted.size()), sorted.size() - 1)];
+}
+
+static void writeRecording(const char* path, size_t strokes, UINT32 seed) {
+	auto pages = HandwritingGenerator::createPages(strokes / 150 + 1);
+	HandwritingGenerator generator(pages, seed);
+	InputRecording::Recorder recorder;
+	recorder.start(1, pages, 0);
+	recorder.setView(1, { 0, 0 }, 0);
+
+	std::vector<HandwritingGenerator::Sample> samples;
+	for (size_t i = 0; i < strokes && generator.nextStroke(samples); i++) {
+		for (size_t j = 0; j < samples.size(); j++) {
+			auto type = j == 0 ? InputRecording::POINTER_DOWN : j + 1 == samples.size() ? InputRecording::POINTER_UP : InputRecording::POINTER_MOVE;
+			auto& s = samples[j];
+			recorder.addPointer(type, 1, STYLUS, 0, s.m_pos, s.m_pressure, (UINT64)(s.m_time * 1e9));
+		}
+	}
+
+	auto data = recorder.stop();
+	std::ofstream file(path, std::ios::binary);
+	file.write((const char*)data.data(), data.size());
+	std::fprintf(stderr, "wrote %zu bytes to %s\n", data.size(), path);
+}
+
+// returns false if a stroke that was drawn on a page got lost
+static bool run(size_t strokes, UINT32 seed) {
+	// the generator fills about 200 words per page so there are always enough pages
+	auto pages = HandwritingGenerator::createPages(strokes / 150 + 1);
+	HandwritingGenerator generator(pages, seed);
+	HeadlessInk ink(pages);
+
+	auto rssbefore = Allocations::residentMemory();
+	auto allocsbefore = Allocations::count();
+
+	// ingest
+	std::vector<HandwritingGenerator::Sample> samples;
+	size_t samplecount = 0;
+	size_t drawn = 0;
+	double ingest = 0;
+	for (size_t i = 0; i < strokes && generator.nextStroke(samples); i++) {
+		auto start = Clock::now();
+		ink.startStroke(samples.front().m_pos, 1, samples.front().m_pressure, samples.front().m_time);
+		for (size_t j = 1; j + 1 < samples.size(); j++)
+			ink.addStroke(samples[j].m_pos, 1, samples[j].m_pressure, samples[j].m_time);
+		ink.endStroke(samples.back().m_pos, 1, samples.back().m_time);
+		ingest += secondsSince(start);
+		samplecount += samples.size();
+		drawn++;
+	}
+	auto allocs = Allocations::count() - allocsbefore;
+	auto memory = ink.getMemorySize();
+	auto rss = Allocations::residentMemory() - min(rssbefore, Allocations::residentMemory());
+	size_t finished = ink.getStrokeCount();
+
+	// tessellate every page that has strokes, like the renderer needs it when a page becomes visible
+	std::vector<double> pagetimes;
+	size_t usedpages = 0;
+	for (size_t i = 0; i < pages.size(); i++) {
+		if (ink.getStrokes(i).empty())
+			continue;
+		usedpages++;
+		auto start = Clock::now();
+		ink.tessellatePage(i);
+		pagetimes.push_back(secondsSince(start) * 1e3);
+	}
+	std::sort(pagetimes.begin(), pagetimes.end());
+
+	// save
+	auto start = Clock::now();
+	auto data = ink.serialize();
+	double save = secondsSince(start);
+
+	// erase at random positions on the used pages. Most of them miss which is the slowest case because every stroke
+	// of the page has to be checked
+	std::vector<double> erasetimes;
+	size_t erases = min(strokes / 10, (size_t)1000);
+	std::mt19937 random(seed);
+	for (size_t i = 0; i < erases && usedpages != 0; i++) {
+		auto& page = pages[random() % usedpages];
+		Point2D<float> p(page.upperleft.x + std::uniform_real_distribution<float>(0, page.width)(random), page.upperleft.y + std::uniform_real_distribution<float>(0, page.height)(random));
+		auto begin = Clock::now();
+		ink.eraser(p);
+		erasetimes.push_back(secondsSince(begin) * 1e6);
+	}
+	std::sort(erasetimes.begin(), erasetimes.end());
+
+	std::printf("%zu,%zu,%zu,%.3f,%.0f,%zu,%.1f,%zu,%.1f,%.3f,%.3f,%.1f,%.1f,%zu,%.2f,%zu\n",
+		finished, usedpages, samplecount,
+		ingest * 1e3, samplecount / max(ingest, 1e-9),
+		memory, (double)memory / max(finished, (size_t)1), rss, (double)allocs / max(finished, (size_t)1),
+		percentile(pagetimes, 0.5), percentile(pagetimes, 1),
+		percentile(erasetimes, 0.5), percentile(erasetimes, 0.99), ink.m_erasedStrokes,
+		save * 1e3, data.size());
+	std::fflush(stdout);
+
+	// the generator only writes on the pages so every stroke has to be kept, even a single dot
+	if (finished != drawn) {
+		std::fprintf(stderr, "error: %zu strokes were drawn but %zu were kept\n", drawn, finished);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	std::vector<size_t> sizes;
+	UINT32 seed = 1;
+	const char* record = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = (UINT32)std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			record = argv[++i];
+		else
+			sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+	}
+	if (sizes.empty())
+		sizes = { 1000, 10000, 100000 };
+
+	if (record != nullptr) {
+		writeRecording(record, sizes.front(), seed);
+		return 0;
+	}
+
+	std::printf("strokes,pages,samples,ingest_ms,samples_per_s,memory_bytes,bytes_per_stroke,rss_bytes,allocs_per_stroke,"
+		"page_tessellate_p50_ms,page_tessellate_max_ms,erase_p50_us,erase_p99_us,erased,save_ms,save_bytes\n");
+	bool passed = true;
+	for (auto n : sizes)
+		passed &= run(n, seed);
+	std::fprintf(stderr, "peak rss %zu MB\n", Allocations::peakResidentMemory() >> 20);
+	return passed ? 0 : 1;
+}